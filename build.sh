@@ -21,7 +21,7 @@ mkdir -p output # Create output directory
 # Build the main analyzer
 print_status "Building analyzer (main)"
 gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -o output/analyzer \
-  main.c \
+  main.c plugins/sync/item_pool.c plugins/sync/output_sink.c plugins/sync/line_reader.c plugins/sync/scheduler.c plugins/sync/affinity.c plugins/sync/coroutine.c \
   -ldl -lpthread
 
 # Build the sync unit tests
@@ -29,10 +29,53 @@ print_status "Building sync unit tests"
 gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/monitor_test \
   plugins/sync/monitor_test.c plugins/sync/monitor.c -lpthread
 
+# Same tests against the portable mutex/condvar monitor (the default on Linux is futex based)
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -DMONITOR_USE_FUTEX=0 -Wall -Wextra -O2 -Iplugins -o output/monitor_pthread_test \
+  plugins/sync/monitor_test.c plugins/sync/monitor.c -lpthread
+
 # Build the consumer-producer unit tests
 gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/consumer_producer_test \
   plugins/sync/consumer_producer_test.c \
-  plugins/sync/monitor.c plugins/sync/consumer_producer.c -lpthread
+  plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/item_pool.c -lpthread
+
+# Build the item pool unit tests
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/item_pool_test \
+  plugins/sync/item_pool_test.c \
+  plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/item_pool.c -lpthread
+
+# Build the output sink unit tests
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/output_sink_test \
+  plugins/sync/output_sink_test.c plugins/sync/output_sink.c -lpthread
+
+# Build the line reader unit tests
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/line_reader_test \
+  plugins/sync/line_reader_test.c plugins/sync/line_reader.c
+
+# Build the scheduler unit tests
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/scheduler_test \
+  plugins/sync/scheduler_test.c plugins/sync/scheduler.c -lpthread
+
+# Build the affinity unit tests
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/affinity_test \
+  plugins/sync/affinity_test.c plugins/sync/affinity.c -lpthread
+
+# Build the coroutine unit tests
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/coroutine_test \
+  plugins/sync/coroutine_test.c plugins/sync/coroutine.c -lpthread
+
+# Build the plugin microbenchmarks
+print_status "Building benchmarks"
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/uppercaser_bench \
+  plugins/uppercaser_bench.c plugins/plugin_common.c \
+  plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/item_pool.c plugins/sync/output_sink.c plugins/sync/scheduler.c plugins/sync/affinity.c plugins/sync/coroutine.c plugins/sync/byte_reverse.c -ldl -lpthread
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/flipper_bench \
+  plugins/flipper_bench.c plugins/plugin_common.c \
+  plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/item_pool.c plugins/sync/output_sink.c plugins/sync/scheduler.c plugins/sync/affinity.c plugins/sync/coroutine.c plugins/sync/byte_reverse.c -ldl -lpthread
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/expander_bench \
+  plugins/expander_bench.c plugins/plugin_common.c \
+  plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/item_pool.c plugins/sync/output_sink.c plugins/sync/scheduler.c plugins/sync/affinity.c plugins/sync/coroutine.c plugins/sync/byte_reverse.c -ldl -lpthread
+gcc -std=c11 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2 -Iplugins -o output/ingest_bench \
+  plugins/ingest_bench.c plugins/sync/line_reader.c
 
 # Build the plugins
 print_status "Building plugins"
@@ -45,11 +88,17 @@ for plugin_name in "${plugins[@]}"; do
   fi
   # Build each plugin
   print_status "Building plugin: $plugin_name"
-  gcc -std=c11 -D_POSIX_C_SOURCE=200809L -fPIC -shared -Wall -Wextra -O2 -o output/${plugin_name}.so \ 
+  gcc -std=c11 -D_POSIX_C_SOURCE=200809L -fPIC -shared -Wall -Wextra -O2 -o output/${plugin_name}.so \
     plugins/${plugin_name}.c \
     plugins/plugin_common.c \
     plugins/sync/monitor.c \
     plugins/sync/consumer_producer.c \
+    plugins/sync/item_pool.c \
+    plugins/sync/output_sink.c \
+    plugins/sync/scheduler.c \
+    plugins/sync/affinity.c \
+    plugins/sync/coroutine.c \
+    plugins/sync/byte_reverse.c \
     -ldl -lpthread
 done
 
@@ -1,184 +1,829 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <dlfcn.h>
-#include <errno.h>
-#include "plugins/plugin_sdk.h"
-
-typedef struct {
-    plugin_init_func_t init;
-    plugin_fini_func_t fini;
-    plugin_place_work_func_t place_work;
-    plugin_attach_func_t attach;
-    plugin_wait_finished_func_t wait_finished;
-    plugin_get_name_func_t get_name;
-    char* name;
-    void* handle;
-} plugin_handle_t;
-
-static void print_usage(void) {
-    printf("Usage: ./analyzer <queue_size> <plugin1> <plugin2> ... <pluginN>\n\n");
-    printf("Arguments:\n");
-    printf("queue_size Maximum number of items in each plugin's queue\n");
-    printf("plugin1..N Names of plugins to load (without .so extension)\n\n");
-    printf("Available plugins:\n");
-    printf("logger - Logs all strings that pass through\n");
-    printf("typewriter - Simulates typewriter effect with delays\n");
-    printf("uppercaser - Converts strings to uppercase\n");
-    printf("rotator - Move every character to the right. Last character moves to the beginning.\n");
-    printf("flipper - Reverses the order of characters\n");
-    printf("expander - Expands each character with spaces\n\n");
-    printf("Example:\n");
-    printf("./analyzer 20 uppercaser rotator logger\n\n");
-    printf("echo 'hello' | ./analyzer 20 uppercaser rotator logger\n");
-    printf("echo '<END>' | ./analyzer 20 uppercaser rotator logger\n");
-}
-
-static void cleanup_plugins(plugin_handle_t* plugins, int count) {
-    if (!plugins) return;
-    for (int i = 0; i < count; i++) {
-        if (plugins[i].fini) {
-            plugins[i].fini();
-        }
-    }
-    for (int i = 0; i < count; i++) {
-        if (plugins[i].handle) {
-            dlclose(plugins[i].handle);
-            plugins[i].handle = NULL;
-        }
-        if (plugins[i].name) {
-            free(plugins[i].name);
-            plugins[i].name = NULL;
-        }
-    }
-}
-
-int main(int argc, char** argv) {
-    if (argc < 3) {
-        fprintf(stderr, "Invalid arguments\n");
-        print_usage();
-        return 1;
-    }
-
-    char* endptr = NULL;
-    long queue_size_long = strtol(argv[1], &endptr, 10);
-    if (endptr == argv[1] || *endptr != '\0' || queue_size_long <= 0 || queue_size_long > 1000000) {
-        fprintf(stderr, "Invalid queue size\n");
-        print_usage();
-        return 1;
-    }
-    int queue_size = (int)queue_size_long;
-
-    int num_plugins = argc - 2;
-    plugin_handle_t* plugins = (plugin_handle_t*)calloc((size_t)num_plugins, sizeof(plugin_handle_t));
-    if (!plugins) {
-        fprintf(stderr, "Memory allocation failure\n");
-        return 1;
-    }
-
-    // Load plugins
-    for (int i = 0; i < num_plugins; i++) {
-        const char* plugin_name = argv[2 + i];
-        char so_path[512];
-        snprintf(so_path, sizeof(so_path), "./output/%s.so", plugin_name);
-
-        void* handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
-        if (!handle) {
-            fprintf(stderr, "Failed to load plugin '%s': %s\n", plugin_name, dlerror());
-            print_usage();
-            cleanup_plugins(plugins, i);
-            free(plugins);
-            return 1;
-        }
-
-        plugins[i].handle = handle;
-        plugins[i].name = strdup(plugin_name);
-        if (!plugins[i].name) {
-            fprintf(stderr, "Memory allocation failure\n");
-            print_usage();
-            cleanup_plugins(plugins, i + 1);
-            free(plugins);
-            return 1;
-        }
-
-        // Resolve symbols
-        plugins[i].init = (plugin_init_func_t)dlsym(handle, "plugin_init");
-        plugins[i].fini = (plugin_fini_func_t)dlsym(handle, "plugin_fini");
-        plugins[i].place_work = (plugin_place_work_func_t)dlsym(handle, "plugin_place_work");
-        plugins[i].attach = (plugin_attach_func_t)dlsym(handle, "plugin_attach");
-        plugins[i].wait_finished = (plugin_wait_finished_func_t)dlsym(handle, "plugin_wait_finished");
-        plugins[i].get_name = (plugin_get_name_func_t)dlsym(handle, "plugin_get_name");
-
-        if (!plugins[i].init || !plugins[i].fini || !plugins[i].place_work || !plugins[i].attach || !plugins[i].wait_finished || !plugins[i].get_name) {
-            fprintf(stderr, "Missing required symbol(s) in plugin '%s'\n", plugin_name);
-            print_usage();
-            cleanup_plugins(plugins, i + 1);
-            free(plugins);
-            return 1;
-        }
-    }
-
-    // Initialize plugins
-    for (int i = 0; i < num_plugins; i++) {
-        const char* err = plugins[i].init(queue_size);
-        if (err != NULL) {
-            fprintf(stderr, "Failed to init plugin '%s': %s\n", plugins[i].name, err);
-            // cleanup any already-initialized
-            for (int j = 0; j < i; j++) {
-                plugins[j].fini();
-            }
-            cleanup_plugins(plugins, num_plugins);
-            free(plugins);
-            return 2;
-        }
-    }
-
-    // Attach pipeline
-    for (int i = 0; i < num_plugins - 1; i++) {
-        plugins[i].attach(plugins[i + 1].place_work);
-    }
-
-    // Read input lines and feed into pipeline
-    char buffer[1026];
-    while (fgets(buffer, sizeof(buffer), stdin) != NULL) {
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len - 1] == '\n') {
-            buffer[len - 1] = '\0';
-            len--;
-        }
-
-        // Send to first plugin
-        const char* place_err = plugins[0].place_work(buffer);
-        if (place_err != NULL) {
-            fprintf(stderr, "Failed to place work in first plugin: %s\n", place_err);
-            break;
-        }
-
-        if (strcmp(buffer, "<END>") == 0) {
-            break;
-        }
-    }
-
-    // Wait for plugins to finish (from first to last)
-    for (int i = 0; i < num_plugins; i++) {
-        const char* err = plugins[i].wait_finished();
-        if (err != NULL) {
-            fprintf(stderr, "Error waiting for plugin '%s': %s\n", plugins[i].name, err);
-        }
-    }
-
-    // Cleanup
-    for (int i = 0; i < num_plugins; i++) {
-        const char* err = plugins[i].fini();
-        if (err != NULL) {
-            fprintf(stderr, "Error finalizing plugin '%s': %s\n", plugins[i].name, err);
-        }
-    }
-
-    cleanup_plugins(plugins, num_plugins);
-    free(plugins);
-
-fprintf(stderr, "Pipeline shutdown complete\n"); /* moved to stderr to keep STDOUT clean */
-    return 0;
-}
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include "plugins/plugin_sdk.h"
+#include "plugins/sync/affinity.h"
+#include "plugins/sync/coroutine.h"
+#include "plugins/sync/item_pool.h"
+#include "plugins/sync/line_reader.h"
+#include "plugins/sync/output_sink.h"
+#include "plugins/sync/scheduler.h"
+
+#define INPUT_BATCH_SIZE 64    // maximum lines handed to the first plugin per call
+
+typedef struct {
+    plugin_init_func_t init;
+    plugin_fini_func_t fini;
+    plugin_place_work_func_t place_work;
+    plugin_attach_func_t attach;
+    plugin_wait_finished_func_t wait_finished;
+    plugin_get_name_func_t get_name;
+    plugin_instance_init_func_t instance_init;                                     // optional
+    plugin_instance_fini_func_t instance_fini;                                     // optional
+    plugin_instance_place_work_buffers_func_t instance_place_work_buffers;         // optional
+    plugin_instance_attach_func_t instance_attach;                                 // optional
+    plugin_instance_wait_finished_func_t instance_wait_finished;                   // optional
+    plugin_instance_wait_finished_timed_func_t instance_wait_finished_timed;       // optional, bounds the drain
+    plugin_get_pure_func_t get_pure;                 // optional, the plugin is pure and may be fused
+    plugin_merge_args_func_t merge_args;             // optional, consecutive instances may be merged
+    plugin_fused_t* fused;                           // pure transforms of the plugins fused into this one
+    int fused_count;
+    int fused_away;                                  // runs inside an earlier plugin's worker, no instance of its own
+    plugin_instance_t* instance;                     // set when driven through the instance interface
+    int started;                                     // init succeeded, fini still pending
+    int workers;                                     // consumer threads requested on the command line
+    const int* cpus;                                 // CPU of each consumer thread with --pin, NULL otherwise
+    char* args;                                      // plugin argument from the command line, NULL if none
+    char* name;
+    void* handle;
+} plugin_handle_t;
+
+static void print_usage(void) {
+    printf("Usage: ./analyzer [-f file] [--framing=...] [--drain-timeout=ms] [--scheduler[=N] | --coroutines] [--pin=...] <queue_size> <plugin1>[:workers][=arg] <plugin2>[:workers][=arg] ... <pluginN>[:workers][=arg]\n\n");
+    printf("Arguments:\n");
+    printf("-f file    Read the input from file instead of stdin (memory mapped, <END> is implied at its end)\n");
+    printf("--framing=lines|lenprefix\n");
+    printf("           Record format of the input and of the logger's output: newline-delimited text (default),\n");
+    printf("           or frames of a varint header (2 * length) and the payload, ended by the header 1\n");
+    printf("           (the header 3 flushes what the plugins hold, 5 is a checkpoint)\n");
+    printf("--drain-timeout=ms\n");
+    printf("           Once the input has ended (<END>, end of input or SIGTERM), wait at most ms milliseconds\n");
+    printf("           for the plugins to finish, then report what was left and exit with status 1 (default: no limit)\n");
+    printf("--scheduler[=N]\n");
+    printf("           Run all plugins on N shared worker threads (default: one per CPU) that take whichever\n");
+    printf("           plugin has queued work, instead of threads of their own (:workers is then ignored)\n");
+    printf("--coroutines\n");
+    printf("           Run all plugins as coroutines on one thread: a plugin switches to the next one when its\n");
+    printf("           queue is empty or the next queue is full, without waking any thread (:workers is then ignored).\n");
+    printf("           For cheap plugins, one that sleeps or blocks holds up all the others\n");
+    printf("--pin=compact|spread|cpu list\n");
+    printf("           Bind every plugin thread (or scheduler worker, or the coroutine thread) to one CPU, in pipeline\n");
+    printf("           order: compact puts adjacent plugins on cores that share a cache, spread gives each its own\n");
+    printf("           core across the sockets, a list such as 0,2,4-7 is used as given. The placement is printed\n");
+    printf("           at startup\n");
+    printf("queue_size Maximum number of items in each plugin's queue\n");
+    printf("plugin1..N Names of plugins to load (without .so extension), a plugin may appear more than once\n");
+    printf("workers    Optional number of threads running the plugin, output order is preserved\n");
+    printf("arg        Optional plugin argument, see the plugin list\n\n");
+    printf("Available plugins:\n");
+    printf("logger - Logs all strings that pass through\n");
+    printf("typewriter - Simulates typewriter effect with delays (=N waits N ms per character, default 100, 0 for none)\n");
+    printf("uppercaser - Converts strings to uppercase\n");
+    printf("rotator - Move every character to the right. Last character moves to the beginning (=N moves N places, negative to the left)\n");
+    printf("flipper - Reverses the order of characters (=bytes, =utf8 keeps UTF-8 characters, =grapheme also keeps combining marks)\n");
+    printf("expander - Expands each character with spaces\n\n");
+    printf("Example:\n");
+    printf("./analyzer 20 uppercaser rotator logger\n\n");
+    printf("echo 'hello' | ./analyzer 20 uppercaser rotator logger\n");
+    printf("echo '<END>' | ./analyzer 20 uppercaser rotator logger\n");
+    printf("echo 'hello' | ./analyzer 20 uppercaser:4 rotator logger\n");
+    printf("echo 'hello' | ./analyzer 20 rotator rotator logger\n");
+    printf("echo 'héllo' | ./analyzer 20 flipper=utf8 logger\n");
+    printf("echo 'hello' | ./analyzer 20 rotator=-2 logger\n");
+    printf("echo 'hello' | ./analyzer 20 uppercaser typewriter=20\n");
+    printf("./analyzer -f input.log 64 uppercaser logger\n");
+    printf("./analyzer --framing=lenprefix -f records.bin 64 uppercaser logger > out.bin\n");
+    printf("./analyzer --scheduler=4 -f input.log 64 uppercaser rotator flipper expander logger\n");
+    printf("./analyzer --pin=compact -f input.log 64 uppercaser:2 logger\n");
+    printf("./analyzer --coroutines -f input.log 64 uppercaser rotator flipper logger\n");
+}
+
+static int has_instance_interface(const plugin_handle_t* plugin) {
+    return plugin->instance_init && plugin->instance_fini && plugin->instance_place_work_buffers &&
+           plugin->instance_attach && plugin->instance_wait_finished;
+}
+
+static const char* start_plugin(plugin_handle_t* plugin, int use_instances, int queue_size, item_pool_t* pool,
+                                output_sink_t* output, scheduler_t* scheduler, coroutine_runner_t* runner) {
+    const char* err;
+    if (plugin->fused_away) { // started as part of the plugin it was fused into
+        return NULL;
+    }
+    if (use_instances) {
+        plugin_config_t config = { queue_size, plugin->workers, pool, plugin->fused, plugin->fused_count, plugin->args, output,
+                                   scheduler, plugin->cpus, plugin->cpus ? plugin->workers : 0, runner };
+        err = plugin->instance_init(&config, &plugin->instance);
+    } else {
+        err = plugin->init(queue_size);
+    }
+    plugin->started = err == NULL;
+    return err;
+}
+
+static void report_cpu(const affinity_t* placement, int slot) { // " -> CPU n (...)" of a slot
+    const affinity_cpu_t* cpu = affinity_slot(placement, slot);
+    fprintf(stderr, " -> CPU %d (node %d, package %d, core %d)\n", cpu->cpu, cpu->node, cpu->package, cpu->core);
+}
+
+static void report_placement(const affinity_t* placement, const plugin_handle_t* plugins, int count,
+                             const scheduler_t* scheduler, const coroutine_runner_t* runner) { // where every thread runs, on stderr
+    fprintf(stderr, "Placement (%s):\n", affinity_policy_name(placement->policy));
+    if (runner) { // one thread runs every stage
+        fprintf(stderr, "  coroutine runner");
+        report_cpu(placement, 0);
+        return;
+    }
+    if (scheduler) { // the stages go wherever a worker takes them
+        for (int i = 0; i < scheduler->num_workers; i++) {
+            fprintf(stderr, "  scheduler worker %d", i);
+            report_cpu(placement, i);
+        }
+        return;
+    }
+    int slot = 0;
+    for (int i = 0; i < count; i++) {
+        for (int t = 0; !plugins[i].fused_away && t < plugins[i].workers; t++, slot++) {
+            fprintf(stderr, plugins[i].workers > 1 ? "  %s thread %d" : "  %s", plugins[i].name, t);
+            report_cpu(placement, slot);
+        }
+    }
+}
+
+static const char* stop_plugin(plugin_handle_t* plugin) {
+    if (!plugin->started) {
+        return NULL;
+    }
+    plugin->started = 0;
+    if (plugin->instance) {
+        const char* err = plugin->instance_fini(plugin->instance);
+        plugin->instance = NULL;
+        return err;
+    }
+    return plugin->fini();
+}
+
+static const char* wait_plugin(plugin_handle_t* plugin) {
+    if (plugin->fused_away) {
+        return NULL;
+    }
+    return plugin->instance ? plugin->instance_wait_finished(plugin->instance) : plugin->wait_finished();
+}
+
+static long elapsed_ms(const struct timespec* start) { // milliseconds since start (CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static int poll_input(int input_fd, int signal_fd, int timeout_ms) { // 1 input ready, 0 not yet, -1 SIGTERM arrived
+    // poll skips a negative descriptor, either one may be left out
+    struct pollfd pfd[2] = { { .fd = input_fd, .events = POLLIN, .revents = 0 },
+                             { .fd = signal_fd, .events = POLLIN, .revents = 0 } };
+    while (poll(pfd, 2, timeout_ms) < 0) {
+        if (errno != EINTR) {
+            return 1; // let the read report the problem
+        }
+    }
+    if (pfd[1].revents & POLLIN) {
+        struct signalfd_siginfo info;
+        if (read(signal_fd, &info, sizeof(info)) < 0) { // taken, the next SIGTERM is not pending any more
+            return 1;
+        }
+        return -1;
+    }
+    return pfd[0].revents != 0;
+}
+
+static int merge_plugins(plugin_handle_t* plugins, int count) { // fold consecutive instances of a plugin into one, returns the new count
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        plugin_handle_t* last = kept > 0 ? &plugins[kept - 1] : NULL;
+        char merged[64];
+        if (last && last->handle == plugins[i].handle && last->merge_args &&
+            last->merge_args(last->args, plugins[i].args, merged, sizeof(merged)) == NULL) {
+            char* args = strdup(merged);
+            if (args) { // otherwise both simply run
+                free(last->args);
+                last->args = args;
+                if (plugins[i].workers > last->workers) {
+                    last->workers = plugins[i].workers;
+                }
+                dlclose(plugins[i].handle); // reference counted, last still holds it
+                free(plugins[i].name);
+                free(plugins[i].args);
+                continue;
+            }
+        }
+        if (kept != i) {
+            plugins[kept] = plugins[i];
+        }
+        kept++;
+    }
+    for (int i = kept; i < count; i++) { // moved or released above
+        memset(&plugins[i], 0, sizeof(plugin_handle_t));
+    }
+    return kept;
+}
+
+static const char* fuse_plugins(plugin_handle_t* plugins, int count, int* failed) { // fold runs of pure plugins into their first member
+    for (int i = 0; i < count; i++) {
+        int head = i;
+        while (i + 1 < count && plugins[head].get_pure && plugins[i + 1].get_pure) {
+            i++;
+        }
+        int run = i - head;
+        if (run == 0) {
+            continue;
+        }
+
+        plugins[head].fused = (plugin_fused_t*)malloc(sizeof(plugin_fused_t) * (size_t)run);
+        if (!plugins[head].fused) {
+            *failed = head;
+            return "Memory allocation failure";
+        }
+        for (int j = head + 1; j <= i; j++) {
+            const char* err = plugins[j].get_pure(plugins[j].args, &plugins[head].fused[plugins[head].fused_count]);
+            if (err != NULL) { // e.g. an invalid plugin argument
+                *failed = j;
+                return err;
+            }
+            plugins[head].fused_count++;
+            plugins[j].fused_away = 1;
+            if (plugins[j].workers > plugins[head].workers) { // the fused stage gets the most workers asked for
+                plugins[head].workers = plugins[j].workers;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void link_plugins(plugin_handle_t* plugin, plugin_handle_t* next) {
+    if (plugin->instance) { // move batches, no copies
+        plugin->instance_attach(plugin->instance, next->instance, next->instance_place_work_buffers);
+    } else {
+        plugin->attach(next->place_work);
+    }
+}
+
+static void cleanup_plugins(plugin_handle_t* plugins, int count) {
+    if (!plugins) return;
+    for (int i = 0; i < count; i++) {
+        stop_plugin(&plugins[i]);
+        for (int j = 0; j < plugins[i].fused_count; j++) { // before dlclose, the release code lives in the plugin
+            if (plugins[i].fused[j].release) {
+                plugins[i].fused[j].release(plugins[i].fused[j].state);
+            }
+        }
+        plugins[i].fused_count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (plugins[i].handle) {
+            dlclose(plugins[i].handle); // reference counted when a plugin appears twice
+            plugins[i].handle = NULL;
+        }
+        if (plugins[i].name) {
+            free(plugins[i].name);
+            plugins[i].name = NULL;
+        }
+        free(plugins[i].fused);
+        plugins[i].fused = NULL;
+        free(plugins[i].args);
+        plugins[i].args = NULL;
+    }
+}
+
+static const char* place_batch(plugin_handle_t* plugin, item_pool_t* pool, plugin_buffer_t* items, int count) { // move lines into a plugin
+    if (plugin->instance) {
+        return plugin->instance_place_work_buffers(plugin->instance, items, count);
+    }
+    const char* err = NULL;
+    for (int i = 0; i < count; i++) { // single instance plugin, it copies and we release ours
+        if (err == NULL && items[i].kind == PLUGIN_ITEM_DATA) {
+            err = plugin->place_work(items[i].ptr);
+        } else if (err == NULL && items[i].kind == PLUGIN_ITEM_END) { // its end of stream is a string
+            err = plugin->place_work("<END>");
+        }
+        item_pool_free(pool, items[i].ptr);
+    }
+    return err;
+}
+
+int main(int argc, char** argv) {
+    // options come before the queue size
+    int first_arg = 1;
+    const char* input_path = NULL;
+    framing_t framing = FRAMING_LINES;
+    long drain_timeout_ms = 0;
+    int scheduler_workers = -1; // -1 without --scheduler, 0 for one worker per CPU
+    const char* pin_spec = NULL;
+    int use_coroutines = 0;
+    while (first_arg < argc && argv[first_arg][0] == '-' && (argv[first_arg][1] < '0' || argv[first_arg][1] > '9')) {
+        if (strcmp(argv[first_arg], "-f") == 0) {
+            if (first_arg + 1 >= argc) {
+                fprintf(stderr, "Missing file name after -f\n");
+                print_usage();
+                return 1;
+            }
+            input_path = argv[first_arg + 1];
+            first_arg += 2;
+        } else if (strcmp(argv[first_arg], "--framing=lines") == 0) {
+            framing = FRAMING_LINES;
+            first_arg++;
+        } else if (strcmp(argv[first_arg], "--framing=lenprefix") == 0) {
+            framing = FRAMING_LENPREFIX;
+            first_arg++;
+        } else if (strncmp(argv[first_arg], "--drain-timeout=", 16) == 0) {
+            char* end = NULL;
+            drain_timeout_ms = strtol(argv[first_arg] + 16, &end, 10);
+            if (end == argv[first_arg] + 16 || *end != '\0' || drain_timeout_ms <= 0 || drain_timeout_ms > 86400000L) {
+                fprintf(stderr, "Invalid drain timeout (expected milliseconds from 1 to 86400000)\n");
+                print_usage();
+                return 1;
+            }
+            first_arg++;
+        } else if (strncmp(argv[first_arg], "--pin=", 6) == 0) {
+            pin_spec = argv[first_arg] + 6;
+            first_arg++;
+        } else if (strcmp(argv[first_arg], "--coroutines") == 0) {
+            use_coroutines = 1;
+            first_arg++;
+        } else if (strcmp(argv[first_arg], "--scheduler") == 0) {
+            scheduler_workers = 0;
+            first_arg++;
+        } else if (strncmp(argv[first_arg], "--scheduler=", 12) == 0) {
+            char* end = NULL;
+            long workers = strtol(argv[first_arg] + 12, &end, 10);
+            if (end == argv[first_arg] + 12 || *end != '\0' || workers <= 0 || workers > SCHEDULER_MAX_WORKERS) {
+                fprintf(stderr, "Invalid scheduler worker count (expected 1 to %d)\n", SCHEDULER_MAX_WORKERS);
+                print_usage();
+                return 1;
+            }
+            scheduler_workers = (int)workers;
+            first_arg++;
+        } else {
+            fprintf(stderr, "Unknown option '%s'\n", argv[first_arg]);
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (use_coroutines && scheduler_workers >= 0) {
+        fprintf(stderr, "--coroutines and --scheduler cannot be combined\n");
+        print_usage();
+        return 1;
+    }
+
+    if (argc - first_arg < 2) {
+        fprintf(stderr, "Invalid arguments\n");
+        print_usage();
+        return 1;
+    }
+
+    char* endptr = NULL;
+    long queue_size_long = strtol(argv[first_arg], &endptr, 10);
+    if (endptr == argv[first_arg] || *endptr != '\0' || queue_size_long <= 0 || queue_size_long > 1000000) {
+        fprintf(stderr, "Invalid queue size\n");
+        print_usage();
+        return 1;
+    }
+    int queue_size = (int)queue_size_long;
+
+    int input_fd = fileno(stdin);
+    if (input_path) {
+        input_fd = open(input_path, O_RDONLY | O_CLOEXEC);
+        if (input_fd < 0) {
+            fprintf(stderr, "Failed to open input file '%s': %s\n", input_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    int num_plugins = argc - first_arg - 1;
+    plugin_handle_t* plugins = (plugin_handle_t*)calloc((size_t)num_plugins, sizeof(plugin_handle_t));
+    if (!plugins) {
+        fprintf(stderr, "Memory allocation failure\n");
+        return 1;
+    }
+
+    // Load plugins
+    for (int i = 0; i < num_plugins; i++) {
+        // split "name:workers=arg", the argument is handed to the plugin as is
+        char plugin_name[256];
+        snprintf(plugin_name, sizeof(plugin_name), "%s", argv[first_arg + 1 + i]);
+        plugins[i].workers = 1;
+        char* plugin_arg = strchr(plugin_name, '=');
+        if (plugin_arg) {
+            *plugin_arg++ = '\0';
+            plugins[i].args = strdup(strchr(argv[first_arg + 1 + i], '=') + 1); // not cut short by the name buffer
+            if (!plugins[i].args) {
+                fprintf(stderr, "Memory allocation failure\n");
+                cleanup_plugins(plugins, i + 1);
+                free(plugins);
+                return 1;
+            }
+        }
+        char* workers_arg = strchr(plugin_name, ':');
+        if (workers_arg) {
+            *workers_arg++ = '\0';
+            long workers = strtol(workers_arg, &endptr, 10);
+            if (endptr == workers_arg || *endptr != '\0' || workers <= 0 || workers > 1024) {
+                fprintf(stderr, "Invalid worker count for plugin '%s'\n", plugin_name);
+                print_usage();
+                cleanup_plugins(plugins, i + 1);
+                free(plugins);
+                return 1;
+            }
+            plugins[i].workers = (int)workers;
+        }
+
+        char so_path[512];
+        snprintf(so_path, sizeof(so_path), "./output/%s.so", plugin_name);
+
+        void* handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            fprintf(stderr, "Failed to load plugin '%s': %s\n", plugin_name, dlerror());
+            print_usage();
+            cleanup_plugins(plugins, i + 1);
+            free(plugins);
+            return 1;
+        }
+
+        plugins[i].handle = handle;
+        plugins[i].name = strdup(plugin_name);
+        if (!plugins[i].name) {
+            fprintf(stderr, "Memory allocation failure\n");
+            print_usage();
+            cleanup_plugins(plugins, i + 1);
+            free(plugins);
+            return 1;
+        }
+
+        // Resolve symbols
+        plugins[i].init = (plugin_init_func_t)dlsym(handle, "plugin_init");
+        plugins[i].fini = (plugin_fini_func_t)dlsym(handle, "plugin_fini");
+        plugins[i].place_work = (plugin_place_work_func_t)dlsym(handle, "plugin_place_work");
+        plugins[i].attach = (plugin_attach_func_t)dlsym(handle, "plugin_attach");
+        plugins[i].wait_finished = (plugin_wait_finished_func_t)dlsym(handle, "plugin_wait_finished");
+        plugins[i].get_name = (plugin_get_name_func_t)dlsym(handle, "plugin_get_name");
+        plugins[i].instance_init = (plugin_instance_init_func_t)dlsym(handle, "plugin_instance_init");
+        plugins[i].instance_fini = (plugin_instance_fini_func_t)dlsym(handle, "plugin_instance_fini");
+        plugins[i].instance_place_work_buffers = (plugin_instance_place_work_buffers_func_t)dlsym(handle, "plugin_instance_place_work_buffers");
+        plugins[i].instance_attach = (plugin_instance_attach_func_t)dlsym(handle, "plugin_instance_attach");
+        plugins[i].instance_wait_finished = (plugin_instance_wait_finished_func_t)dlsym(handle, "plugin_instance_wait_finished");
+        plugins[i].instance_wait_finished_timed = (plugin_instance_wait_finished_timed_func_t)dlsym(handle, "plugin_instance_wait_finished_timed");
+        plugins[i].get_pure = (plugin_get_pure_func_t)dlsym(handle, "plugin_get_pure");
+        plugins[i].merge_args = (plugin_merge_args_func_t)dlsym(handle, "plugin_merge_args");
+
+        if (!plugins[i].init || !plugins[i].fini || !plugins[i].place_work || !plugins[i].attach || !plugins[i].wait_finished || !plugins[i].get_name) {
+            fprintf(stderr, "Missing required symbol(s) in plugin '%s'\n", plugin_name);
+            print_usage();
+            cleanup_plugins(plugins, i + 1);
+            free(plugins);
+            return 1;
+        }
+    }
+
+    // Plugins that support instances are created through the instance interface, which allows
+    // the same plugin to appear several times in the chain. Mixing in an older plugin falls
+    // back to the single instance interface for the whole chain
+    int use_instances = 1;
+    for (int i = 0; i < num_plugins; i++) {
+        use_instances = use_instances && has_instance_interface(&plugins[i]);
+    }
+    for (int i = 0; i < num_plugins && !use_instances; i++) {
+        const char* problem = plugins[i].workers > 1 ? "does not support multiple workers"
+                            : plugins[i].args ? "does not support arguments" : NULL;
+        for (int j = 0; j < i && !problem; j++) {
+            if (plugins[j].handle == plugins[i].handle) { // dlopen returned the already loaded object
+                problem = "cannot appear more than once in the chain";
+            }
+        }
+        if (problem) {
+            fprintf(stderr, "Plugin '%s' %s\n", plugins[i].name, problem);
+            cleanup_plugins(plugins, num_plugins);
+            free(plugins);
+            return 1;
+        }
+    }
+
+    // Consecutive instances of a plugin that can merge its arguments become one instance,
+    // e.g. rotator=2 rotator=-5 runs as rotator=-3
+    if (use_instances) {
+        num_plugins = merge_plugins(plugins, num_plugins);
+    }
+
+    // Adjacent pure plugins run back-to-back in one worker, queues and threads are kept only
+    // in front of plugins that block or have side effects
+    int fuse_failed = 0;
+    const char* fuse_err = use_instances ? fuse_plugins(plugins, num_plugins, &fuse_failed) : NULL;
+    if (fuse_err != NULL) {
+        fprintf(stderr, "Failed to init plugin '%s': %s\n", plugins[fuse_failed].name, fuse_err);
+        cleanup_plugins(plugins, num_plugins);
+        free(plugins);
+        return 2;
+    }
+
+    // SIGTERM ends the input as <END> does. It is blocked before any thread starts, so every
+    // plugin thread inherits the mask, and the reader picks it up through a signalfd
+    sigset_t term_set;
+    sigemptyset(&term_set);
+    sigaddset(&term_set, SIGTERM);
+    int signal_fd = -1;
+    if (pthread_sigmask(SIG_BLOCK, &term_set, NULL) == 0) {
+        signal_fd = signalfd(-1, &term_set, SFD_CLOEXEC);
+        if (signal_fd < 0) {
+            pthread_sigmask(SIG_UNBLOCK, &term_set, NULL); // SIGTERM keeps its default action
+        }
+    }
+
+    // Share one work item pool across the pipeline, buffers then recycle from the last
+    // plugin back to the input reader
+    item_pool_t item_pool;
+    item_pool_t* pool = NULL;
+    if (use_instances && item_pool_init(&item_pool) == 0) {
+        pool = &item_pool;
+    }
+
+    // One buffered stdout writer for every plugin, lines leave in batches and in order
+    output_sink_t output_sink;
+    output_sink_t* output = NULL;
+    if (use_instances && output_sink_init(&output_sink, fileno(stdout), 0, 0) == 0) {
+        output = &output_sink;
+        output->framing = framing; // the logger writes frames, the host adds the end-of-stream frame
+    }
+    if (framing == FRAMING_LENPREFIX && !output) {
+        fprintf(stderr, "--framing=lenprefix needs plugins with the instance interface\n");
+        cleanup_plugins(plugins, num_plugins);
+        free(plugins);
+        if (pool) item_pool_destroy(pool);
+        return 1;
+    }
+
+    // With --pin every stage thread is bound to a CPU, numbered in pipeline order
+    affinity_t placement;
+    int* slot_cpus = NULL;
+    if (pin_spec) {
+        const char* problem = !use_instances ? "--pin needs plugins with the instance interface"
+                                             : affinity_init(&placement, pin_spec);
+        int threads = 0;
+        for (int i = 0; i < num_plugins && !problem; i++) {
+            threads += plugins[i].fused_away ? 0 : plugins[i].workers;
+        }
+        if (!problem && !(slot_cpus = (int*)malloc(sizeof(int) * (size_t)threads))) {
+            affinity_destroy(&placement);
+            problem = "Memory allocation failure";
+        }
+        if (problem) {
+            fprintf(stderr, "%s\n", problem);
+            cleanup_plugins(plugins, num_plugins);
+            free(plugins);
+            if (output) output_sink_destroy(output);
+            if (pool) item_pool_destroy(pool);
+            return 1;
+        }
+        for (int i = 0, slot = 0; i < num_plugins; i++) {
+            if (plugins[i].fused_away || scheduler_workers >= 0 || use_coroutines) { // scheduler workers or the coroutine thread are pinned instead
+                continue;
+            }
+            plugins[i].cpus = slot_cpus + slot;
+            for (int t = 0; t < plugins[i].workers; t++, slot++) {
+                slot_cpus[slot] = affinity_slot(&placement, slot)->cpu;
+            }
+        }
+        if (scheduler_workers == 0) { // one scheduler worker per CPU of the placement
+            scheduler_workers = placement.count < SCHEDULER_MAX_WORKERS ? placement.count : SCHEDULER_MAX_WORKERS;
+        }
+    }
+
+    // With --scheduler a fixed set of workers runs every stage: a stage is a task that is
+    // queued whenever items arrive, and idle workers steal tasks from busy ones
+    scheduler_t stage_scheduler;
+    scheduler_t* scheduler = NULL;
+    if (scheduler_workers >= 0) {
+        const char* problem = !use_instances ? "--scheduler needs plugins with the instance interface"
+                            : scheduler_init(&stage_scheduler, scheduler_workers) != 0 ? "Failed to start the scheduler" : NULL;
+        if (problem) {
+            fprintf(stderr, "%s\n", problem);
+            if (pin_spec) affinity_destroy(&placement);
+            free(slot_cpus);
+            cleanup_plugins(plugins, num_plugins);
+            free(plugins);
+            if (output) output_sink_destroy(output);
+            if (pool) item_pool_destroy(pool);
+            return 1;
+        }
+        scheduler = &stage_scheduler;
+        for (int i = 0; pin_spec && i < scheduler->num_workers; i++) {
+            if (affinity_pin_thread(scheduler->threads[i], affinity_slot(&placement, i)->cpu) != 0) {
+                fprintf(stderr, "Failed to pin scheduler worker %d\n", i);
+            }
+        }
+    }
+
+    // With --coroutines one thread runs every stage: a stage is a coroutine that parks while
+    // its queue is empty and yields while the next one is full
+    coroutine_runner_t stage_runner;
+    coroutine_runner_t* runner = NULL;
+    if (use_coroutines) {
+        const char* problem = !use_instances ? "--coroutines needs plugins with the instance interface"
+                            : coroutine_runner_init(&stage_runner) != 0 ? "Failed to start the coroutine runner" : NULL;
+        if (problem) {
+            fprintf(stderr, "%s\n", problem);
+            if (pin_spec) affinity_destroy(&placement);
+            free(slot_cpus);
+            cleanup_plugins(plugins, num_plugins);
+            free(plugins);
+            if (output) output_sink_destroy(output);
+            if (pool) item_pool_destroy(pool);
+            return 1;
+        }
+        runner = &stage_runner;
+        if (pin_spec && affinity_pin_thread(runner->thread, affinity_slot(&placement, 0)->cpu) != 0) {
+            fprintf(stderr, "Failed to pin the coroutine runner\n");
+        }
+    }
+    if (pin_spec) {
+        report_placement(&placement, plugins, num_plugins, scheduler, runner);
+        affinity_destroy(&placement);
+    }
+
+    // Initialize plugins
+    for (int i = 0; i < num_plugins; i++) {
+        const char* err = start_plugin(&plugins[i], use_instances, queue_size, pool, output, scheduler, runner);
+        if (err != NULL) {
+            fprintf(stderr, "Failed to init plugin '%s': %s\n", plugins[i].name, err);
+            // stop any already-initialized, nothing is attached yet so each one gets its own end of stream
+            for (int j = 0; j < i; j++) {
+                plugin_buffer_t end_item = { NULL, 0, 0, { 0, 0 }, PLUGIN_ITEM_END };
+                if (plugins[j].started) {
+                    place_batch(&plugins[j], pool, &end_item, 1);
+                    stop_plugin(&plugins[j]);
+                }
+            }
+            if (scheduler) scheduler_destroy(scheduler); // its workers run code of the plugins
+            if (runner) coroutine_runner_destroy(runner);
+            cleanup_plugins(plugins, num_plugins);
+            free(plugins);
+            free(slot_cpus);
+            if (output) output_sink_destroy(output);
+            if (pool) item_pool_destroy(pool);
+            return 2;
+        }
+    }
+
+    // Attach pipeline, skipping plugins that were fused into the one before them
+    int previous = 0;
+    for (int i = 1; i < num_plugins; i++) {
+        if (!plugins[i].fused_away) {
+            link_plugins(&plugins[previous], &plugins[i]);
+            previous = i;
+        }
+    }
+
+    // Read input lines and feed into pipeline, a batch at a time. stdin is read in large
+    // blocks and cut with memchr, a -f file is mapped and cut in place. Each line is copied
+    // once into its work item, the buffer the stages own and may rewrite, then ownership and
+    // length move from stage to stage until the last plugin frees it. Lines may be of any
+    // length and may contain NUL bytes. The end of the input and flush/checkpoint frames
+    // travel as control messages, in order with the lines but outside of them, so every
+    // framed record is data, "<END>" included. Whenever the input has nothing buffered the
+    // reader waits for it together with SIGTERM
+    line_reader_t reader;
+    int reader_result = input_path ? line_reader_init_mapped(&reader, input_fd) : line_reader_init(&reader, input_fd, 0);
+    if (reader_result != 0) {
+        fprintf(stderr, "Memory allocation failure\n");
+    }
+    line_reader_set_framing(&reader, framing); // frames are cut at their length, no scan
+    const char* input_line;
+    size_t len;
+    int read_result = 0;
+    plugin_buffer_t batch[INPUT_BATCH_SIZE];
+    int batch_count = 0;
+    int reached_end = 0;
+    int terminated = 0;
+    while (!reached_end && reader.buffer) {
+        if (!line_reader_ready(&reader) && poll_input(input_fd, signal_fd, -1) < 0) {
+            terminated = 1;
+            break;
+        }
+        if ((read_result = line_reader_next(&reader, &input_line, &len)) <= 0) {
+            break;
+        }
+        if (read_result == 2) { // flush or checkpoint frame
+            plugin_item_kind_t kind = reader.control == FRAME_FLUSH ? PLUGIN_ITEM_FLUSH : PLUGIN_ITEM_CHECKPOINT;
+            batch[batch_count++] = (plugin_buffer_t){ NULL, 0, 0, { 0, 0 }, kind };
+        } else if (framing == FRAMING_LINES && len == 5 && memcmp(input_line, "<END>", 5) == 0) { // end line of the text input
+            batch[batch_count++] = (plugin_buffer_t){ NULL, 0, 0, { 0, 0 }, PLUGIN_ITEM_END };
+            reached_end = 1;
+        } else {
+            char* line = (char*)item_pool_alloc(pool, len + 1);
+            if (!line) {
+                fprintf(stderr, "Memory allocation failure\n");
+                break;
+            }
+            memcpy(line, input_line, len);
+            line[len] = '\0';
+            batch[batch_count++] = (plugin_buffer_t){ line, len, len + 1, { 0, 0 }, PLUGIN_ITEM_DATA }; // bytes in order
+        }
+
+        // send when the batch is full, at a control message, or when no more input is ready right now
+        if (batch_count < INPUT_BATCH_SIZE && read_result == 1 && !reached_end &&
+            (line_reader_ready(&reader) || poll_input(input_fd, -1, 0) > 0)) {
+            continue;
+        }
+        if (reader.mapped && poll_input(-1, signal_fd, 0) < 0) { // a mapped file is never waited for
+            terminated = 1;
+        }
+
+        // Send to first plugin
+        const char* place_err = place_batch(&plugins[0], pool, batch, batch_count);
+        batch_count = 0;
+        if (place_err != NULL) {
+            fprintf(stderr, "Failed to place work in first plugin: %s\n", place_err);
+            break;
+        }
+        if (terminated) {
+            break;
+        }
+    }
+    int exit_code = 0;
+    if (read_result < 0) {
+        fprintf(stderr, "Failed to read input: %s\n", strerror(errno));
+        exit_code = 1;
+    }
+    if (terminated) {
+        fprintf(stderr, "SIGTERM received, draining the pipeline\n");
+    }
+    // the input need not end with <END>: the end of input, the end-of-stream frame, SIGTERM
+    // and input that cannot be read any further all end the stream
+    if (!reached_end) {
+        batch[batch_count++] = (plugin_buffer_t){ NULL, 0, 0, { 0, 0 }, PLUGIN_ITEM_END };
+    }
+    if (signal_fd >= 0) { // from now on SIGTERM terminates at once
+        close(signal_fd);
+        pthread_sigmask(SIG_UNBLOCK, &term_set, NULL);
+    }
+    line_reader_destroy(&reader);
+    if (input_path) {
+        close(input_fd);
+    }
+    if (batch_count > 0) { // input ended in the middle of a batch
+        const char* place_err = place_batch(&plugins[0], pool, batch, batch_count);
+        if (place_err != NULL) {
+            fprintf(stderr, "Failed to place work in first plugin: %s\n", place_err);
+        }
+    }
+
+    // Wait for plugins to finish (from first to last), within the drain timeout if one was given
+    struct timespec drain_start;
+    clock_gettime(CLOCK_MONOTONIC, &drain_start);
+    int drained = 1;
+    for (int i = 0; i < num_plugins; i++) {
+        if (drain_timeout_ms > 0 && plugins[i].instance && plugins[i].instance_wait_finished_timed) {
+            long left = drained ? drain_timeout_ms - elapsed_ms(&drain_start) : 0; // past the deadline only count
+            int queued = 0;
+            if (plugins[i].instance_wait_finished_timed(plugins[i].instance, left > 0 ? left : 0, &queued) != NULL) {
+                fprintf(stderr, "Plugin '%s' did not finish in time, %d items left in its queue\n", plugins[i].name, queued);
+                drained = 0;
+            }
+            continue;
+        }
+        const char* err = wait_plugin(&plugins[i]);
+        if (err != NULL) {
+            fprintf(stderr, "Error waiting for plugin '%s': %s\n", plugins[i].name, err);
+        }
+    }
+    if (!drained) { // the stages still run, they cannot be stopped or unloaded
+        fprintf(stderr, "Drain timeout of %ld ms passed, exiting without the remaining work\n", drain_timeout_ms);
+        if (output) {
+            output_sink_flush(output); // what the plugins did write goes out
+        }
+        return 1;
+    }
+
+    // Cleanup
+    for (int i = 0; i < num_plugins; i++) {
+        const char* err = stop_plugin(&plugins[i]);
+        if (err != NULL) {
+            fprintf(stderr, "Error finalizing plugin '%s': %s\n", plugins[i].name, err);
+        }
+    }
+    if (scheduler) {
+        scheduler_destroy(scheduler); // before the plugins are unloaded and the pool goes away
+    }
+    if (runner) {
+        coroutine_runner_destroy(runner); // every stage coroutine was joined by its plugin's fini
+    }
+
+    if (output) {
+        output_sink_write_end(output); // framed output ends with an explicit frame
+        output_sink_destroy(output); // after the last plugin wrote, what is left goes out
+    }
+    cleanup_plugins(plugins, num_plugins);
+    free(plugins);
+    free(slot_cpus);
+    if (pool) {
+        item_pool_destroy(pool); // every stage thread has flushed its cache by now
+    }
+
+fprintf(stderr, "Pipeline shutdown complete\n"); /* moved to stderr to keep STDOUT clean */
+    return exit_code;
+}
+
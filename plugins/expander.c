@@ -1,30 +1,96 @@
-#include "plugin_common.h"
-#include <stdlib.h>
-#include <string.h>
-
-// Expander plugin transformation function
-
-static const char* plugin_transform(const char* input) { // transform input string
-    if (!input) return NULL;
-    size_t len = strlen(input);
-    if (len == 0) {
-        char* empty = (char*)malloc(1);
-        if (empty) empty[0] = '\0';
-        return empty;
-    }
-    // each char separated by one space: size = len + (len-1) spaces
-    size_t out_len = len + (len - 1);
-    char* out = (char*)malloc(out_len + 1);
-    if (!out) return NULL;
-    size_t j = 0;
-    for (size_t i = 0; i < len; i++) {
-        out[j++] = input[i];
-        if (i + 1 < len) out[j++] = ' ';
-    }
-    out[out_len] = '\0';
-    return out;
-}
-
-const char* plugin_get_name(void) { return "expander"; } // get plugin name
-
-const char* plugin_init(int queue_size) { return common_plugin_init(plugin_transform, "expander", queue_size); } // initialize plugin
+#include "plugin_common.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EXPANDER_X86 1
+#else
+#define EXPANDER_X86 0
+#endif
+
+// Expander kernels
+// Every kernel writes len (character, space) pairs straight into the destination, the
+// last space is then replaced by the terminating NUL, so the output of 2*len-1 bytes
+// fits exactly the 2*len bytes allocated for it. SSE2 interleaves 16 input bytes with a
+// vector of spaces (unpacklo/unpackhi) into two 16 byte stores, AVX2 does 32 at a time.
+
+static void expand_scalar(char* dst, const char* src, size_t len) { // one pair at a time, no branch
+    for (size_t i = 0; i < len; i++) {
+        dst[2 * i] = src[i];
+        dst[2 * i + 1] = ' ';
+    }
+}
+
+#if EXPANDER_X86
+static void expand_sse2(char* dst, const char* src, size_t len) { // 16 characters at a time
+    const __m128i spaces = _mm_set1_epi8(' ');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(v, spaces));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(v, spaces));
+    }
+    expand_scalar(dst + 2 * i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void expand_avx2(char* dst, const char* src, size_t len) { // 32 characters at a time
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_unpacklo_epi8(v, spaces); // characters 0-7 and 16-23, the unpacks stay within lanes
+        __m256i hi = _mm256_unpackhi_epi8(v, spaces); // characters 8-15 and 24-31
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    expand_scalar(dst + 2 * i, src + i, len - i);
+}
+#endif
+
+static void (*g_expand_kernel)(char* dst, const char* src, size_t len) = expand_scalar;
+static const char* g_expand_kernel_name = "scalar";
+
+__attribute__((constructor))
+static void expander_select_kernel(void) { // pick the widest kernel the CPU supports, once at load time
+#if EXPANDER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_expand_kernel = expand_avx2;
+        g_expand_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        g_expand_kernel = expand_sse2;
+        g_expand_kernel_name = "sse2";
+    }
+#endif
+}
+
+static size_t expand_into(char* dst, const char* src, size_t len) { // dst holds 2*len bytes (1 if len is 0), returns the length
+    if (len == 0) {
+        dst[0] = '\0';
+        return 0;
+    }
+    g_expand_kernel(dst, src, len);
+    dst[2 * len - 1] = '\0'; // the last pair's space
+    return 2 * len - 1;
+}
+
+// Expander plugin transformation function
+
+static int plugin_transform(const plugin_buffer_t* input, plugin_buffer_t* output, void* state) { // transform input buffer
+    (void)state; // no plugin argument
+    if (!input || !output) return -1;
+    size_t len = input->len;
+    // each char separated by one space: len + (len-1) spaces, plus the NUL
+    if (plugin_buffer_alloc(output, len ? 2 * len : 1) != 0) return -1;
+    output->len = expand_into(output->ptr, input->ptr, len); // straight into the pool buffer
+    return 0;
+}
+
+static const plugin_ops_t g_plugin_ops = { "expander", plugin_transform, NULL, NULL, NULL, NULL, NULL }; // transforms run by the framework
+
+const char* plugin_get_name(void) { return "expander"; } // get plugin name
+const char* plugin_init(int queue_size) { return common_plugin_init_v2(&g_plugin_ops, queue_size); } // initialize plugin
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance) { return common_plugin_instance_init_v2(&g_plugin_ops, config, instance); } // create an instance
+const char* plugin_get_pure(const char* args, plugin_fused_t* fused) { return common_plugin_get_pure(&g_plugin_ops, args, fused); } // pure, may be fused
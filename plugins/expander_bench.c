@@ -0,0 +1,108 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* pull in the implementation so we reach the static kernels */
+#include "expander.c"
+
+// Microbenchmark for the expander kernels
+// Usage: ./output/expander_bench [megabytes]
+// Expands the same input cut into 64 byte and 4 KB lines with every kernel, the results
+// are checked against the original per character loop before any timing is reported.
+
+typedef struct {
+    const char* name;
+    void (*kernel)(char* dst, const char* src, size_t len);
+} bench_kernel_t;
+
+static const size_t g_line_sizes[] = { 64, 4096 };
+
+static void expand_legacy(char* dst, const char* src, size_t len) { // the original loop, one branch per character
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++) {
+        dst[j++] = src[i];
+        if (i + 1 < len) dst[j++] = ' ';
+    }
+    dst[j] = ' '; // same bytes as the pair kernels, the caller overwrites it
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double run_kernel(void (*kernel)(char*, const char*, size_t), const char* input, char* work, size_t size, size_t line) { // MB/s of input
+    double start = now_seconds();
+    for (size_t off = 0; off < size; off += line) { // line by line, as the pipeline calls it
+        size_t len = size - off < line ? size - off : line;
+        kernel(work + 2 * off, input + off, len);
+        work[2 * (off + len) - 1] = '\0';
+    }
+    double elapsed = now_seconds() - start;
+    return elapsed > 0 ? (double)size / (1024.0 * 1024.0) / elapsed : 0.0;
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 64;
+    if (megabytes == 0) megabytes = 1;
+    size_t size = megabytes * 1024 * 1024 + 5; // an odd tail for the scalar remainder
+
+    bench_kernel_t kernels[4];
+    int num_kernels = 0;
+    kernels[num_kernels++] = (bench_kernel_t){ "legacy", expand_legacy };
+    kernels[num_kernels++] = (bench_kernel_t){ "scalar", expand_scalar };
+#if EXPANDER_X86
+    kernels[num_kernels++] = (bench_kernel_t){ "sse2", expand_sse2 };
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[num_kernels++] = (bench_kernel_t){ "avx2", expand_avx2 };
+    }
+#endif
+
+    char* input = malloc(size);
+    char* expected = malloc(2 * size);
+    char* work = malloc(2 * size);
+    if (!input || !expected || !work) {
+        fprintf(stderr, "Memory allocation failure\n");
+        return 1;
+    }
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        input[i] = (char)(seed >> 16);
+    }
+
+    printf("Expander kernels, %zu MB, dispatch picks '%s'\n", megabytes, g_expand_kernel_name);
+    for (size_t l = 0; l < sizeof(g_line_sizes) / sizeof(g_line_sizes[0]); l++) {
+        size_t line = g_line_sizes[l];
+
+        // every kernel must match the original loop byte for byte
+        run_kernel(expand_legacy, input, expected, size, line);
+        for (int k = 1; k < num_kernels; k++) {
+            memset(work, 0, 2 * size);
+            run_kernel(kernels[k].kernel, input, work, size, line);
+            if (memcmp(work, expected, 2 * size) != 0) {
+                fprintf(stderr, "Kernel %s disagrees with the original loop on %zu byte lines\n", kernels[k].name, line);
+                return 1;
+            }
+        }
+
+        printf("%zu byte lines:\n", line);
+        for (int k = 0; k < num_kernels; k++) {
+            double best = 0.0;
+            for (int round = 0; round < 3; round++) {
+                double mbps = run_kernel(kernels[k].kernel, input, work, size, line);
+                if (mbps > best) best = mbps;
+            }
+            printf("  %-7s %9.1f MB/s\n", kernels[k].name, best);
+        }
+    }
+    printf("All kernels agree\n");
+
+    free(input);
+    free(expected);
+    free(work);
+    return 0;
+}
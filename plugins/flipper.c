@@ -1,21 +1,230 @@
-#include "plugin_common.h"
-#include <stdlib.h>
-#include <string.h>
-
-// Flipper plugin transformation function
-
-static const char* plugin_transform(const char* input) { // transform input string
-    if (!input) return NULL;
-    size_t len = strlen(input);
-    char* out = (char*)malloc(len + 1);
-    if (!out) return NULL;
-    for (size_t i = 0; i < len; i++) {
-        out[i] = input[len - 1 - i];
-    }
-    out[len] = '\0';
-    return out;
-}
-
-const char* plugin_get_name(void) { return "flipper"; } // get plugin name
-
-const char* plugin_init(int queue_size) { return common_plugin_init(plugin_transform, "flipper", queue_size); } // initialize plugin
+#include "plugin_common.h"
+#include "sync/byte_reverse.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLIPPER_X86 1
+#else
+#define FLIPPER_X86 0
+#endif
+
+// Flipper kernels
+// The reversing copy runs 16 (SSSE3 pshufb) or 32 (AVX2 vpshufb + vpermq) bytes at a time,
+// the bytes left over at the end are done one at a time. In place the flipper uses the
+// framework's dispatched kernel (sync/byte_reverse.h), the one views are written out with.
+// The UTF-8 modes first reverse the bytes of every multi-byte unit (a code point, or with
+// =grapheme a code point with the marks attached to it) where it stands, then reverse the
+// whole item: the units come out in reverse order with their bytes the right way round.
+
+static void reverse_copy_scalar(char* dst, const char* src, size_t len) { // one byte at a time
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = src[len - 1 - i];
+    }
+}
+
+static void reverse_inplace_scalar(char* str, size_t len) {
+    for (size_t i = 0; i < len / 2; i++) {
+        char c = str[i];
+        str[i] = str[len - 1 - i];
+        str[len - 1 - i] = c;
+    }
+}
+
+#if FLIPPER_X86
+__attribute__((target("ssse3")))
+static void reverse_copy_ssse3(char* dst, const char* src, size_t len) { // 16 bytes at a time
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + len - 16 - i), _mm_shuffle_epi8(v, reverse));
+    }
+    for (; i < len; i++) {
+        dst[len - 1 - i] = src[i];
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i reverse_avx2_block(__m256i v) { // reverse 32 bytes
+    const __m256i reverse = _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    v = _mm256_shuffle_epi8(v, reverse);         // reverse within each 128-bit lane
+    return _mm256_permute4x64_epi64(v, 0x4E);    // then swap the lanes
+}
+
+__attribute__((target("avx2")))
+static void reverse_copy_avx2(char* dst, const char* src, size_t len) { // 32 bytes at a time
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + len - 32 - i), reverse_avx2_block(v));
+    }
+    for (; i < len; i++) {
+        dst[len - 1 - i] = src[i];
+    }
+}
+#endif
+
+static void (*g_reverse_copy)(char* dst, const char* src, size_t len) = reverse_copy_scalar;
+static const char* g_reverse_kernel_name = "scalar";
+
+__attribute__((constructor))
+static void flipper_select_kernel(void) { // pick the widest kernel the CPU supports, once at load time
+#if FLIPPER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_reverse_copy = reverse_copy_avx2;
+        g_reverse_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        g_reverse_copy = reverse_copy_ssse3;
+        g_reverse_kernel_name = "ssse3";
+    }
+#endif
+}
+
+static size_t utf8_decode(const unsigned char* s, size_t avail, unsigned int* cp) { // length of the code point at s, 1 if malformed
+    unsigned char lead = s[0];
+    size_t need = lead >= 0xC2 && lead <= 0xDF ? 2 : lead >= 0xE0 && lead <= 0xEF ? 3 : lead >= 0xF0 && lead <= 0xF4 ? 4 : 1;
+    if (need == 1 || avail < need) {
+        *cp = lead;
+        return 1;
+    }
+    unsigned int value = lead & (0x7F >> need);
+    for (size_t i = 1; i < need; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *cp = lead;
+            return 1;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+    *cp = value;
+    return need;
+}
+
+static int is_attached_mark(unsigned int cp) { // stays with the code point before it (=grapheme)
+    return (cp >= 0x300 && cp <= 0x36F)       // combining diacritical marks
+        || (cp >= 0x1AB0 && cp <= 0x1AFF)
+        || (cp >= 0x1DC0 && cp <= 0x1DFF)
+        || (cp >= 0x20D0 && cp <= 0x20FF)     // combining marks for symbols
+        || (cp >= 0xFE00 && cp <= 0xFE0F)     // variation selectors
+        || (cp >= 0xFE20 && cp <= 0xFE2F)
+        || (cp >= 0x1F3FB && cp <= 0x1F3FF)   // emoji skin tone modifiers
+        || cp == 0x200D;                      // zero width joiner, also pulls in the next code point
+}
+
+static size_t skip_ascii(const unsigned char* s, size_t pos, size_t len) { // first byte >= 0x80 at or after pos
+    for (; pos + 8 <= len; pos += 8) { // eight bytes per step, items are mostly ASCII
+        uint64_t word;
+        memcpy(&word, s + pos, sizeof(word));
+        if (word & 0x8080808080808080ull) break;
+    }
+    while (pos < len && s[pos] < 0x80) pos++;
+    return pos;
+}
+
+static void reverse_units(char* str, size_t len, int grapheme) { // reverse each multi-byte unit where it stands
+    unsigned char* s = (unsigned char*)str;
+    size_t unit_end = 0; // end of the last unit reversed
+    size_t pos = skip_ascii(s, 0, len);
+    while (pos < len) {
+        unsigned int cp;
+        size_t start = pos;
+        pos += utf8_decode(s + pos, len - pos, &cp);
+        if (grapheme && start > unit_end && is_attached_mark(cp)) { // a mark on an ASCII letter, e.g. e + U+0301
+            start--;
+        }
+        int joined = cp == 0x200D;
+        while (grapheme && pos < len && (s[pos] >= 0x80 || joined)) { // extend over attached marks
+            unsigned int next;
+            size_t next_len = utf8_decode(s + pos, len - pos, &next);
+            if (!joined && !is_attached_mark(next)) break;
+            joined = next == 0x200D;
+            pos += next_len;
+        }
+        if (pos - start > 1) {
+            reverse_inplace_scalar(str + start, pos - start); // short, the vector kernels would not pay off
+        }
+        unit_end = pos;
+        if (pos < len && s[pos] < 0x80) {
+            pos = skip_ascii(s, pos, len);
+        }
+    }
+}
+
+// Flipper modes, the plugin argument: =bytes (default), =utf8, =grapheme
+
+typedef struct {
+    const char* name;
+    int utf8;                        // keep UTF-8 code points intact
+    int grapheme;                    // also keep combining marks with their base
+} flipper_mode_t;
+
+static const flipper_mode_t g_flipper_modes[] = {
+    { "bytes", 0, 0 },
+    { "utf8", 1, 0 },
+    { "grapheme", 1, 1 },
+};
+
+static void flip_buffer(char* str, size_t len, const flipper_mode_t* mode) { // reverse len bytes in place
+    if (mode->utf8) {
+        reverse_units(str, len, mode->grapheme);
+    }
+    byte_reverse(str, len); // the framework's dispatched kernel, views are written out with it too
+}
+
+// Flipper plugin transformation function
+
+static const char* plugin_parse_args(const char* args, void** state) { // select the mode
+    if (!args) {
+        *state = (void*)&g_flipper_modes[0];
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(g_flipper_modes) / sizeof(g_flipper_modes[0]); i++) {
+        if (strcmp(args, g_flipper_modes[i].name) == 0) {
+            *state = (void*)&g_flipper_modes[i]; // static, nothing to free
+            return NULL;
+        }
+    }
+    return "Unknown flipper mode (expected bytes, utf8 or grapheme)";
+}
+
+static int plugin_transform(const plugin_buffer_t* input, plugin_buffer_t* output, void* state) { // transform input buffer
+    const flipper_mode_t* mode = (const flipper_mode_t*)state;
+    if (!input || !output || !mode) return -1;
+    size_t len = input->len;
+    if (plugin_buffer_alloc(output, len + 1) != 0) return -1;
+    if (mode->utf8) { // the unit pass works in place on the copy
+        memcpy(output->ptr, input->ptr, len);
+        flip_buffer(output->ptr, len, mode);
+    } else {
+        g_reverse_copy(output->ptr, input->ptr, len); // a single pass
+    }
+    output->ptr[len] = '\0';
+    output->len = len;
+    return 0;
+}
+
+static int plugin_transform_inplace(plugin_buffer_t* item, void* state) { // reverse the owned buffer directly
+    const flipper_mode_t* mode = (const flipper_mode_t*)state;
+    if (!item || !mode) return -1;
+    flip_buffer(item->ptr, item->len, mode);
+    return 0;
+}
+
+static int plugin_transform_view(plugin_buffer_t* item, void* state) { // record the reversal, the bytes stay put
+    const flipper_mode_t* mode = (const flipper_mode_t*)state;
+    if (!item || !mode) return -1;
+    if (mode->utf8) return PLUGIN_VIEW_DECLINED; // needs to see the characters
+    plugin_view_reverse(item);
+    return 0;
+}
+
+static const plugin_ops_t g_plugin_ops = { "flipper", plugin_transform, plugin_transform_inplace, plugin_transform_view, plugin_parse_args, NULL, NULL }; // transforms run by the framework
+
+const char* plugin_get_name(void) { return "flipper"; } // get plugin name
+const char* plugin_init(int queue_size) { return common_plugin_init_v2(&g_plugin_ops, queue_size); } // initialize plugin
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance) { return common_plugin_instance_init_v2(&g_plugin_ops, config, instance); } // create an instance
+const char* plugin_get_pure(const char* args, plugin_fused_t* fused) { return common_plugin_get_pure(&g_plugin_ops, args, fused); } // pure, may be fused
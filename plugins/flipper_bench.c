@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* pull in the implementation so we reach the static kernels */
+#include "flipper.c"
+
+// Microbenchmark for the flipper kernels
+// Usage: ./output/flipper_bench [megabytes]
+// Reverses the same input cut into 1 KB, 16 KB, 256 KB and 1 MB lines with every byte
+// kernel, in place and into a second buffer, then with the UTF-8 modes. Every kernel is
+// checked against the scalar one, and the UTF-8 modes must give back the input when run twice.
+
+typedef struct {
+    const char* name;
+    void (*copy)(char* dst, const char* src, size_t len);
+    void (*inplace)(char* str, size_t len);
+} bench_kernel_t;
+
+static const size_t g_line_sizes[] = { 1024, 16 * 1024, 256 * 1024, 1024 * 1024 };
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void fill_input(char* buf, size_t size) { // words with UTF-8 letters and combining marks
+    static const char* const words[] = { "Ångström", "wörld", "αβγ", "жизнь", "cafe\xCC\x81", "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD" };
+    size_t pos = 0;
+    unsigned int seed = 12345;
+    while (pos < size) {
+        seed = seed * 1103515245u + 12345u;
+        if ((seed >> 16) % 8 == 0) {
+            const char* word = words[(seed >> 8) % 6];
+            size_t len = strlen(word);
+            if (pos + len > size) break;
+            memcpy(buf + pos, word, len);
+            pos += len;
+        } else {
+            buf[pos++] = (char)((seed >> 16) % 3 == 0 ? ' ' : 'a' + (seed >> 8) % 26);
+        }
+    }
+    while (pos < size) buf[pos++] = ' ';
+}
+
+static size_t line_start(const char* buf, size_t off, size_t size) { // move a cut off a character or a mark
+    const unsigned char* s = (const unsigned char*)buf;
+    while (off < size && s[off] >= 0x80) {
+        unsigned int cp = 0;
+        if ((s[off] & 0xC0) != 0x80) { // a lead byte, fine unless it starts a mark
+            utf8_decode(s + off, size - off, &cp);
+            if (!is_attached_mark(cp)) break;
+        }
+        off++;
+    }
+    return off;
+}
+
+static double mbps(size_t size, double elapsed) {
+    return elapsed > 0 ? (double)size / (1024.0 * 1024.0) / elapsed : 0.0;
+}
+
+static double run_inplace(void (*kernel)(char*, size_t), const char* input, char* work, size_t size, size_t line) {
+    memcpy(work, input, size);
+    double start = now_seconds();
+    for (size_t off = 0; off < size; off += line) {
+        kernel(work + off, size - off < line ? size - off : line);
+    }
+    return mbps(size, now_seconds() - start);
+}
+
+static double run_copy(void (*kernel)(char*, const char*, size_t), const char* input, char* work, size_t size, size_t line) {
+    double start = now_seconds();
+    for (size_t off = 0; off < size; off += line) {
+        kernel(work + off, input + off, size - off < line ? size - off : line);
+    }
+    return mbps(size, now_seconds() - start);
+}
+
+static double run_mode(const flipper_mode_t* mode, const char* input, char* work, size_t size, size_t line,
+                       const char* cuts) { // lines cut between characters of cuts
+    memcpy(work, input, size);
+    double start = now_seconds();
+    for (size_t off = 0; off < size;) {
+        size_t end = off + line < size ? line_start(cuts, off + line, size) : size;
+        flip_buffer(work + off, end - off, mode);
+        off = end;
+    }
+    return mbps(size, now_seconds() - start);
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 64;
+    if (megabytes == 0) megabytes = 1;
+    size_t size = megabytes * 1024 * 1024;
+
+    bench_kernel_t kernels[3];
+    int num_kernels = 0;
+    kernels[num_kernels++] = (bench_kernel_t){ "scalar", reverse_copy_scalar, byte_reverse_scalar };
+#if FLIPPER_X86
+    if (__builtin_cpu_supports("ssse3")) {
+        kernels[num_kernels++] = (bench_kernel_t){ "ssse3", reverse_copy_ssse3, byte_reverse_ssse3 };
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[num_kernels++] = (bench_kernel_t){ "avx2", reverse_copy_avx2, byte_reverse_avx2 };
+    }
+#endif
+
+    char* input = malloc(size);
+    char* expected = malloc(size);
+    char* work = malloc(size);
+    if (!input || !expected || !work) {
+        fprintf(stderr, "Memory allocation failure\n");
+        return 1;
+    }
+    fill_input(input, size);
+
+    printf("Flipper kernels, %zu MB, dispatch picks '%s' (in place '%s')\n", megabytes, g_reverse_kernel_name,
+           byte_reverse_kernel_name());
+    size_t num_lines = sizeof(g_line_sizes) / sizeof(g_line_sizes[0]);
+    for (size_t l = 0; l < num_lines; l++) {
+        size_t line = g_line_sizes[l];
+        if (line > size) break;
+
+        // every kernel must match the byte at a time reversal, both ways
+        run_inplace(reverse_inplace_scalar, input, expected, size, line);
+        for (int k = 0; k < num_kernels; k++) {
+            run_inplace(kernels[k].inplace, input, work, size, line);
+            int same = memcmp(work, expected, size) == 0;
+            run_copy(kernels[k].copy, input, work, size, line);
+            if (!same || memcmp(work, expected, size) != 0) {
+                fprintf(stderr, "Kernel %s disagrees with scalar on %zu byte lines\n", kernels[k].name, line);
+                return 1;
+            }
+        }
+
+        // flipping twice gives back the input, the UTF-8 modes never split a unit
+        for (size_t m = 1; m < sizeof(g_flipper_modes) / sizeof(g_flipper_modes[0]); m++) {
+            run_mode(&g_flipper_modes[m], input, work, size, line, input);
+            memcpy(expected, work, size);
+            run_mode(&g_flipper_modes[m], expected, work, size, line, input); // same cuts, every line flips back
+            if (memcmp(work, input, size) != 0) {
+                fprintf(stderr, "Mode %s does not round trip on %zu byte lines\n", g_flipper_modes[m].name, line);
+                return 1;
+            }
+        }
+
+        printf("%zu byte lines:\n", line);
+        for (int k = 0; k < num_kernels; k++) {
+            double best_inplace = 0.0;
+            double best_copy = 0.0;
+            for (int round = 0; round < 3; round++) {
+                double a = run_inplace(kernels[k].inplace, input, work, size, line);
+                double b = run_copy(kernels[k].copy, input, work, size, line);
+                if (a > best_inplace) best_inplace = a;
+                if (b > best_copy) best_copy = b;
+            }
+            printf("  %-9s in place %9.1f MB/s   copy %9.1f MB/s\n", kernels[k].name, best_inplace, best_copy);
+        }
+        for (size_t m = 1; m < sizeof(g_flipper_modes) / sizeof(g_flipper_modes[0]); m++) {
+            double best = 0.0;
+            for (int round = 0; round < 3; round++) {
+                double a = run_mode(&g_flipper_modes[m], input, work, size, line, input);
+                if (a > best) best = a;
+            }
+            printf("  %-9s in place %9.1f MB/s\n", g_flipper_modes[m].name, best);
+        }
+    }
+    printf("All kernels agree\n");
+
+    free(input);
+    free(expected);
+    free(work);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sync/line_reader.h"
+
+// Microbenchmark for the input reader
+// Usage: ./output/ingest_bench [megabytes]
+// Reads the same file of mixed length lines with fgets into a 1026 byte buffer (the
+// original reader, which splits long lines), getline, the block line reader and the
+// mapped line reader (-f). Every reader copies each line out, as the host does into a
+// work item. getline and both line readers must see the same lines before any timing
+// is reported.
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double mbps(size_t size, double elapsed) {
+    return elapsed > 0 ? (double)size / (1024.0 * 1024.0) / elapsed : 0.0;
+}
+
+static size_t fill_input(FILE* file, size_t size) { // lines from a few bytes to a few KB
+    char line[8192];
+    size_t pos = 0;
+    unsigned int seed = 12345;
+    while (pos < size) {
+        seed = seed * 1103515245u + 12345u;
+        size_t len = (seed >> 16) % 16 == 0 ? (seed >> 8) % 6000 : (seed >> 8) % 120;
+        for (size_t i = 0; i < len; i++) {
+            line[i] = (char)('a' + (i * 7 + seed) % 26);
+        }
+        line[len] = '\n';
+        fwrite(line, 1, len + 1, file);
+        pos += len + 1;
+    }
+    fflush(file);
+    return pos;
+}
+
+typedef struct {
+    unsigned long long lines;
+    unsigned long long hash;         // order sensitive checksum of the lines
+} read_result_t;
+
+static void account(read_result_t* result, char* copy, const char* line, size_t len) { // copy out, like the host
+    memcpy(copy, line, len);
+    result->lines++;
+    result->hash = result->hash * 31 + len;
+    if (len > 0) result->hash = result->hash * 31 + (unsigned char)copy[len / 2];
+}
+
+static read_result_t run_fgets(FILE* file, char* copy) {
+    read_result_t result = { 0, 0 };
+    char buffer[1026];
+    rewind(file);
+    while (fgets(buffer, sizeof(buffer), file)) {
+        size_t len = strlen(buffer);
+        if (len > 0 && buffer[len - 1] == '\n') len--;
+        account(&result, copy, buffer, len);
+    }
+    return result;
+}
+
+static read_result_t run_getline(FILE* file, char* copy) {
+    read_result_t result = { 0, 0 };
+    char* buffer = NULL;
+    size_t size = 0;
+    ssize_t got;
+    rewind(file);
+    while ((got = getline(&buffer, &size, file)) != -1) {
+        size_t len = (size_t)got;
+        if (len > 0 && buffer[len - 1] == '\n') len--;
+        account(&result, copy, buffer, len);
+    }
+    free(buffer);
+    return result;
+}
+
+static read_result_t run_reader(FILE* file, char* copy, int mapped) {
+    read_result_t result = { 0, 0 };
+    line_reader_t reader;
+    const char* line;
+    size_t len;
+    lseek(fileno(file), 0, SEEK_SET);
+    if ((mapped ? line_reader_init_mapped(&reader, fileno(file)) : line_reader_init(&reader, fileno(file), 0)) != 0) {
+        return result;
+    }
+    while (line_reader_next(&reader, &line, &len) == 1) {
+        account(&result, copy, line, len);
+    }
+    line_reader_destroy(&reader);
+    return result;
+}
+
+static read_result_t run_line_reader(FILE* file, char* copy) {
+    return run_reader(file, copy, 0);
+}
+
+static read_result_t run_mapped_reader(FILE* file, char* copy) {
+    return run_reader(file, copy, 1);
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 64;
+    if (megabytes == 0) megabytes = 1;
+
+    FILE* file = tmpfile();
+    char* copy = malloc(8192);
+    if (!file || !copy) {
+        fprintf(stderr, "Failed to set up the input\n");
+        return 1;
+    }
+    size_t size = fill_input(file, megabytes * 1024 * 1024);
+
+    read_result_t expected = run_getline(file, copy);
+    read_result_t actual = run_line_reader(file, copy);
+    read_result_t mapped = run_mapped_reader(file, copy);
+    if (expected.lines != actual.lines || expected.hash != actual.hash ||
+        expected.lines != mapped.lines || expected.hash != mapped.hash) {
+        fprintf(stderr, "Line readers saw %llu and %llu lines, getline %llu\n", actual.lines, mapped.lines, expected.lines);
+        return 1;
+    }
+
+    printf("Ingest, %zu MB in %llu lines (from the page cache)\n", megabytes, expected.lines);
+    struct {
+        const char* name;
+        read_result_t (*run)(FILE*, char*);
+    } readers[] = { { "fgets", run_fgets }, { "getline", run_getline }, { "block", run_line_reader }, { "mapped", run_mapped_reader } };
+    for (size_t r = 0; r < sizeof(readers) / sizeof(readers[0]); r++) {
+        double best = 0.0;
+        unsigned long long lines = 0;
+        for (int round = 0; round < 3; round++) {
+            double start = now_seconds();
+            lines = readers[r].run(file, copy).lines;
+            double a = mbps(size, now_seconds() - start);
+            if (a > best) best = a;
+        }
+        printf("  %-8s %9.1f MB/s  %llu lines\n", readers[r].name, best, lines);
+    }
+    printf("All readers agree\n");
+
+    fclose(file);
+    free(copy);
+    return 0;
+}
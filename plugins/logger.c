@@ -5,16 +5,48 @@
 
 // Logger plugin transform function
 
-static const char* plugin_transform(const char* input) { // transform input string
-    if (!input) {
-        return NULL;
+static int log_line(const plugin_buffer_t* item) { // one record, so another logger instance cannot interleave
+    if (plugin_output_framing() == FRAMING_LENPREFIX) { // the item as a frame, exact bytes and no prefix
+        return plugin_output_write_frame(item->ptr, item->len);
     }
+    // written by length so embedded NUL bytes survive, the output sink batches the lines
+    struct iovec iov[3] = { { "[logger] ", 9 }, { item->ptr, item->len }, { "\n", 1 } };
+    return plugin_output_write(iov, 3);
+}
+
+static int plugin_transform(const plugin_buffer_t* input, plugin_buffer_t* output, void* state) { // transform input buffer
+    (void)state; // no plugin argument
+    if (!input || !output) {
+        return -1;
+    }
+    if (log_line(input) != 0) {
+        return -1;
+    }
+
+    // return a copy of the input buffer
+    if (plugin_buffer_alloc(output, input->len + 1) != 0) {
+        return -1;
+    }
+    memcpy(output->ptr, input->ptr, input->len + 1);
+    output->len = input->len;
+    return 0;
+}
 
-    printf("[logger] %s\n", input); // log the input string
-    fflush(stdout); // ensure immediate output
+static int plugin_transform_inplace(plugin_buffer_t* item, void* state) { // log the owned buffer, it passes on unchanged
+    (void)state; // no plugin argument
+    if (!item) {
+        return -1;
+    }
+    return log_line(item);
+}
 
-    return strdup(input); // return a copy of the input string
+static int plugin_flush(void* state) { // lines still buffered go out, at a flush message and at the end of stream
+    (void)state; // no plugin argument
+    return plugin_output_flush();
 }
 
+static const plugin_ops_t g_plugin_ops = { "logger", plugin_transform, plugin_transform_inplace, NULL, NULL, NULL, plugin_flush }; // transforms run by the framework
+
 const char* plugin_get_name(void) { return "logger"; } // get plugin name
-const char* plugin_init(int queue_size) { return common_plugin_init(plugin_transform, "logger", queue_size); } // initialize plugin
\ No newline at end of file
+const char* plugin_init(int queue_size) { return common_plugin_init_v2(&g_plugin_ops, queue_size); } // initialize plugin
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance) { return common_plugin_instance_init_v2(&g_plugin_ops, config, instance); } // create an instance
@@ -1,10 +1,109 @@
 #include "plugin_common.h"
+#include "sync/byte_reverse.h"
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-// global plugin context, shared across all plugins
-static plugin_context_t g_plugin_context = {0};
+// queue backend used between stages, every queue has exactly one producer (main or the
+// upstream stage) and one consumer (this plugin's consumer thread), build with
+// -DPLUGIN_QUEUE_MODE=CONSUMER_PRODUCER_LOCKED to fall back to the mutex queue
+#ifndef PLUGIN_QUEUE_MODE
+#define PLUGIN_QUEUE_MODE CONSUMER_PRODUCER_SPSC
+#endif
+
+// implicit instance driven by the single instance interface (plugin_init, plugin_place_work, ...)
+static plugin_instance_t* g_default_instance = NULL;
+
+// pool of the instance whose consumer thread is running, used by plugin_alloc in transforms
+static _Thread_local item_pool_t* tls_item_pool = NULL;
+
+// host allocator while another plugin's worker runs this plugin's transform (stage fusion)
+static _Thread_local plugin_alloc_func_t tls_fused_alloc = NULL;
+
+// stdout writer of the pipeline, one per host and shared by all its instances
+static output_sink_t* g_output_sink = NULL;
+
+void* plugin_alloc(size_t size) { // allocate an item buffer
+    if (tls_fused_alloc) {
+        return tls_fused_alloc(size);
+    }
+    return item_pool_alloc(tls_item_pool, size);
+}
+
+char* plugin_strdup(const char* str) { // copy a string into an item buffer
+    if (tls_fused_alloc) {
+        size_t size = strlen(str) + 1;
+        char* copy = (char*)tls_fused_alloc(size);
+        if (copy) {
+            memcpy(copy, str, size);
+        }
+        return copy;
+    }
+    return item_pool_strdup(tls_item_pool, str);
+}
+
+int plugin_buffer_alloc(plugin_buffer_t* buffer, size_t capacity) { // allocate an empty output buffer
+    if (!buffer) {
+        return -1;
+    }
+    if (capacity < 1) {
+        capacity = 1;
+    }
+    buffer->ptr = (char*)plugin_alloc(capacity);
+    if (!buffer->ptr) {
+        return -1;
+    }
+    buffer->ptr[0] = '\0';
+    buffer->len = 0;
+    buffer->capacity = capacity;
+    buffer->view = (plugin_view_t){ 0, 0 };
+    buffer->kind = PLUGIN_ITEM_DATA;
+    return 0;
+}
+
+void plugin_view_reverse(plugin_buffer_t* item) { // flip the logical order
+    if (!item || item->len < 2) {
+        return;
+    }
+    size_t n = item->len;
+    item->view.start = item->view.reversed ? (item->view.start + 1) % n : (item->view.start + n - 1) % n;
+    item->view.reversed = !item->view.reversed;
+}
+
+void plugin_view_rotate(plugin_buffer_t* item, size_t shift) { // rotate right, rotations add up
+    if (!item || item->len < 2) {
+        return;
+    }
+    size_t n = item->len;
+    shift %= n;
+    item->view.start = item->view.reversed ? (item->view.start + shift) % n : (item->view.start + n - shift) % n;
+}
+
+int plugin_view_materialize(plugin_buffer_t* item) { // write the pending reorder out, in place, with the vector kernels
+    if (!item) {
+        return -1;
+    }
+    size_t n = item->len;
+    size_t start = item->view.start;
+    if (item->view.reversed && n > 1) { // bytes start..0, then n-1..start+1: two runs reversed where they are
+        byte_reverse(item->ptr, start + 1);
+        byte_reverse(item->ptr + start + 1, n - start - 1);
+    } else if (start != 0 && n > 1) { // rotation: reverse both runs, then the whole item
+        byte_reverse(item->ptr, start);
+        byte_reverse(item->ptr + start, n - start);
+        byte_reverse(item->ptr, n);
+    }
+    item->view = (plugin_view_t){ 0, 0 };
+    return 0;
+}
+
+void plugin_free(void* ptr) { // release an item buffer
+    item_pool_free(tls_item_pool, ptr);
+}
 
 void log_error(plugin_context_t* context, const char* message) { // log error messages
     if (context && context->name && message) {
@@ -14,10 +113,263 @@ void log_error(plugin_context_t* context, const char* message) { // log error me
 
 void log_info(plugin_context_t* context, const char* message) { // log info messages
     if (context && context->name && message) {
-        printf("[INFO][%s] - %s\n", context->name, message); // log the info message
+        struct iovec iov[5] = { { "[INFO][", 7 }, { (char*)context->name, strlen(context->name) }, { "] - ", 4 },
+                                { (char*)message, strlen(message) }, { "\n", 1 } };
+        plugin_output_write(iov, 5); // log the info message, in order with the plugins' output
+    }
+}
+
+int plugin_output_write(const struct iovec* iov, int count) { // one record to stdout
+    if (g_output_sink) {
+        return output_sink_writev(g_output_sink, iov, count);
+    }
+    flockfile(stdout); // stdio fallback, the stream stays locked so records do not interleave
+    for (int i = 0; i < count; i++) {
+        fwrite(iov[i].iov_base, 1, iov[i].iov_len, stdout);
+    }
+    int result = fflush(stdout) == 0 ? 0 : -1;
+    funlockfile(stdout);
+    return result;
+}
+
+output_reservation_t* plugin_output_reserve(void) { // a record's place in the output, filled later
+    return g_output_sink ? output_sink_reserve(g_output_sink) : NULL;
+}
+
+int plugin_output_write_reserved(output_reservation_t* reservation, const struct iovec* iov, int count) { // part of a reserved record
+    if (!reservation) { // nothing reserved, written as it comes
+        return plugin_output_write(iov, count);
+    }
+    return output_sink_writev_reserved(g_output_sink, reservation, iov, count);
+}
+
+int plugin_output_commit(output_reservation_t* reservation) { // the reserved record is complete
+    return reservation ? output_sink_commit(g_output_sink, reservation) : 0;
+}
+
+framing_t plugin_output_framing(void) { // record format of the pipeline's output
+    return g_output_sink ? g_output_sink->framing : FRAMING_LINES;
+}
+
+int plugin_output_write_frame(const char* data, size_t len) { // one length-prefixed record
+    if (!g_output_sink || g_output_sink->framing != FRAMING_LENPREFIX) {
+        return -1;
+    }
+    return output_sink_write_record(g_output_sink, data, len);
+}
+
+int plugin_output_flush(void) { // write out what the sink holds
+    return g_output_sink ? output_sink_flush(g_output_sink) : 0;
+}
+
+static void forward_batch(plugin_context_t* context, plugin_buffer_t* items, int count) { // hand processed items downstream
+    if (count <= 0) {
+        return;
+    }
+
+    if (context->next_place_work_buffers) { // next instance adopts the whole batch, nothing to free
+        const char* result = context->next_place_work_buffers(context->next_instance, items, count);
+        if (result != NULL) {
+            log_error(context, "Failed to pass work to next plugin");
+        }
+        return;
+    }
+
+    if (context->next_place_work) { // single instance interface, one copied string at a time
+        for (int i = 0; i < count; i++) {
+            if (items[i].kind != PLUGIN_ITEM_DATA) { // strings only carry data, the end goes as "<END>"
+                continue;
+            }
+            if (plugin_view_materialize(&items[i]) != 0) {
+                log_error(context, "Failed to pass work to next plugin");
+                continue;
+            }
+            const char* result = context->next_place_work(items[i].ptr);
+            if (result != NULL) {
+                log_error(context, "Failed to pass work to next plugin");
+            }
+        }
+    }
+
+    // the next plugin stored its own copies (or this is the last plugin, where control
+    // messages stop), free ours
+    for (int i = 0; i < count; i++) {
+        plugin_free(items[i].ptr);
+    }
+}
+
+static void forward_end(plugin_context_t* context) { // pass the end of stream to the next plugin
+    const char* result = NULL;
+    if (context->next_place_work_buffers) {
+        plugin_buffer_t end_item = { NULL, 0, 0, { 0, 0 }, PLUGIN_ITEM_END };
+        result = context->next_place_work_buffers(context->next_instance, &end_item, 1);
+    } else if (context->next_place_work) {
+        result = context->next_place_work("<END>"); // the single instance interface's end marker
+    }
+    if (result != NULL) {
+        log_error(context, "Failed to pass end of stream to next plugin");
+    }
+}
+
+static void flush_stage(plugin_context_t* context) { // write out what the plugin still holds
+    if (context->ops && context->ops->flush && context->ops->flush(context->state) != 0) {
+        log_error(context, "Failed to flush plugin output");
     }
 }
 
+static int dispatch_batch(plugin_context_t* context, plugin_buffer_t* batch, unsigned long* ticket) { // take the next batch in input order
+    pthread_mutex_lock(&context->dispatch_mutex); // workers take turns at the queue, so it stays single-consumer
+    if (context->end_seen) { // another worker already took the end of stream, nothing more will arrive
+        pthread_mutex_unlock(&context->dispatch_mutex);
+        return 0;
+    }
+
+    int count = consumer_producer_get_buffers(context->queue, batch, context->batch_limit); // drain a batch
+    if (count > 0) {
+        *ticket = context->next_ticket++; // batches are numbered in the order they left the queue
+        for (int i = 0; i < count; i++) {
+            if (batch[i].kind == PLUGIN_ITEM_END) {
+                context->end_seen = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&context->dispatch_mutex);
+    return count;
+}
+
+static void commit_in_order(plugin_context_t* context, unsigned long ticket, plugin_buffer_t* items, int count,
+                            int flush, int done) { // forward a batch in input order
+    if (context->num_workers > 1) { // wait until every earlier batch has been forwarded
+        pthread_mutex_lock(&context->order_mutex);
+        while (context->next_commit != ticket) {
+            pthread_cond_wait(&context->order_cond, &context->order_mutex);
+        }
+        pthread_mutex_unlock(&context->order_mutex);
+    }
+
+    if (flush && !done) { // every item before the flush message has been processed
+        flush_stage(context);
+    }
+    forward_batch(context, items, count); // pass results downstream as one batch, control messages in place
+
+    if (done) {
+        flush_stage(context); // output the plugin still holds
+        forward_end(context); // pass the end of stream to next plugin, if there is one
+
+        context->finished = 1; // mark the context as finished
+        consumer_producer_signal_finished(context->queue); // signal that processing is finished
+    }
+
+    if (context->num_workers > 1) { // let the holder of the next ticket go
+        pthread_mutex_lock(&context->order_mutex);
+        context->next_commit = ticket + 1;
+        pthread_cond_broadcast(&context->order_cond);
+        pthread_mutex_unlock(&context->order_mutex);
+    }
+}
+
+static void* fused_alloc(size_t size) { // allocator handed to fused transforms, always this worker's pool
+    return item_pool_alloc(tls_item_pool, size);
+}
+
+static int process_v1(plugin_context_t* context, const plugin_buffer_t* input, plugin_buffer_t* output) { // shim for SDK v1 transforms
+    const char* result = context->process_function(input->ptr);
+    if (!result) {
+        return -1;
+    }
+    output->ptr = (char*)result;
+    output->len = strlen(result);
+    output->capacity = output->len + 1;
+    output->view = (plugin_view_t){ 0, 0 };
+    output->kind = PLUGIN_ITEM_DATA;
+    return 0;
+}
+
+static int process_item(plugin_context_t* context, plugin_buffer_t* work_item, plugin_buffer_t* output) { // run the stage's transforms, consumes work_item
+    int view_result = context->ops && context->ops->process_view ? context->ops->process_view(work_item, context->state)
+                                                                 : PLUGIN_VIEW_DECLINED;
+    if (view_result == 0) { // a reorder, only the view changed
+        *output = *work_item;
+    } else if (view_result != PLUGIN_VIEW_DECLINED) {
+        plugin_free(work_item->ptr);
+        return -1;
+    } else if (plugin_view_materialize(work_item) != 0) { // everything else reads the bytes in order
+        plugin_free(work_item->ptr);
+        return -1;
+    } else if (context->ops && context->ops->process_inplace) { // rewrite the buffer we own, no allocation and no copy
+        *output = *work_item;
+        if (context->ops->process_inplace(output, context->state) != 0) {
+            plugin_free(output->ptr);
+            return -1;
+        }
+    } else {
+        int result = context->ops ? context->ops->process(work_item, output, context->state)
+                                  : process_v1(context, work_item, output); // process the work item
+        plugin_free(work_item->ptr); // free the original work item
+        if (result != 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < context->fused_count; i++) { // fused plugins run back-to-back, no queue hop
+        view_result = context->fused[i].process_view ? context->fused[i].process_view(output, context->fused[i].state)
+                                                     : PLUGIN_VIEW_DECLINED;
+        if (view_result == 0) {
+            continue;
+        }
+        if (view_result != PLUGIN_VIEW_DECLINED || plugin_view_materialize(output) != 0) {
+            plugin_free(output->ptr);
+            return -1;
+        }
+        if (context->fused[i].process_inplace) {
+            if (context->fused[i].process_inplace(output, context->fused[i].state) != 0) {
+                plugin_free(output->ptr);
+                return -1;
+            }
+            continue;
+        }
+        plugin_buffer_t next;
+        int result = context->fused[i].process(output, &next, fused_alloc, context->fused[i].state);
+        plugin_free(output->ptr);
+        if (result != 0) {
+            return -1;
+        }
+        *output = next;
+    }
+    output->kind = PLUGIN_ITEM_DATA;
+    return 0;
+}
+
+static int process_batch(plugin_context_t* context, plugin_buffer_t* batch, int count, unsigned long ticket) { // transform a batch and forward it, 1 at the end of stream
+    plugin_buffer_t processed[PLUGIN_BATCH_SIZE];
+    int processed_count = 0;
+    int flush = 0;
+    int done = 0;
+    for (int i = 0; i < count; i++) {
+        plugin_buffer_t* work_item = &batch[i];
+
+        if (done || work_item->kind == PLUGIN_ITEM_END) { // check for termination signal
+            done = 1;
+            plugin_free(work_item->ptr); // free the work item
+            continue;
+        }
+        if (work_item->kind != PLUGIN_ITEM_DATA) { // control message, skips the transforms and moves on in order
+            flush = flush || work_item->kind == PLUGIN_ITEM_FLUSH;
+            processed[processed_count++] = *work_item;
+            continue;
+        }
+
+        if (process_item(context, work_item, &processed[processed_count]) != 0) { // check for a failed transform
+            log_error(context, "Plugin processing function failed");
+            continue;
+        }
+        processed_count++; // transform output is ours to move
+    }
+
+    commit_in_order(context, ticket, processed, processed_count, flush, done);
+    return done;
+}
+
 void* plugin_consumer_thread(void* arg) { // consumer thread for plugin
     plugin_context_t* context = (plugin_context_t*)arg;
     
@@ -25,143 +377,526 @@ void* plugin_consumer_thread(void* arg) { // consumer thread for plugin
         return NULL;
     }
 
-    while (1) {  
-        char* work_item = consumer_producer_get(context->queue); // get work item from queue
+    plugin_buffer_t batch[PLUGIN_BATCH_SIZE];
+    int done = 0;
+    tls_item_pool = context->pool; // transforms on this thread allocate from the instance's pool
 
-        if (!work_item) { // check if work item is NULL
+    while (!done) {  
+        unsigned long ticket = 0;
+        int count = dispatch_batch(context, batch, &ticket);
+
+        if (count == 0) { // another worker is shutting the stage down
+            break;
+        }
+        if (count < 0) { // check if the queue failed
             log_error(context, "Failed to get work item from queue");
             break;
         }
 
-        if (strcmp(work_item, "<END>") == 0) { // check for termination signal
-            if (context->next_place_work) { // check if there is a next plugin
-                const char* result = context->next_place_work("<END>"); // pass <END> to next plugin
-                if (result != NULL) {
-                    log_error(context, "Failed to pass <END> to next plugin");
-                }
-            }
+        done = process_batch(context, batch, count, ticket);
+    }
+
+    item_pool_thread_flush(); // hand this thread's cached buffers back to the pool
+    return NULL;
+}
+
+static void stage_run(scheduler_task_t* task) { // scheduler task of a stage, processes a few queued batches
+    plugin_context_t* context = (plugin_context_t*)((char*)task - offsetof(plugin_context_t, task));
+    atomic_fetch_add(&context->active, 1);
+    item_pool_t* saved_pool = tls_item_pool; // may run nested in another stage's task (see stage_help)
+    tls_item_pool = context->pool;
 
-            free(work_item); // free the work item
-            context->finished = 1; // mark the context as finished
-            consumer_producer_signal_finished(context->queue); // signal that processing is finished
+    plugin_buffer_t batch[PLUGIN_BATCH_SIZE];
+    int done = 0;
+    for (int i = 0; i < PLUGIN_STAGE_BATCHES && !done; i++) {
+        int count = consumer_producer_try_get_buffers(context->queue, batch, context->batch_limit);
+        if (count < 0) {
+            log_error(context, "Failed to get work item from queue");
+        }
+        if (count <= 0) {
             break;
         }
+        done = process_batch(context, batch, count, context->next_ticket++);
+    }
+    tls_item_pool = saved_pool;
 
-        const char* processed_item = context->process_function(work_item); // process the work item
+    if (!done) { // once finished the task stays marked, nothing arrives after the end of stream
+        atomic_store(&context->scheduled, 0); // from here on a put schedules the task again
+        if (consumer_producer_count(context->queue) > 0 && !atomic_exchange(&context->scheduled, 1)) {
+            scheduler_requeue(context->scheduler, &context->task); // more to do, after the tasks waiting here
+        }
+    }
+    atomic_fetch_sub(&context->active, 1); // last access, plugin_instance_fini may release the instance now
+}
+
+static void stage_wake(void* arg) { // items were put in the stage's queue
+    plugin_context_t* context = (plugin_context_t*)arg;
+    if (!atomic_exchange(&context->scheduled, 1)) {
+        scheduler_submit(context->scheduler, &context->task); // runs next on the producer's worker, near its data
+    }
+}
 
-        free(work_item); // free the original work item
+static int stage_help(void* arg) { // the stage's queue is full, run the stage on the producer's worker
+    plugin_context_t* context = (plugin_context_t*)arg;
+    return scheduler_help(context->scheduler, &context->task);
+}
 
-        if (!processed_item) { // check if processed item is NULL
-            log_error(context, "Plugin processing function returned NULL");
+static void stage_coroutine(void* arg) { // consumer loop of a stage on the coroutine runner
+    plugin_context_t* context = (plugin_context_t*)arg;
+    plugin_buffer_t batch[PLUGIN_BATCH_SIZE];
+    int done = 0;
+    int batches = 0;
+    tls_item_pool = context->pool; // every stage on the runner thread uses the same pool
+
+    while (!done) {
+        int count = consumer_producer_try_get_buffers(context->queue, batch, context->batch_limit);
+        if (count < 0) {
+            log_error(context, "Failed to get work item from queue");
+            break;
+        }
+        if (count == 0) { // the next put wakes it, the runner goes on with the other stages
+            batches = 0;
+            coroutine_park(&context->coroutine);
             continue;
         }
-
-        if (context->next_place_work) { // check if there is a next plugin
-            const char* result = context->next_place_work(processed_item);
-            if (result != NULL) {
-                log_error(context, "Failed to pass work to next plugin");
-            }
+        done = process_batch(context, batch, count, context->next_ticket++);
+        if (++batches == PLUGIN_STAGE_BATCHES) { // what went downstream is processed while still in cache
+            batches = 0;
+            coroutine_yield(&context->coroutine);
         }
-        
-        // If this is the last plugin in the chain, we need to free the processed item
-        if (!context->next_place_work) {
-            free((void*)processed_item);
+    }
+
+    item_pool_thread_flush(); // hand the runner thread's cached buffers of this plugin back to the pool
+}
+
+static void stage_resume(void* arg) { // items were put in the stage's queue
+    plugin_context_t* context = (plugin_context_t*)arg;
+    coroutine_wake(&context->coroutine);
+}
+
+static int stage_yield(void* arg) { // the stage's queue is full, an upstream coroutine lets it run
+    plugin_context_t* context = (plugin_context_t*)arg;
+    coroutine_t* producer = coroutine_current(context->runner);
+    if (!producer) { // the host's input thread, sleeps until the stage takes items
+        return -1;
+    }
+    coroutine_yield(producer); // the stage is ready, it was woken by the put that filled its queue
+    return 1;
+}
+
+static const char* parse_args(const plugin_ops_t* ops, const char* args, void** state) { // plugin argument to transform state
+    *state = NULL;
+    if (!ops || !ops->parse_args) {
+        return args ? "Plugin does not take arguments" : NULL;
+    }
+    return ops->parse_args(args, state);
+}
+
+static void free_state(const plugin_ops_t* ops, void* state) { // release what parse_args returned
+    if (ops && ops->free_state) {
+        ops->free_state(state);
+    }
+}
+
+typedef struct { // arguments of setup_queue
+    consumer_producer_t* queue;
+    int capacity;
+    const char* result;                                  // consumer_producer_init_mode's result
+} queue_setup_t;
+
+static void setup_queue(void* arg) { // create a stage's queue and write every page of its ring
+    queue_setup_t* setup = (queue_setup_t*)arg;
+    setup->result = consumer_producer_init_mode(setup->queue, setup->capacity, PLUGIN_QUEUE_MODE);
+    if (setup->result == NULL) {
+        volatile char* ring = (volatile char*)setup->queue->items; // calloc may hand out pages nobody touched yet
+        size_t size = sizeof(plugin_buffer_t) * (size_t)setup->capacity;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        for (size_t offset = 0; offset < size; offset += page) {
+            ring[offset] = 0;
         }
     }
-    
-    return NULL;
 }
 
-const char* common_plugin_init(const char* (*process_function)(const char*), 
-                               const char* name, int queue_size) { // Initialize the plugin
-    if (!process_function || !name || queue_size <= 0) { // Check for valid parameters
+static const char* instance_create(const char* (*process_function)(const char*), const plugin_ops_t* ops, const char* name,
+                                   const plugin_config_t* config, plugin_instance_t** instance) { // create an instance
+    if ((!process_function && (!ops || !ops->process)) || !name || !config || !instance || config->queue_size <= 0) { // Check for valid parameters
         return "Invalid parameters for plugin initialization";
     }
+    int workers = config->scheduler || config->coroutines ? 1 : config->workers > 0 ? config->workers : 1; // a scheduled or coroutine stage runs one batch at a time
+    if (workers > PLUGIN_MAX_WORKERS) {
+        return "Invalid worker count";
+    }
+
+    if (config->output) {
+        g_output_sink = config->output; // the same host sink for every instance
+    }
+
+    void* state = NULL;
+    const char* args_result = parse_args(ops, config->args, &state);
+    if (args_result != NULL) {
+        return args_result;
+    }
 
-    memset(&g_plugin_context, 0, sizeof(plugin_context_t)); // initialize the global context
+    plugin_context_t* context = (plugin_context_t*)calloc(1, sizeof(plugin_context_t));
+    if (!context) {
+        free_state(ops, state);
+        return "Failed to allocate memory for plugin instance";
+    }
 
-    g_plugin_context.name = name;
-    g_plugin_context.process_function = process_function;
-    g_plugin_context.next_place_work = NULL;
-    g_plugin_context.initialized = 0;
-    g_plugin_context.finished = 0;
+    context->name = name;
+    context->pool = config->pool;
+    context->process_function = process_function;
+    context->ops = ops;
+    context->state = state;
+    context->next_place_work = NULL;
+    context->next_instance = NULL;
+    context->next_place_work_buffers = NULL;
+    context->fused = NULL;
+    context->fused_count = 0;
+    context->scheduler = config->scheduler;
+    context->task.run = stage_run;
+    atomic_init(&context->scheduled, 0);
+    atomic_init(&context->active, 0);
+    context->runner = config->coroutines;
+    context->initialized = 0;
+    context->finished = 0;
 
     // allocate and initialize the queue
-    g_plugin_context.queue = malloc(sizeof(consumer_producer_t));
-    if (!g_plugin_context.queue) {
+    context->queue = malloc(sizeof(consumer_producer_t));
+    if (!context->queue) {
+        free_state(ops, state);
+        free(context);
         return "Failed to allocate memory for plugin queue";
     }
-    const char* queue_init_result = consumer_producer_init(g_plugin_context.queue, queue_size);
+    // a pinned stage's queue is created from its first thread's CPU, so the ring's pages
+    // are first written, and placed, on the NUMA node of the thread that reads them
+    int pinned = config->cpus && config->cpu_count > 0 && !config->scheduler;
+    queue_setup_t setup = { context->queue, config->queue_size, NULL };
+    if (pinned) {
+        affinity_run_on(config->cpus[0], setup_queue, &setup);
+    } else {
+        setup_queue(&setup);
+    }
+    const char* queue_init_result = setup.result;
     if (queue_init_result != NULL) { // Check for queue initialization errors
-        free(g_plugin_context.queue);
-        g_plugin_context.queue = NULL;
+        free(context->queue);
+        free_state(ops, state);
+        free(context);
         return queue_init_result; // return the error message
     }
-    
-    // create the consumer thread
-    int thread_result = pthread_create(&g_plugin_context.consumer_thread, NULL, 
-                                       plugin_consumer_thread, &g_plugin_context);
-    if (thread_result != 0) {
-        consumer_producer_destroy(g_plugin_context.queue);
-        free(g_plugin_context.queue);
-        g_plugin_context.queue = NULL;
-        return "Failed to create consumer thread";
+    consumer_producer_set_pool(context->queue, context->pool); // items come from the shared pool
+
+    if (config->fused && config->fused_count > 0) { // keep our own copy of the fused transforms
+        context->fused = (plugin_fused_t*)malloc(sizeof(plugin_fused_t) * (size_t)config->fused_count);
+        if (!context->fused) {
+            consumer_producer_destroy(context->queue);
+            free(context->queue);
+            free_state(ops, state);
+            free(context);
+            return "Failed to allocate memory for fused plugins";
+        }
+        memcpy(context->fused, config->fused, sizeof(plugin_fused_t) * (size_t)config->fused_count);
+        context->fused_count = config->fused_count;
+    }
+
+    // with several workers every one of them grabs a fair share of a full queue
+    context->num_workers = workers;
+    context->batch_limit = config->queue_size / workers;
+    if (context->batch_limit > PLUGIN_BATCH_SIZE) context->batch_limit = PLUGIN_BATCH_SIZE;
+    if (context->batch_limit < 1) context->batch_limit = 1;
+    pthread_mutex_init(&context->dispatch_mutex, NULL);
+    pthread_mutex_init(&context->order_mutex, NULL);
+    pthread_cond_init(&context->order_cond, NULL);
+
+    if (context->scheduler) { // the shared workers run the stage whenever its queue has items
+        consumer_producer_set_hooks(context->queue, stage_wake, stage_help, context);
+        if (scheduler_at_worker_exit(context->scheduler, item_pool_thread_flush) != 0) { // this plugin's caches
+            pthread_cond_destroy(&context->order_cond);
+            pthread_mutex_destroy(&context->order_mutex);
+            pthread_mutex_destroy(&context->dispatch_mutex);
+            consumer_producer_destroy(context->queue);
+            free(context->queue);
+            free(context->fused);
+            free_state(ops, state);
+            free(context);
+            return "Failed to register with the scheduler";
+        }
+    }
+    if (context->runner) { // puts wake the stage's coroutine, an upstream stage yields to it while its queue is full
+        consumer_producer_set_hooks(context->queue, stage_resume, stage_yield, context);
+        if (coroutine_start(context->runner, &context->coroutine, stage_coroutine, context, 0) != 0) {
+            pthread_cond_destroy(&context->order_cond);
+            pthread_mutex_destroy(&context->order_mutex);
+            pthread_mutex_destroy(&context->dispatch_mutex);
+            consumer_producer_destroy(context->queue);
+            free(context->queue);
+            free(context->fused);
+            free_state(ops, state);
+            free(context);
+            return "Failed to start the stage coroutine";
+        }
     }
 
-    g_plugin_context.initialized = 1; // mark the plugin as initialized
+    // create the consumer threads
+    for (int i = 0; i < context->num_workers && !context->scheduler && !context->runner; i++) {
+        int thread_result = pthread_create(&context->consumer_threads[i], NULL, 
+                                           plugin_consumer_thread, context);
+        if (thread_result != 0) {
+            // stop the workers that did start, nothing is attached downstream yet
+            if (i > 0) {
+                consumer_producer_put_control(context->queue, PLUGIN_ITEM_END);
+            }
+            for (int j = 0; j < i; j++) {
+                pthread_join(context->consumer_threads[j], NULL);
+            }
+            pthread_cond_destroy(&context->order_cond);
+            pthread_mutex_destroy(&context->order_mutex);
+            pthread_mutex_destroy(&context->dispatch_mutex);
+            consumer_producer_destroy(context->queue);
+            free(context->queue);
+            free(context->fused);
+            free_state(ops, state);
+            free(context);
+            return "Failed to create consumer thread";
+        }
+        if (pinned && affinity_pin_thread(context->consumer_threads[i], config->cpus[i % config->cpu_count]) != 0) {
+            log_error(context, "Failed to pin consumer thread"); // runs wherever the kernel puts it
+        }
+    }
+
+    context->initialized = 1; // mark the instance as initialized
+    *instance = context;
     return NULL; // success
 }
 
-const char* plugin_place_work(const char* str) { // place work item in the queue
+const char* common_plugin_instance_init(const char* (*process_function)(const char*), const char* name,
+                                        const plugin_config_t* config, plugin_instance_t** instance) { // create an SDK v1 instance
+    if (!process_function) {
+        return "Invalid parameters for plugin initialization";
+    }
+    return instance_create(process_function, NULL, name, config, instance);
+}
+
+const char* common_plugin_instance_init_v2(const plugin_ops_t* ops, const plugin_config_t* config,
+                                           plugin_instance_t** instance) { // create an SDK v2 instance
+    if (!ops || !ops->process) {
+        return "Invalid parameters for plugin initialization";
+    }
+    return instance_create(NULL, ops, ops->name, config, instance);
+}
+
+const char* common_plugin_init(const char* (*process_function)(const char*), 
+                               const char* name, int queue_size) { // Initialize the plugin
+    if (g_default_instance) {
+        return "Plugin already initialized";
+    }
+
+    plugin_config_t config = { queue_size, 1, NULL, NULL, 0, NULL, NULL, NULL, NULL, 0, NULL };
+    return common_plugin_instance_init(process_function, name, &config, &g_default_instance);
+}
+
+const char* common_plugin_init_v2(const plugin_ops_t* ops, int queue_size) { // Initialize the plugin
+    if (g_default_instance) {
+        return "Plugin already initialized";
+    }
+
+    plugin_config_t config = { queue_size, 1, NULL, NULL, 0, NULL, NULL, NULL, NULL, 0, NULL };
+    return common_plugin_instance_init_v2(ops, &config, &g_default_instance);
+}
+
+typedef struct { // state of a transform handed to a host for fusion
+    const plugin_ops_t* ops;
+    void* state;                                         // parsed plugin argument
+} pure_binding_t;
+
+static int pure_process(const plugin_buffer_t* input, plugin_buffer_t* output, plugin_alloc_func_t alloc, void* arg) { // run a transform for a fused stage
+    pure_binding_t* binding = (pure_binding_t*)arg;
+    if (!binding || !input || !output || !alloc) {
+        return -1;
+    }
+
+    plugin_alloc_func_t saved = tls_fused_alloc;
+    tls_fused_alloc = alloc; // the result must come from the host's allocator
+    int result = binding->ops->process(input, output, binding->state);
+    tls_fused_alloc = saved;
+    return result;
+}
+
+static int pure_process_inplace(plugin_buffer_t* item, void* arg) { // run an in-place transform for a fused stage
+    pure_binding_t* binding = (pure_binding_t*)arg;
+    if (!binding || !item) {
+        return -1;
+    }
+    return binding->ops->process_inplace(item, binding->state);
+}
+
+static int pure_process_view(plugin_buffer_t* item, void* arg) { // run a view transform for a fused stage
+    pure_binding_t* binding = (pure_binding_t*)arg;
+    if (!binding || !item) {
+        return -1;
+    }
+    return binding->ops->process_view(item, binding->state);
+}
+
+static void pure_release(void* arg) { // the host is done with the fused transform
+    pure_binding_t* binding = (pure_binding_t*)arg;
+    if (binding) {
+        free_state(binding->ops, binding->state);
+        free(binding);
+    }
+}
+
+const char* common_plugin_get_pure(const plugin_ops_t* ops, const char* args, plugin_fused_t* fused) { // transforms for a fused stage
+    if (!ops || !ops->process || !fused) {
+        return "Invalid parameters for plugin fusion";
+    }
+
+    pure_binding_t* binding = (pure_binding_t*)malloc(sizeof(pure_binding_t));
+    if (!binding) {
+        return "Failed to allocate memory for fused plugin";
+    }
+    binding->ops = ops;
+    const char* args_result = parse_args(ops, args, &binding->state);
+    if (args_result != NULL) {
+        free(binding);
+        return args_result;
+    }
+
+    fused->process = pure_process;
+    fused->process_inplace = ops->process_inplace ? pure_process_inplace : NULL;
+    fused->process_view = ops->process_view ? pure_process_view : NULL;
+    fused->state = binding;
+    fused->release = pure_release;
+    return NULL;
+}
+
+const char* plugin_instance_place_work(plugin_instance_t* instance, const char* str) { // place a copy in the queue
     if (!str) {
         return "Cannot place NULL work item";
     }
 
-    if (!g_plugin_context.initialized || !g_plugin_context.queue) { // check if plugin is initialized
+    if (!instance || !instance->initialized || !instance->queue) { // check if instance is initialized
         return "Plugin not initialized";
     }
-    
-    return consumer_producer_put(g_plugin_context.queue, str);
+
+    if (strcmp(str, "<END>") == 0) { // the string interface's end marker becomes an end of stream message
+        return consumer_producer_put_control(instance->queue, PLUGIN_ITEM_END);
+    }
+    return consumer_producer_put(instance->queue, str);
 }
 
-void plugin_attach(const char* (*next_place_work)(const char*)) { // attach next plugin
-    g_plugin_context.next_place_work = next_place_work;
+const char* plugin_instance_place_work_buffers(plugin_instance_t* instance, plugin_buffer_t* items, int count) { // adopt several work items
+    if (!items || count < 0) {
+        return "Cannot place NULL work batch";
+    }
+
+    if (!instance || !instance->initialized || !instance->queue) { // check if instance is initialized
+        for (int i = 0; i < count; i++) {
+            item_pool_free(instance ? instance->pool : NULL, items[i].ptr);
+        }
+        return "Plugin not initialized";
+    }
+
+    return consumer_producer_put_buffers_owned(instance->queue, items, count);
 }
 
-const char* plugin_wait_finished(void) { // wait for plugin to finish
-    if (!g_plugin_context.initialized || !g_plugin_context.queue) {
+void plugin_instance_attach(plugin_instance_t* instance, plugin_instance_t* next_instance,
+                            plugin_instance_place_work_buffers_func_t next_place_work_buffers) { // attach next instance
+    if (!instance) {
+        return;
+    }
+    instance->next_instance = next_instance;
+    instance->next_place_work_buffers = next_place_work_buffers;
+}
+
+const char* plugin_instance_wait_finished(plugin_instance_t* instance) { // wait for an instance to finish
+    if (!instance || !instance->initialized || !instance->queue) {
         return "Plugin not initialized";
     }
     
     // wait for the finished signal
-    if (consumer_producer_wait_finished(g_plugin_context.queue) != 0) {
+    if (consumer_producer_wait_finished(instance->queue) != 0) {
         return "Failed to wait for plugin to finish";
     }
 
     return NULL; // success
 }
 
-const char* plugin_fini(void) { // finalize the plugin
-    if (!g_plugin_context.initialized) {
+const char* plugin_instance_wait_finished_timed(plugin_instance_t* instance, long timeout_ms, int* queued) { // wait, bounded
+    if (!instance || !instance->initialized || !instance->queue) {
+        return "Plugin not initialized";
+    }
+
+    int result = consumer_producer_wait_finished_timed(instance->queue, timeout_ms);
+    if (queued) {
+        *queued = consumer_producer_count(instance->queue); // what the stage has not taken yet
+    }
+    if (result != 0) {
+        return "Timed out waiting for plugin to finish";
+    }
+    return NULL; // success
+}
+
+const char* plugin_instance_fini(plugin_instance_t* instance) { // finalize an instance
+    if (!instance || !instance->initialized) {
         return "Plugin not initialized";
     }
     
-    // wait for the consumer thread to finish
-    void* thread_result;
-    int join_result = pthread_join(g_plugin_context.consumer_thread, &thread_result);
-    if (join_result != 0) {
-        log_error(&g_plugin_context, "Failed to join consumer thread");
+    if (instance->scheduler) { // a task run may still be returning from the end of stream
+        if (consumer_producer_wait_finished(instance->queue) != 0) {
+            log_error(instance, "Failed to wait for plugin to finish");
+        }
+        while (atomic_load(&instance->active) > 0) {
+            sched_yield();
+        }
+    }
+    if (instance->runner && coroutine_join(&instance->coroutine) != 0) { // returns once the end of stream went through
+        log_error(instance, "Failed to join the stage coroutine");
+    }
+
+    // wait for the consumer threads to finish
+    for (int i = 0; i < instance->num_workers && !instance->scheduler && !instance->runner; i++) {
+        void* thread_result;
+        int join_result = pthread_join(instance->consumer_threads[i], &thread_result);
+        if (join_result != 0) {
+            log_error(instance, "Failed to join consumer thread");
+        }
     }
+    pthread_cond_destroy(&instance->order_cond);
+    pthread_mutex_destroy(&instance->order_mutex);
+    pthread_mutex_destroy(&instance->dispatch_mutex);
     
     // clean up the queue
-    if (g_plugin_context.queue) {
-        consumer_producer_destroy(g_plugin_context.queue);
-        free(g_plugin_context.queue);
-        g_plugin_context.queue = NULL;
+    if (instance->queue) {
+        consumer_producer_destroy(instance->queue);
+        free(instance->queue);
+        instance->queue = NULL;
     }
     
-    // reset the context
-    memset(&g_plugin_context, 0, sizeof(plugin_context_t));
-
+    free(instance->fused); // the fused transforms' state belongs to the host
+    free_state(instance->ops, instance->state);
+    free(instance); // the pool belongs to the host
     return NULL; // success
 }
+
+const char* plugin_place_work(const char* str) { // place work item in the queue
+    return plugin_instance_place_work(g_default_instance, str);
+}
+
+void plugin_attach(const char* (*next_place_work)(const char*)) { // attach next plugin
+    if (g_default_instance) {
+        g_default_instance->next_place_work = next_place_work;
+    }
+}
+
+const char* plugin_wait_finished(void) { // wait for plugin to finish
+    return plugin_instance_wait_finished(g_default_instance);
+}
+
+const char* plugin_fini(void) { // finalize the plugin
+    const char* result = plugin_instance_fini(g_default_instance);
+    if (result == NULL) {
+        g_default_instance = NULL; // reset the implicit instance
+    }
+    return result;
+}
@@ -4,24 +4,107 @@
 #include <pthread.h>
 #include "plugin_sdk.h"
 #include "sync/consumer_producer.h"
+#include "sync/affinity.h"
+#include "sync/coroutine.h"
+#include "sync/item_pool.h"
+#include "sync/output_sink.h"
+#include "sync/scheduler.h"
 
 /**
  * Common SDK structures and functions for plugin implementation
  */
 
-typedef struct { // Plugin context structure
+#define PLUGIN_BATCH_SIZE 64 // maximum items drained from the queue per consumer iteration
+#define PLUGIN_MAX_WORKERS 64 // maximum consumer threads per plugin
+#define PLUGIN_STAGE_BATCHES 4 // batches a stage processes per scheduler task run (or coroutine turn) before giving the others a turn
+
+/**
+ * Buffer transform (SDK v2)
+ * Reads input (length aware, may contain NUL bytes) and fills output with a buffer
+ * obtained from plugin_buffer_alloc, NUL terminated at ptr[len]. The input is freed by
+ * the framework. On failure nothing may be left allocated
+ * @param state The instance's state, as returned by the plugin's parse_args (NULL without one)
+ * @return 0 on success, -1 on failure
+ */
+typedef int (*plugin_buffer_process_func_t)(const plugin_buffer_t* input, plugin_buffer_t* output, void* state);
+
+/**
+ * In-place buffer transform (SDK v2, optional)
+ * For transforms that never change the length: rewrites the item's bytes directly, so
+ * the framework skips the output allocation and the copy. When a plugin registers one,
+ * the framework uses it for every item and keeps the allocating transform for callers
+ * that do not own the input
+ * @return 0 on success, -1 on failure
+ */
+typedef int (*plugin_buffer_inplace_func_t)(plugin_buffer_t* item, void* state);
+
+/**
+ * View transform (SDK v2, optional)
+ * For transforms that only reorder bytes: the item may arrive with a pending view, and
+ * the transform records its move with plugin_view_reverse/plugin_view_rotate instead of
+ * touching the bytes. Has the signature of plugin_buffer_inplace_func_t, and returns
+ * PLUGIN_VIEW_DECLINED without changing the item when the move cannot be expressed as a
+ * view (the framework then materializes the item and runs the other transforms)
+ */
+#define PLUGIN_VIEW_DECLINED 1
+
+/**
+ * Argument parser (optional)
+ * Turns the plugin argument given on the command line into the state handed to every
+ * transform call. Called once per instance (and once per fused copy), before any item
+ * @param args The argument, NULL when none was given
+ * @param state Receives the state
+ * @return NULL on success, error message on failure
+ */
+typedef const char* (*plugin_parse_args_func_t)(const char* args, void** state);
+
+typedef struct { // Everything the framework needs to run an SDK v2 plugin
     const char* name;                                    // Plugin name (for diagnosis)
+    plugin_buffer_process_func_t process;                // Buffer transform
+    plugin_buffer_inplace_func_t process_inplace;        // In-place variant of process, NULL if the transform changes the length
+    plugin_buffer_inplace_func_t process_view;           // View variant of process, NULL unless the transform only reorders
+    plugin_parse_args_func_t parse_args;                 // NULL if the plugin takes no argument, state is then NULL
+    void (*free_state)(void* state);                     // Releases what parse_args returned, NULL if nothing to release
+    int (*flush)(void* state);                           // Writes out held output at a flush message and at the end of stream, NULL if none
+} plugin_ops_t;
+
+typedef struct plugin_instance { // Plugin context structure, one per instance
+    const char* name;                                    // Plugin name (for diagnosis)
+    item_pool_t* pool;                                   // Item allocator shared by the pipeline (NULL for malloc)
     consumer_producer_t* queue;                          // Input queue
-    pthread_t consumer_thread;                           // Consumer thread
-    const char* (*next_place_work)(const char*);        // Next plugin's place_work function
-    const char* (*process_function)(const char*);       // Plugin-specific processing function
+    pthread_t consumer_threads[PLUGIN_MAX_WORKERS];      // Consumer threads
+    int num_workers;                                     // Number of consumer threads
+    int batch_limit;                                     // Items one worker takes from the queue at a time
+    pthread_mutex_t dispatch_mutex;                      // Serializes workers at the queue (keeps it single-consumer)
+    unsigned long next_ticket;                           // Sequence number of the next batch taken from the queue
+    int end_seen;                                        // The end of stream message was taken from the queue
+    pthread_mutex_t order_mutex;                         // Protects next_commit
+    pthread_cond_t order_cond;                           // Signaled when next_commit advances
+    unsigned long next_commit;                           // Sequence number of the next batch allowed downstream
+    const char* (*next_place_work)(const char*);        // Next plugin's place_work function (single instance interface)
+    plugin_instance_t* next_instance;                    // Next instance in the chain (instance interface)
+    plugin_instance_place_work_buffers_func_t next_place_work_buffers; // Next instance's buffer entry
+    const char* (*process_function)(const char*);       // Plugin-specific processing function (SDK v1, run through a shim)
+    const plugin_ops_t* ops;                             // Plugin-specific buffer transforms (SDK v2)
+    void* state;                                         // The instance's argument, parsed by ops->parse_args
+    plugin_fused_t* fused;                               // Transforms of fused downstream plugins, run in order
+    int fused_count;                                     // Number of fused transforms
+    scheduler_t* scheduler;                              // Shared worker threads running the stage, NULL for consumer threads
+    scheduler_task_t task;                               // The stage's scheduler task, processes what is queued
+    atomic_int scheduled;                                // The task is queued or running, cleared when it runs out of work
+    atomic_int active;                                   // Task runs in progress, the instance is released once none are
+    coroutine_runner_t* runner;                          // Thread running the stage as a coroutine, NULL otherwise
+    coroutine_t coroutine;                               // The stage's consumer loop on the runner
     int initialized;                                     // Initialization flag
     int finished;                                        // Finished processing flag
 } plugin_context_t;
 
 /**
  * Generic consumer thread function
- * This function runs in a separate thread and processes items from the queue
+ * This function runs in a separate thread and processes items from the queue.
+ * A plugin may run several of these: each takes a numbered batch from the queue,
+ * processes it in parallel with the others, and waits for its turn before handing
+ * the results downstream, so the output keeps the input order
  * @param arg Pointer to plugin_context_t
  * @return NULL
  */
@@ -41,6 +124,113 @@ void log_error(plugin_context_t* context, const char* message);
  */
 void log_info(plugin_context_t* context, const char* message);
 
+/**
+ * Allocate a work item buffer from the pipeline's pool (malloc if no pool was set)
+ * Transform functions should allocate their output with this, it uses the pool of the
+ * instance whose consumer thread is calling
+ * @param size Number of bytes needed
+ * @return Pointer to the buffer, NULL on failure
+ */
+void* plugin_alloc(size_t size);
+
+/**
+ * Copy a string into a buffer from the pipeline's pool
+ * @param str String to copy
+ * @return The copy, NULL on failure
+ */
+char* plugin_strdup(const char* str);
+
+/**
+ * Allocate an empty work item buffer for a transform's output
+ * @param buffer Receives the buffer, ptr[0] is '\0' and len is 0
+ * @param capacity Bytes to allocate, including room for the terminating NUL
+ * @return 0 on success, -1 on failure
+ */
+int plugin_buffer_alloc(plugin_buffer_t* buffer, size_t capacity);
+
+/**
+ * Write one record to stdout through the pipeline's output sink
+ * The pieces come out together and in call order with every other plugin's output. The
+ * sink buffers them and writes on size, after a few milliseconds or on plugin_output_flush.
+ * Without a sink (single instance interface) they go through stdio and are flushed at once
+ * @param iov Pieces of the record, in order
+ * @param count Number of pieces, at most OUTPUT_SINK_MAX_IOV
+ * @return 0 on success, -1 on failure
+ */
+int plugin_output_write(const struct iovec* iov, int count);
+
+/**
+ * Reserve the place of a record in the output, to be written piece by piece later
+ * Everything written after the reservation, by any plugin, comes out after the record, so
+ * no other output lands in the middle of it. The record ends with plugin_output_commit.
+ * @return The reservation, NULL without an output sink or on failure (the pieces are then
+ *         written at once, as plugin_output_write does)
+ */
+output_reservation_t* plugin_output_reserve(void);
+
+/**
+ * Append pieces to a reserved record, held back while an earlier record is still open
+ * @param reservation What plugin_output_reserve returned
+ * @param iov Pieces to write, in order
+ * @param count Number of pieces, at most OUTPUT_SINK_MAX_IOV
+ * @return 0 on success, -1 on failure
+ */
+int plugin_output_write_reserved(output_reservation_t* reservation, const struct iovec* iov, int count);
+
+/**
+ * Complete a reserved record, the output held back behind it follows
+ * @param reservation What plugin_output_reserve returned, invalid afterwards
+ * @return 0 on success, -1 on failure
+ */
+int plugin_output_commit(output_reservation_t* reservation);
+
+/**
+ * Get the pipeline's output framing
+ * @return FRAMING_LENPREFIX when records are written as length-prefixed frames, FRAMING_LINES otherwise
+ */
+framing_t plugin_output_framing(void);
+
+/**
+ * Write one record as a length-prefixed frame (see sync/framing.h), for output in FRAMING_LENPREFIX
+ * @param data Record payload, written as is
+ * @param len Payload length
+ * @return 0 on success, -1 on failure (or without an output sink)
+ */
+int plugin_output_write_frame(const char* data, size_t len);
+
+/**
+ * Write out everything the output sink holds, for output that must be seen now
+ * @return 0 on success, -1 on failure
+ */
+int plugin_output_flush(void);
+
+/**
+ * Reverse an item by updating its view, O(1)
+ * @param item The item, its bytes are not touched
+ */
+void plugin_view_reverse(plugin_buffer_t* item);
+
+/**
+ * Rotate an item right by updating its view, O(1)
+ * @param item The item, its bytes are not touched
+ * @param shift Positions every byte moves to the right (the last ones wrap to the front)
+ */
+void plugin_view_rotate(plugin_buffer_t* item, size_t shift);
+
+/**
+ * Write an item's pending view out so ptr holds its bytes in order (view becomes the identity)
+ * Done in place, a reversal as two reversed runs and a rotation as three reversals
+ * @param item The item, owned by the caller
+ * @return 0 on success, -1 on failure
+ */
+int plugin_view_materialize(plugin_buffer_t* item);
+
+/**
+ * Release a buffer obtained from plugin_alloc/plugin_strdup (or received from the queue)
+ * @param ptr Buffer to release, NULL is ignored
+ */
+void plugin_free(void* ptr);
+
 /**
  * Get the plugin's name
  * @return The plugin's name (should not be modified or freed)
@@ -50,7 +240,10 @@ const char* plugin_get_name(void);
 
 /**
  * Initialize the common plugin infrastructure with the specified queue size
- * @param process_function Plugin-specific processing function
+ * Creates the plugin's implicit instance used by the single instance interface
+ * @param process_function Plugin-specific processing function (SDK v1), must return a string allocated with
+ *                         plugin_alloc which the framework then moves downstream and frees at the sink.
+ *                         Its result is measured with strlen, so it cannot produce NUL bytes
  * @param name Plugin name
  * @param queue_size Maximum number of items that can be queued
  * @return NULL on success, error message on failure
@@ -58,6 +251,46 @@ const char* plugin_get_name(void);
 const char* common_plugin_init(const char* (*process_function)(const char*), 
                                const char* name, int queue_size);
 
+/**
+ * Initialize the common plugin infrastructure for a buffer transform (SDK v2)
+ * @param ops Plugin-specific transforms, must outlive the plugin
+ * @param queue_size Maximum number of items that can be queued
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_init_v2(const plugin_ops_t* ops, int queue_size);
+
+/**
+ * Create an independent plugin instance with its own queue and consumer threads
+ * @param process_function Plugin-specific processing function (see common_plugin_init)
+ * @param name Plugin name
+ * @param config Instance configuration
+ * @param instance Receives the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init(const char* (*process_function)(const char*), const char* name,
+                                        const plugin_config_t* config, plugin_instance_t** instance);
+
+/**
+ * Create an independent plugin instance for a buffer transform (SDK v2)
+ * config->args goes through ops->parse_args, a plugin without one rejects any argument
+ * @param ops Plugin-specific transforms, must outlive the instance
+ * @param config Instance configuration
+ * @param instance Receives the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_v2(const plugin_ops_t* ops, const plugin_config_t* config, plugin_instance_t** instance);
+
+/**
+ * Hand a plugin's transforms to a host that fuses it into another plugin's worker
+ * Allocations made by the transform (plugin_alloc/plugin_buffer_alloc) go to the host's
+ * alloc for the duration of each call
+ * @param ops Plugin-specific transforms
+ * @param args Plugin argument, parsed with ops->parse_args
+ * @param fused Receives the transforms, their state and its release function
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_get_pure(const plugin_ops_t* ops, const char* args, plugin_fused_t* fused);
+
 /**
  * Initialize the plugin with the specified queue size - calls common_plugin_init
  * This function should be implemented by each plugin
@@ -67,6 +300,16 @@ const char* common_plugin_init(const char* (*process_function)(const char*),
 __attribute__((visibility("default")))
 const char* plugin_init(int queue_size);
 
+/**
+ * Create a new instance of the plugin - calls common_plugin_instance_init
+ * This function should be implemented by each plugin
+ * @param config Instance configuration
+ * @param instance Receives the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance);
+
 /**
  * Finalize the plugin - drain queue and terminate thread gracefully (i.e. pthread_join)
  * @return NULL on success, error message on failure
@@ -97,4 +340,72 @@ void plugin_attach(const char* (*next_place_work)(const char*));
 __attribute__((visibility("default")))
 const char* plugin_wait_finished(void);
 
-#endif // PLUGIN_COMMON_H
\ No newline at end of file
+/**
+ * Finalize an instance - drain queue, join its threads and free it
+ * @param instance Instance handle
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_fini(plugin_instance_t* instance);
+
+/**
+ * Place a copy of a string into an instance's queue
+ * @param instance Instance handle
+ * @param str The string to process
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work(plugin_instance_t* instance, const char* str);
+
+/**
+ * Place buffers into an instance's queue, the queue adopts them instead of copying
+ * @param instance Instance handle
+ * @param items Array of buffers, owned by the plugin after the call (even on failure)
+ * @param count Number of buffers in items
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_buffers(plugin_instance_t* instance, plugin_buffer_t* items, int count);
+
+/**
+ * Attach an instance to the next instance in the chain
+ * Processed items are then moved downstream instead of copied
+ * @param instance Instance handle
+ * @param next_instance Next instance in the chain
+ * @param next_place_work_buffers The next instance's plugin_instance_place_work_buffers function
+ */
+__attribute__((visibility("default")))
+void plugin_instance_attach(plugin_instance_t* instance, plugin_instance_t* next_instance,
+                            plugin_instance_place_work_buffers_func_t next_place_work_buffers);
+
+/**
+ * Wait until an instance has finished processing all work
+ * @param instance Instance handle
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_wait_finished(plugin_instance_t* instance);
+
+/**
+ * Get the plugin's pure transforms - calls common_plugin_get_pure
+ * Implemented only by plugins whose transform is pure (no side effects, never blocks)
+ * @param args Plugin argument (NULL if none)
+ * @param fused Receives the transforms
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_get_pure(const char* args, plugin_fused_t* fused);
+
+/**
+ * Merge the arguments of two consecutive instances of the plugin into one (optional)
+ * Implemented only by plugins where running twice equals running once with other arguments
+ * @param args Argument of the first instance (NULL if none)
+ * @param next_args Argument of the instance right after it (NULL if none)
+ * @param merged Receives the argument of the single instance replacing both
+ * @param size Bytes available at merged
+ * @return NULL on success, error message if the two cannot be merged
+ */
+__attribute__((visibility("default")))
+const char* plugin_merge_args(const char* args, const char* next_args, char* merged, size_t size);
+
+#endif // PLUGIN_COMMON_H
@@ -1,11 +1,93 @@
 #ifndef PLUGIN_SDK_H
 #define PLUGIN_SDK_H
 
+#include <stddef.h>
+
 /**
  * Plugin SDK Interface, defines the contract between the main application and plugins
  * This interface allows for dynamic loading and communication with plugins.
  */
 
+struct item_pool; // shared work item allocator, see sync/item_pool.h
+struct output_sink; // shared buffered stdout writer, see sync/output_sink.h
+struct scheduler; // shared worker threads, see sync/scheduler.h
+struct coroutine_runner; // single thread running stages as coroutines, see sync/coroutine.h
+typedef struct plugin_instance plugin_instance_t; // opaque handle of one plugin instance
+
+/**
+ * Pending reorder of a work item (SDK v2 views)
+ * Stages that only move bytes around (reverse, rotate) record the move here instead of
+ * rewriting the item: logical byte i of the item is ptr[(start + i) % len], or
+ * ptr[(start - i) % len] when reversed. Moves compose in O(1), two reversals cancel and
+ * rotations add up, and the bytes are written out once, by the first stage that reads
+ * them. All zero is the identity, the view of every item a host creates
+ */
+typedef struct {
+    size_t start;                    // index in ptr of the item's first byte
+    int reversed;                    // the item's bytes run backwards through ptr
+} plugin_view_t;
+
+/**
+ * Kind of a queue entry (SDK v2)
+ * Control messages travel through the same queues as the data, in order with it, but
+ * never reach a transform. They carry no bytes: ptr is NULL and len is 0
+ */
+typedef enum {
+    PLUGIN_ITEM_DATA = 0,            // bytes to transform, the kind of every item a host creates
+    PLUGIN_ITEM_END = 1,             // end of stream, the stage flushes, passes it on and finishes
+    PLUGIN_ITEM_FLUSH = 2,           // the stage writes out what it holds (plugin_ops_t flush) and passes it on
+    PLUGIN_ITEM_CHECKPOINT = 3       // marker passed on in order, a stage has seen everything before it
+} plugin_item_kind_t;
+
+/**
+ * Work item buffer (SDK v2)
+ * The length travels with the bytes, so stages never rescan an item and an item may
+ * contain NUL bytes. ptr[len] is always '\0' so the bytes can also be used as a C string
+ * once the view is the identity (it always is for items leaving the pipeline).
+ * Any byte sequence is data, "<END>" included: the end of the stream is a
+ * PLUGIN_ITEM_END entry
+ */
+typedef struct {
+    char* ptr;                       // item bytes, NULL for a control message
+    size_t len;                      // bytes in use, not counting the terminating NUL
+    size_t capacity;                 // bytes allocated at ptr, at least len + 1
+    plugin_view_t view;              // pending reorder of the bytes, see plugin_view_t
+    plugin_item_kind_t kind;         // data or control message, see plugin_item_kind_t
+} plugin_buffer_t;
+
+typedef void* (*plugin_alloc_func_t)(size_t size); // allocator for work item buffers
+typedef int (*plugin_process_pure_func_t)(const plugin_buffer_t* input, plugin_buffer_t* output,
+                                          plugin_alloc_func_t alloc, void* state); // run a pure transform
+typedef int (*plugin_process_pure_inplace_func_t)(plugin_buffer_t* item, void* state); // run a pure transform in place
+
+/**
+ * A pure plugin fused into another plugin's worker
+ */
+typedef struct {
+    plugin_process_pure_func_t process;                 // allocating transform
+    plugin_process_pure_inplace_func_t process_inplace; // in place transform, preferred when not NULL
+    plugin_process_pure_inplace_func_t process_view;    // composes into the item's view, preferred over both
+    void* state;                                        // plugin private, passed to process and process_inplace
+    void (*release)(void* state);                       // called by the host once the transforms are no longer used
+} plugin_fused_t;
+
+/**
+ * Configuration of a plugin instance
+ */
+typedef struct {
+    int queue_size;                  // maximum number of items in the instance's queue
+    int workers;                     // threads processing the queue, output order is preserved (0 means 1)
+    struct item_pool* pool;          // pipeline wide item allocator, NULL for malloc
+    const plugin_fused_t* fused;     // pure transforms of the following plugins, run after this one's (may be NULL)
+    int fused_count;                 // number of entries in fused
+    const char* args;                // plugin argument from the command line (plugin=args), NULL if none
+    struct output_sink* output;      // pipeline wide stdout writer, NULL to write through stdio
+    struct scheduler* scheduler;     // pipeline wide worker threads that run the stage (workers is then ignored), NULL for threads of its own
+    const int* cpus;                 // CPU of each of the stage's threads (thread i runs on cpus[i % cpu_count]), NULL to leave them unpinned
+    int cpu_count;                   // number of entries in cpus
+    struct coroutine_runner* coroutines; // pipeline wide thread that runs the stage as a coroutine (workers is then ignored), NULL otherwise
+} plugin_config_t;
+
 // Function pointer types for plugin interface
 typedef const char* (*plugin_init_func_t)(int queue_size); // initialize the plugin
 typedef const char* (*plugin_fini_func_t)(void); // finalize the plugin
@@ -14,6 +96,20 @@ typedef void (*plugin_attach_func_t)(const char* (*next_place_work)(const char*)
 typedef const char* (*plugin_wait_finished_func_t)(void); // wait for plugin to finish
 typedef const char* (*plugin_get_name_func_t)(void); // get the plugin's name
 
+// Function pointer types for the instance interface
+typedef const char* (*plugin_instance_init_func_t)(const plugin_config_t* config, plugin_instance_t** instance); // create an instance
+typedef const char* (*plugin_instance_fini_func_t)(plugin_instance_t* instance); // finalize an instance
+typedef const char* (*plugin_instance_place_work_func_t)(plugin_instance_t* instance, const char* str); // place a copy of str
+typedef const char* (*plugin_instance_place_work_buffers_func_t)(plugin_instance_t* instance, plugin_buffer_t* items, int count); // hand buffers over
+typedef void (*plugin_instance_attach_func_t)(plugin_instance_t* instance, plugin_instance_t* next_instance,
+                                              plugin_instance_place_work_buffers_func_t next_place_work_buffers); // attach next instance
+typedef const char* (*plugin_instance_wait_finished_func_t)(plugin_instance_t* instance); // wait for an instance to finish
+typedef const char* (*plugin_instance_wait_finished_timed_func_t)(plugin_instance_t* instance, long timeout_ms,
+                                                                  int* queued); // wait a bounded time
+typedef const char* (*plugin_get_pure_func_t)(const char* args, plugin_fused_t* fused); // get a plugin's pure transforms
+typedef const char* (*plugin_merge_args_func_t)(const char* args, const char* next_args,
+                                                char* merged, size_t size); // merge two consecutive instances
+
 /**
  * Get the plugin's name
  * @return The plugin's name (should not be modified or freed)
@@ -35,6 +131,7 @@ const char* plugin_fini(void);
 
 /**
  * Place work (a string) into the plugin's queue
+ * The string "<END>" ends the stream
  * @param str The string to process (plugin takes ownership if it allocates new memory)
  * @return NULL on success, error message on failure
  */
@@ -53,4 +150,110 @@ void plugin_attach(const char* (*next_place_work)(const char*));
  */
 const char* plugin_wait_finished(void);
 
-#endif // PLUGIN_SDK_H
\ No newline at end of file
+/*
+ * Instance interface (SDK v2, optional)
+ * The functions above (SDK v1) drive a single, implicit instance per loaded plugin and
+ * pass bare C strings. The instance interface creates any number of independent
+ * instances from one shared object, so a chain can contain the same plugin several
+ * times. Each instance has its own queue, threads and downstream link, and items move
+ * between instances as plugin_buffer_t descriptors.
+ */
+
+/**
+ * Create and start a new plugin instance
+ * @param config Instance configuration
+ * @param instance Receives the instance handle on success
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance);
+
+/**
+ * Finalize an instance - terminate its threads gracefully and release it
+ * @param instance Instance handle, invalid after the call
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_fini(plugin_instance_t* instance);
+
+/**
+ * Place a copy of a string into the instance's queue
+ * As with plugin_place_work, the string "<END>" ends the stream
+ * @param instance Instance handle
+ * @param str The string to process
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_place_work(plugin_instance_t* instance, const char* str);
+
+/**
+ * Place several work items into the instance's queue by transferring ownership (SDK v2)
+ * Buffers are adopted instead of copied and moved with as few queue synchronizations
+ * as possible. Lengths are taken from the descriptors, the bytes are never rescanned.
+ * Control messages (kind other than PLUGIN_ITEM_DATA) may be mixed in, the stream
+ * ends with a PLUGIN_ITEM_END entry
+ * @param instance Instance handle
+ * @param items Buffers allocated from the configured pool (or malloc), NUL terminated at ptr[len],
+ *              all owned by the plugin after the call even on failure
+ * @param count Number of buffers in items
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_place_work_buffers(plugin_instance_t* instance, plugin_buffer_t* items, int count);
+
+/**
+ * Attach an instance to the next instance in the chain
+ * Processed items are moved downstream a batch at a time without copying
+ * @param instance Instance handle
+ * @param next_instance Next instance in the chain
+ * @param next_place_work_buffers The next instance's plugin_instance_place_work_buffers function
+ */
+void plugin_instance_attach(plugin_instance_t* instance, plugin_instance_t* next_instance,
+                            plugin_instance_place_work_buffers_func_t next_place_work_buffers);
+
+/**
+ * Wait until the instance has finished processing all work and is ready to shutdown
+ * @param instance Instance handle
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_wait_finished(plugin_instance_t* instance);
+
+/**
+ * Wait at most timeout_ms milliseconds for the instance to finish (optional)
+ * Lets a host shut the pipeline down within a deadline and report what was left
+ * @param instance Instance handle
+ * @param timeout_ms Longest wait in milliseconds, 0 only checks
+ * @param queued Receives the number of items still waiting in the instance's queue (may be NULL)
+ * @return NULL once the instance has finished, error message on failure or when the time ran out
+ */
+const char* plugin_instance_wait_finished_timed(plugin_instance_t* instance, long timeout_ms, int* queued);
+
+/**
+ * Get the plugin's transforms for running directly on the calling thread (optional)
+ * Exporting this declares the plugin pure: the output depends only on the input and the
+ * plugin argument, and the transform neither blocks nor has side effects. A host may then
+ * fuse the plugin into the previous stage's worker instead of giving it a queue and
+ * threads of its own. process allocates its result with the alloc it is given;
+ * process_inplace is set only when the transform never changes the item's length, the
+ * host then rewrites the buffer it owns instead of allocating and copying a new one.
+ * process_view is set when the transform can be a reorder, it accepts an item with a
+ * pending view and only updates the view, or returns 1 and leaves the item alone when
+ * it cannot (the host then materializes the item and calls one of the others, which
+ * always expect the identity view)
+ * @param args Plugin argument, as in plugin_config_t (NULL if none)
+ * @param fused Receives the transforms and their state, the host calls fused->release (if set)
+ *              when done with them
+ * @return NULL on success, error message on failure (e.g. an invalid argument)
+ */
+const char* plugin_get_pure(const char* args, plugin_fused_t* fused);
+
+/**
+ * Merge two consecutive instances of the plugin into one (optional)
+ * Exported by plugins where running twice in a row equals running once with another
+ * argument, e.g. two rotations add up to one. A host may then create a single instance
+ * with the merged argument in place of both
+ * @param args Argument of the first instance (NULL if none)
+ * @param next_args Argument of the instance right after it (NULL if none)
+ * @param merged Receives the merged argument, NUL terminated
+ * @param size Bytes available at merged
+ * @return NULL on success, error message if the two cannot be merged (both then run)
+ */
+const char* plugin_merge_args(const char* args, const char* next_args, char* merged, size_t size);
+
+#endif // PLUGIN_SDK_H
@@ -1,27 +1,105 @@
-#include "plugin_common.h"
-#include <stdlib.h>
-#include <string.h>
-
-// Rotator plugin transformation function
-
-static const char* plugin_transform(const char* input) { // transform the input string
-    if (!input) return NULL;
-    size_t len = strlen(input);
-    char* out = (char*)malloc(len + 1);
-    if (!out) return NULL;
-    if (len == 0) {
-        out[0] = '\0';
-        return out;
-    }
-    // rotate right by 1, last char to front
-    out[0] = input[len - 1];
-    if (len > 1) {
-        memcpy(out + 1, input, len - 1);
-    }
-    out[len] = '\0';
-    return out;
-}
-
-const char* plugin_get_name(void) { return "rotator"; } // get plugin name
-
-const char* plugin_init(int queue_size) { return common_plugin_init(plugin_transform, "rotator", queue_size); } // initialize plugin
+#include "plugin_common.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rotator plugin argument: the shift, =N moves every character N places to the right
+// (the last ones wrap to the front), a negative N moves them to the left. Default 1
+
+typedef struct {
+    long shift;                      // positive rotates right, negative left
+} rotator_args_t;
+
+static const char* plugin_parse_args(const char* args, void** state) { // read the shift
+    long shift = 1;
+    if (args) {
+        char* endptr = NULL;
+        errno = 0;
+        shift = strtol(args, &endptr, 10);
+        if (endptr == args || *endptr != '\0' || errno == ERANGE) {
+            return "Invalid rotator shift (expected an integer)";
+        }
+    }
+    rotator_args_t* rotator = (rotator_args_t*)malloc(sizeof(rotator_args_t));
+    if (!rotator) {
+        return "Failed to allocate memory for rotator arguments";
+    }
+    rotator->shift = shift;
+    *state = rotator;
+    return NULL;
+}
+
+static size_t right_shift(const rotator_args_t* rotator, size_t len) { // the shift as a right rotation in [0, len)
+    size_t magnitude = rotator->shift < 0 ? (size_t)0 - (size_t)rotator->shift : (size_t)rotator->shift;
+    magnitude %= len;
+    return rotator->shift < 0 && magnitude ? len - magnitude : magnitude;
+}
+
+// Rotator plugin transformation function
+
+static int plugin_transform(const plugin_buffer_t* input, plugin_buffer_t* output, void* state) { // transform the input buffer
+    const rotator_args_t* rotator = (const rotator_args_t*)state;
+    if (!input || !output || !rotator) return -1;
+    size_t len = input->len;
+    if (plugin_buffer_alloc(output, len + 1) != 0) return -1;
+    char* out = output->ptr;
+    if (len > 0) {
+        // rotate right: the last shift characters move to the front
+        size_t shift = right_shift(rotator, len);
+        memcpy(out, input->ptr + len - shift, shift);
+        memcpy(out + shift, input->ptr, len - shift);
+    }
+    out[len] = '\0';
+    output->len = len;
+    return 0;
+}
+
+static int plugin_transform_inplace(plugin_buffer_t* item, void* state) { // rotate the owned buffer directly
+    const rotator_args_t* rotator = (const rotator_args_t*)state;
+    if (!item || !rotator) return -1;
+    if (item->len > 1) {
+        plugin_view_rotate(item, right_shift(rotator, item->len));
+        return plugin_view_materialize(item); // three reversals, no allocation
+    }
+    return 0;
+}
+
+static int plugin_transform_view(plugin_buffer_t* item, void* state) { // record the rotation, the bytes stay put
+    const rotator_args_t* rotator = (const rotator_args_t*)state;
+    if (!item || !rotator) return -1;
+    if (item->len > 1) {
+        plugin_view_rotate(item, right_shift(rotator, item->len));
+    }
+    return 0;
+}
+
+const char* plugin_merge_args(const char* args, const char* next_args, char* merged, size_t size) { // consecutive rotators become one rotation
+    long shifts[2] = { 1, 1 };
+    const char* texts[2] = { args, next_args };
+    for (int i = 0; i < 2; i++) {
+        void* state = NULL;
+        const char* err = plugin_parse_args(texts[i], &state);
+        if (err != NULL) {
+            return err;
+        }
+        shifts[i] = ((rotator_args_t*)state)->shift;
+        free(state);
+    }
+    long total;
+    if (__builtin_add_overflow(shifts[0], shifts[1], &total)) {
+        return "Rotator shifts too large to merge";
+    }
+    int written = snprintf(merged, size, "%ld", total);
+    if (written < 0 || (size_t)written >= size) {
+        return "Rotator shift does not fit";
+    }
+    return NULL;
+}
+
+static const plugin_ops_t g_plugin_ops = { "rotator", plugin_transform, plugin_transform_inplace, plugin_transform_view, plugin_parse_args, free, NULL }; // transforms run by the framework
+
+const char* plugin_get_name(void) { return "rotator"; } // get plugin name
+const char* plugin_init(int queue_size) { return common_plugin_init_v2(&g_plugin_ops, queue_size); } // initialize plugin
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance) { return common_plugin_instance_init_v2(&g_plugin_ops, config, instance); } // create an instance
+const char* plugin_get_pure(const char* args, plugin_fused_t* fused) { return common_plugin_get_pure(&g_plugin_ops, args, fused); } // pure, may be fused
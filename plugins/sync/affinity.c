@@ -0,0 +1,229 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // sched_getaffinity() and the CPU_* macros
+#endif
+#include "affinity.h"
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct { // a CPU with its sort keys
+    affinity_cpu_t cpu;
+    int sibling;                     /* index among the hyperthreads of its core */
+    int core_rank;                   /* index of its core within its package */
+} ranked_cpu_t;
+
+static int read_number(const char* path, int fallback) { // first integer in a sysfs file
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return fallback;
+    }
+    int value;
+    if (fscanf(file, "%d", &value) != 1 || value < 0) {
+        value = fallback;
+    }
+    fclose(file);
+    return value;
+}
+
+static int read_node(int cpu) { // NUMA node, the cpuN/nodeM link
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    int node = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) {
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+static affinity_cpu_t describe(int cpu) { // where a CPU sits
+    char path[96];
+    affinity_cpu_t described = { cpu, read_node(cpu), 0, cpu };
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    described.package = read_number(path, 0);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+    described.core = read_number(path, cpu);
+    return described;
+}
+
+static int compare_compact(const void* a, const void* b) { // node, package, core, CPU
+    const affinity_cpu_t* x = &((const ranked_cpu_t*)a)->cpu;
+    const affinity_cpu_t* y = &((const ranked_cpu_t*)b)->cpu;
+    if (x->node != y->node) return x->node < y->node ? -1 : 1;
+    if (x->package != y->package) return x->package < y->package ? -1 : 1;
+    if (x->core != y->core) return x->core < y->core ? -1 : 1;
+    return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+static int compare_spread(const void* a, const void* b) { // first sibling of every core, the sockets in turn
+    const ranked_cpu_t* x = (const ranked_cpu_t*)a;
+    const ranked_cpu_t* y = (const ranked_cpu_t*)b;
+    if (x->sibling != y->sibling) return x->sibling < y->sibling ? -1 : 1;
+    if (x->core_rank != y->core_rank) return x->core_rank < y->core_rank ? -1 : 1;
+    return compare_compact(a, b);
+}
+
+static const char* parse_list(const char* spec, const cpu_set_t* allowed, int* cpus, int* count) { // "0,2,4-7"
+    *count = 0;
+    const char* p = spec;
+    while (*p) {
+        char* end = NULL;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) {
+            return "Invalid CPU list (expected compact, spread or CPUs such as 0,2,4-7)";
+        }
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return "Invalid CPU list (expected compact, spread or CPUs such as 0,2,4-7)";
+            }
+            p = end;
+        }
+        if (*p == ',' && p[1] != '\0') {
+            p++;
+        } else if (*p != '\0') {
+            return "Invalid CPU list (expected compact, spread or CPUs such as 0,2,4-7)";
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET((int)cpu, allowed)) {
+                return "CPU list names a CPU this process cannot run on";
+            }
+            if (*count == CPU_SETSIZE) {
+                return "CPU list is too long";
+            }
+            cpus[(*count)++] = (int)cpu;
+        }
+    }
+    return *count > 0 ? NULL : "Invalid CPU list (expected compact, spread or CPUs such as 0,2,4-7)";
+}
+
+const char* affinity_init(affinity_t* affinity, const char* spec) { // Read the topology and order the CPUs
+    if (!affinity || !spec) {
+        return "Invalid placement";
+    }
+    memset(affinity, 0, sizeof(*affinity));
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return "Failed to read the CPUs this process may run on";
+    }
+
+    int* numbers = (int*)malloc(sizeof(int) * CPU_SETSIZE);
+    if (!numbers) {
+        return "Failed to allocate memory for the placement";
+    }
+    int count = 0;
+    const char* error = NULL;
+    if (strcmp(spec, "compact") == 0 || strcmp(spec, "spread") == 0) {
+        affinity->policy = spec[0] == 'c' ? AFFINITY_COMPACT : AFFINITY_SPREAD;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                numbers[count++] = cpu;
+            }
+        }
+    } else {
+        affinity->policy = AFFINITY_LIST;
+        error = parse_list(spec, &allowed, numbers, &count);
+    }
+    affinity->cpus = error ? NULL : (affinity_cpu_t*)malloc(sizeof(affinity_cpu_t) * (size_t)count);
+    if (!error && !affinity->cpus) {
+        error = "Failed to allocate memory for the placement";
+    }
+    for (int i = 0; !error && i < count; i++) {
+        affinity->cpus[i] = describe(numbers[i]);
+    }
+    if (!error && affinity_order(affinity->cpus, count, affinity->policy) != 0) {
+        error = "Failed to allocate memory for the placement";
+    }
+    free(numbers);
+    if (error) {
+        free(affinity->cpus);
+        affinity->cpus = NULL;
+        return error;
+    }
+    affinity->count = count;
+    return NULL;
+}
+
+int affinity_order(affinity_cpu_t* cpus, int count, affinity_policy_t policy) { // Sort CPUs by policy
+    if (policy == AFFINITY_LIST || count <= 1) {
+        return 0;
+    }
+    ranked_cpu_t* ranked = (ranked_cpu_t*)calloc((size_t)count, sizeof(ranked_cpu_t));
+    if (!ranked) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        ranked[i].cpu = cpus[i];
+    }
+    qsort(ranked, (size_t)count, sizeof(ranked_cpu_t), compare_compact);
+    if (policy == AFFINITY_SPREAD) { // rank cores within their socket and siblings within their core
+        for (int i = 1; i < count; i++) {
+            const affinity_cpu_t* previous = &ranked[i - 1].cpu;
+            const affinity_cpu_t* current = &ranked[i].cpu;
+            if (current->node != previous->node || current->package != previous->package) {
+                continue; // first core of the next socket, ranks start over at 0
+            }
+            int same_core = current->core == previous->core;
+            ranked[i].core_rank = ranked[i - 1].core_rank + !same_core;
+            ranked[i].sibling = same_core ? ranked[i - 1].sibling + 1 : 0;
+        }
+        qsort(ranked, (size_t)count, sizeof(ranked_cpu_t), compare_spread);
+    }
+    for (int i = 0; i < count; i++) {
+        cpus[i] = ranked[i].cpu;
+    }
+    free(ranked);
+    return 0;
+}
+
+const affinity_cpu_t* affinity_slot(const affinity_t* affinity, int slot) { // CPU of a slot
+    if (!affinity || affinity->count == 0 || slot < 0) {
+        return NULL;
+    }
+    return &affinity->cpus[slot % affinity->count];
+}
+
+const char* affinity_policy_name(affinity_policy_t policy) { // name for the report
+    return policy == AFFINITY_COMPACT ? "compact" : policy == AFFINITY_SPREAD ? "spread" : "list";
+}
+
+int affinity_pin_thread(pthread_t thread, int cpu) { // Bind a thread to one CPU
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int affinity_run_on(int cpu, void (*fn)(void* arg), void* arg) { // Run fn bound to a CPU
+    cpu_set_t previous;
+    int moved = pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) == 0 &&
+                affinity_pin_thread(pthread_self(), cpu) == 0;
+    fn(arg);
+    if (moved) {
+        pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+    }
+    return moved ? 0 : -1;
+}
+
+void affinity_destroy(affinity_t* affinity) { // Release the CPU order
+    if (affinity) {
+        free(affinity->cpus);
+        affinity->cpus = NULL;
+        affinity->count = 0;
+    }
+}
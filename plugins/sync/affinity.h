@@ -0,0 +1,97 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <pthread.h>
+
+/**
+ * CPU placement of the pipeline's threads
+ * Orders the CPUs this process may run on by policy, and hands them out one slot at a
+ * time in pipeline order (the host numbers the stage threads from the first stage to the
+ * last), wrapping around when there are more threads than CPUs.
+ * COMPACT - by NUMA node, package and core: adjacent stages land on hyperthread siblings
+ *           and neighbouring cores that share a cache, one socket is filled before the next
+ * SPREAD  - one thread per core, the sockets in turn, siblings only after every core has a
+ *           thread: the most cache and memory bandwidth per stage
+ * LIST    - the CPUs given, in the order given (e.g. "0,2,8-11")
+ * The topology comes from /sys/devices/system/cpu, missing entries count as one node,
+ * one package and one core per CPU.
+ */
+
+typedef enum {
+    AFFINITY_COMPACT = 0,
+    AFFINITY_SPREAD = 1,
+    AFFINITY_LIST = 2
+} affinity_policy_t;
+
+typedef struct {
+    int cpu;                         /* CPU number as the kernel counts them */
+    int node;                        /* NUMA node */
+    int package;                     /* physical package (socket) */
+    int core;                        /* core id within the package */
+} affinity_cpu_t;
+
+typedef struct {
+    affinity_policy_t policy;
+    affinity_cpu_t* cpus;            /* CPUs in the order slots get them */
+    int count;
+} affinity_t;
+
+/**
+ * Read the topology and order the usable CPUs
+ * @param affinity Pointer to affinity structure
+ * @param spec "compact", "spread" or a CPU list such as "0,2,4-7"
+ * @return NULL on success, error message on failure
+ */
+const char* affinity_init(affinity_t* affinity, const char* spec);
+
+/**
+ * Sort CPUs into the order a policy hands them out (AFFINITY_LIST keeps the given order)
+ * @param cpus CPUs with their topology, sorted in place
+ * @param count Number of CPUs
+ * @param policy The policy
+ * @return 0 on success, -1 on failure
+ */
+int affinity_order(affinity_cpu_t* cpus, int count, affinity_policy_t policy);
+
+/**
+ * CPU of a slot
+ * @param affinity Initialized placement
+ * @param slot Thread number in pipeline order, from 0
+ * @return The slot's CPU, slots past the last CPU start over at the first
+ */
+const affinity_cpu_t* affinity_slot(const affinity_t* affinity, int slot);
+
+/**
+ * Name of a policy, for the placement report
+ * @param policy The policy
+ * @return "compact", "spread" or "list"
+ */
+const char* affinity_policy_name(affinity_policy_t policy);
+
+/**
+ * Bind a thread to one CPU
+ * @param thread Thread to move
+ * @param cpu CPU to run it on
+ * @return 0 on success, -1 on failure
+ */
+int affinity_pin_thread(pthread_t thread, int cpu);
+
+/**
+ * Run a function on the calling thread while it is bound to one CPU, then give the thread
+ * its previous CPUs back
+ * For memory that should live on the NUMA node of the thread that will use it: pages are
+ * placed where they are first written, so fn allocates and writes them from that CPU
+ * @param cpu CPU to run fn on
+ * @param fn Function to run (it runs even if the thread could not be moved)
+ * @param arg Argument of fn
+ * @return 0 if fn ran on cpu, -1 if it ran where the thread was
+ */
+int affinity_run_on(int cpu, void (*fn)(void* arg), void* arg);
+
+/**
+ * Release the CPU order
+ * @param affinity Placement to release
+ */
+void affinity_destroy(affinity_t* affinity);
+
+#endif // AFFINITY_H
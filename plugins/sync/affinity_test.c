@@ -0,0 +1,107 @@
+#define _GNU_SOURCE // sched_getcpu() and the CPU_* macros
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+#include "sync/affinity.h"
+
+// two sockets of two cores with two hyperthreads, numbered the way Linux does: every
+// core's first thread, then the siblings
+static const affinity_cpu_t two_sockets[8] = {
+    { 0, 0, 0, 0 }, { 1, 0, 0, 1 }, { 2, 1, 1, 0 }, { 3, 1, 1, 1 },
+    { 4, 0, 0, 0 }, { 5, 0, 0, 1 }, { 6, 1, 1, 0 }, { 7, 1, 1, 1 },
+};
+
+static void check_order(affinity_policy_t policy, const int* expected) { // sort the layout, compare CPU numbers
+    affinity_cpu_t cpus[8];
+    memcpy(cpus, two_sockets, sizeof(cpus));
+    assert(affinity_order(cpus, 8, policy) == 0);
+    for (int i = 0; i < 8; i++) {
+        assert(cpus[i].cpu == expected[i]);
+    }
+}
+
+void test_order() { // compact fills a core then a socket, spread takes every core first, sockets in turn
+    printf("\n=== Test 1: Policy Order ===\n");
+
+    const int compact[8] = { 0, 4, 1, 5, 2, 6, 3, 7 };
+    const int spread[8] = { 0, 2, 1, 3, 4, 6, 5, 7 };
+    const int list[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    check_order(AFFINITY_COMPACT, compact);
+    check_order(AFFINITY_SPREAD, spread);
+    check_order(AFFINITY_LIST, list);
+    printf("Policy order test passed\n");
+}
+
+void test_init() { // the usable CPUs, lists and their errors
+    printf("\n=== Test 2: Init ===\n");
+
+    cpu_set_t allowed;
+    assert(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    int first = 0;
+    while (!CPU_ISSET(first, &allowed)) {
+        first++;
+    }
+
+    affinity_t placement;
+    assert(affinity_init(&placement, "compact") == NULL);
+    assert(placement.policy == AFFINITY_COMPACT && placement.count == CPU_COUNT(&allowed));
+    assert(affinity_slot(&placement, placement.count)->cpu == affinity_slot(&placement, 0)->cpu); // wraps around
+    affinity_destroy(&placement);
+    assert(affinity_init(&placement, "spread") == NULL);
+    assert(placement.policy == AFFINITY_SPREAD && placement.count == CPU_COUNT(&allowed));
+    affinity_destroy(&placement);
+
+    char list[64];
+    snprintf(list, sizeof(list), "%d,%d-%d", first, first, first);
+    assert(affinity_init(&placement, list) == NULL);
+    assert(placement.policy == AFFINITY_LIST && placement.count == 2);
+    assert(affinity_slot(&placement, 1)->cpu == first);
+    assert(strcmp(affinity_policy_name(placement.policy), "list") == 0);
+    affinity_destroy(&placement);
+
+    assert(affinity_init(&placement, "") != NULL);
+    assert(affinity_init(&placement, "fast") != NULL);
+    assert(affinity_init(&placement, "0,") != NULL);
+    assert(affinity_init(&placement, "3-1") != NULL);
+    assert(affinity_init(&placement, "1000000") != NULL);
+    printf("Init test passed\n");
+}
+
+static void record_cpu(void* arg) {
+    *(int*)arg = sched_getcpu();
+}
+
+void test_run_on() { // the thread moves for the call and gets its CPUs back
+    printf("\n=== Test 3: Run On ===\n");
+
+    cpu_set_t before, after;
+    assert(pthread_getaffinity_np(pthread_self(), sizeof(before), &before) == 0);
+    int first = 0;
+    while (!CPU_ISSET(first, &before)) {
+        first++;
+    }
+    int ran_on = -1;
+    assert(affinity_run_on(first, record_cpu, &ran_on) == 0);
+    assert(ran_on == first);
+    assert(pthread_getaffinity_np(pthread_self(), sizeof(after), &after) == 0);
+    assert(CPU_EQUAL(&before, &after));
+
+    ran_on = -1;
+    assert(affinity_run_on(-1, record_cpu, &ran_on) == -1); // runs anyway, where it was
+    assert(ran_on >= 0);
+    printf("Run on test passed\n");
+}
+
+int main() { // main test runner
+    printf("Starting Affinity Unit Tests...\n");
+
+    test_order();
+    test_init();
+    test_run_on();
+
+    printf("\n All affinity tests passed!\n");
+    return 0;
+}
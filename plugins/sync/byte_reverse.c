@@ -0,0 +1,94 @@
+#include "byte_reverse.h"
+#include <stdint.h>
+#include <string.h>
+
+#if BYTE_REVERSE_X86
+#include <immintrin.h>
+#endif
+
+void byte_reverse_scalar(char* str, size_t len) { // Reverse, eight bytes from each end per step
+    size_t front = 0;
+    size_t back = len;
+    while (back - front >= 16) {
+        uint64_t head, tail;
+        memcpy(&head, str + front, 8);
+        memcpy(&tail, str + back - 8, 8);
+        head = __builtin_bswap64(head);
+        tail = __builtin_bswap64(tail);
+        memcpy(str + front, &tail, 8);
+        memcpy(str + back - 8, &head, 8);
+        front += 8;
+        back -= 8;
+    }
+    while (back - front >= 2) {
+        char c = str[front];
+        str[front++] = str[--back];
+        str[back] = c;
+    }
+}
+
+#if BYTE_REVERSE_X86
+__attribute__((target("ssse3")))
+void byte_reverse_ssse3(char* str, size_t len) { // Reverse, a 16 byte block from each end per step
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t front = 0;
+    size_t back = len;
+    while (back - front >= 32) {
+        __m128i head = _mm_loadu_si128((const __m128i*)(str + front));
+        __m128i tail = _mm_loadu_si128((const __m128i*)(str + back - 16));
+        _mm_storeu_si128((__m128i*)(str + front), _mm_shuffle_epi8(tail, reverse));
+        _mm_storeu_si128((__m128i*)(str + back - 16), _mm_shuffle_epi8(head, reverse));
+        front += 16;
+        back -= 16;
+    }
+    byte_reverse_scalar(str + front, back - front);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i reverse_block(__m256i v) { // reverse 32 bytes
+    const __m256i reverse = _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    v = _mm256_shuffle_epi8(v, reverse);         // reverse within each 128-bit lane
+    return _mm256_permute4x64_epi64(v, 0x4E);    // then swap the lanes
+}
+
+__attribute__((target("avx2")))
+void byte_reverse_avx2(char* str, size_t len) { // Reverse, a 32 byte block from each end per step
+    size_t front = 0;
+    size_t back = len;
+    while (back - front >= 64) {
+        __m256i head = _mm256_loadu_si256((const __m256i*)(str + front));
+        __m256i tail = _mm256_loadu_si256((const __m256i*)(str + back - 32));
+        _mm256_storeu_si256((__m256i*)(str + front), reverse_block(tail));
+        _mm256_storeu_si256((__m256i*)(str + back - 32), reverse_block(head));
+        front += 32;
+        back -= 32;
+    }
+    byte_reverse_scalar(str + front, back - front);
+}
+#endif
+
+static void (*g_byte_reverse)(char* str, size_t len) = byte_reverse_scalar;
+static const char* g_byte_reverse_name = "scalar";
+
+__attribute__((constructor))
+static void byte_reverse_select(void) { // pick the widest kernel the CPU supports, once at load time
+#if BYTE_REVERSE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_byte_reverse = byte_reverse_avx2;
+        g_byte_reverse_name = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        g_byte_reverse = byte_reverse_ssse3;
+        g_byte_reverse_name = "ssse3";
+    }
+#endif
+}
+
+void byte_reverse(char* str, size_t len) { // Reverse with the dispatched kernel
+    g_byte_reverse(str, len);
+}
+
+const char* byte_reverse_kernel_name(void) { // Kernel byte_reverse runs
+    return g_byte_reverse_name;
+}
@@ -0,0 +1,58 @@
+#ifndef BYTE_REVERSE_H
+#define BYTE_REVERSE_H
+
+#include <stddef.h>
+
+/**
+ * In-place byte reversal
+ * The scalar kernel swaps eight bytes from each end per step (bswap64). On x86 the SSSE3
+ * (pshufb) and AVX2 (vpshufb + vpermq) kernels load a 16 or 32 byte block from each end,
+ * reverse both and store them swapped, the middle left over goes through the scalar kernel.
+ * byte_reverse runs the widest kernel the CPU supports, picked once at load time. The
+ * flipper reverses items with it, and the framework writes out reversed and rotated views
+ * with it (see plugin_view_materialize).
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BYTE_REVERSE_X86 1
+#else
+#define BYTE_REVERSE_X86 0
+#endif
+
+/**
+ * Reverse bytes in place with the dispatched kernel
+ * @param str Bytes to reverse
+ * @param len Number of bytes
+ */
+void byte_reverse(char* str, size_t len);
+
+/**
+ * Get the kernel byte_reverse runs
+ * @return "scalar", "ssse3" or "avx2"
+ */
+const char* byte_reverse_kernel_name(void);
+
+/**
+ * Reverse bytes in place, eight bytes from each end per step
+ * @param str Bytes to reverse
+ * @param len Number of bytes
+ */
+void byte_reverse_scalar(char* str, size_t len);
+
+#if BYTE_REVERSE_X86
+/**
+ * Reverse bytes in place with SSSE3, only call when the CPU supports it
+ * @param str Bytes to reverse
+ * @param len Number of bytes
+ */
+void byte_reverse_ssse3(char* str, size_t len);
+
+/**
+ * Reverse bytes in place with AVX2, only call when the CPU supports it
+ * @param str Bytes to reverse
+ * @param len Number of bytes
+ */
+void byte_reverse_avx2(char* str, size_t len);
+#endif
+
+#endif // BYTE_REVERSE_H
@@ -1,15 +1,24 @@
 #include "consumer_producer.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 
 const char* consumer_producer_init(consumer_producer_t* queue, int capacity) { // Initialize the queue
+    return consumer_producer_init_mode(queue, capacity, CONSUMER_PRODUCER_DEFAULT_MODE);
+}
+
+const char* consumer_producer_init_mode(consumer_producer_t* queue, int capacity,
+                                        consumer_producer_mode_t mode) { // Initialize the queue with a backend
     if (!queue || capacity <= 0) {
         return "Invalid queue or capacity";
     }
+    if (mode != CONSUMER_PRODUCER_LOCKED && mode != CONSUMER_PRODUCER_SPSC) {
+        return "Invalid queue mode";
+    }
     
     // allocate memory for items array and initialize to NULLs
-    queue->items = (char**)calloc((size_t)capacity, sizeof(char*));
+    queue->items = (plugin_buffer_t*)calloc((size_t)capacity, sizeof(plugin_buffer_t));
     if (!queue->items) {
         return "Failed to allocate memory for queue items";
     }
@@ -19,6 +28,15 @@ const char* consumer_producer_init(consumer_producer_t* queue, int capacity) { /
     queue->count = 0;
     queue->head = 0;
     queue->tail = 0;
+    queue->mode = mode;
+    queue->pool = NULL;
+    queue->published = NULL;
+    queue->help = NULL;
+    queue->hook_arg = NULL;
+    atomic_init(&queue->spsc_head, 0);
+    atomic_init(&queue->spsc_tail, 0);
+    atomic_init(&queue->consumer_waiting, 0);
+    atomic_init(&queue->producer_waiting, 0);
     if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
         free(queue->items);
         return "Failed to initialize queue mutex";
@@ -54,6 +72,21 @@ const char* consumer_producer_init(consumer_producer_t* queue, int capacity) { /
     return NULL; // success
 }
 
+void consumer_producer_set_pool(consumer_producer_t* queue, item_pool_t* pool) { // choose the item allocator
+    if (queue) {
+        queue->pool = pool;
+    }
+}
+
+void consumer_producer_set_hooks(consumer_producer_t* queue, void (*published)(void* arg), int (*help)(void* arg),
+                                 void* arg) { // let a scheduler drive the consumer
+    if (queue) {
+        queue->published = published;
+        queue->help = help;
+        queue->hook_arg = arg;
+    }
+}
+
 void consumer_producer_destroy(consumer_producer_t* queue) { // destroy the queue
     if (!queue) {
         return;
@@ -63,9 +96,9 @@ void consumer_producer_destroy(consumer_producer_t* queue) { // destroy the queu
     if (queue->items) {
         // drain and free all items
         for (int i = 0; i < queue->capacity; i++) {
-            if (queue->items[i]) {
-                free(queue->items[i]);
-                queue->items[i] = NULL;
+            if (queue->items[i].ptr) {
+                item_pool_free(queue->pool, queue->items[i].ptr);
+                queue->items[i].ptr = NULL;
             }
         }
         free(queue->items);
@@ -83,25 +116,40 @@ void consumer_producer_destroy(consumer_producer_t* queue) { // destroy the queu
     queue->count = 0;
     queue->head = 0;
     queue->tail = 0;
+    atomic_store(&queue->spsc_head, 0);
+    atomic_store(&queue->spsc_tail, 0);
 }
 
-const char* consumer_producer_put(consumer_producer_t* queue, const char* item) { // put item into the queue
-    if (!queue || !item) {
-        return "Invalid queue or item";
+static int wait_not_full(consumer_producer_t* queue) { // full queue: help the consumer along, else sleep
+    if (queue->help) {
+        int helped = queue->help(queue->hook_arg);
+        if (helped > 0) {
+            return 0; // recheck at once
+        }
+        if (helped == 0) {
+            int result = monitor_wait_timed(&queue->not_full_monitor, 1);
+            return result == 0 || errno == ETIMEDOUT ? 0 : -1;
+        }
     }
-    while (1) { // loop until item is added
+    return monitor_wait(&queue->not_full_monitor);
+}
+
+/*
+ * Locked backend
+ * Moves as many items as fit under one acquisition of queue->mutex and wakes the other
+ * side once per call rather than once per item.
+ */
+static int locked_put_n(consumer_producer_t* queue, plugin_buffer_t* items, int count) { // store up to count items
+    int stored = 0;
+    while (stored < count) { // loop until every item is added
         pthread_mutex_lock(&queue->mutex);
         if (queue->count < queue->capacity) {
-            // create a copy of the string
-            char* item_copy = strdup(item);
-            if (!item_copy) {
-                pthread_mutex_unlock(&queue->mutex);
-                return "Failed to allocate memory for item copy";
+            // add as many items as there are free slots
+            while (stored < count && queue->count < queue->capacity) {
+                queue->items[queue->tail] = items[stored++];
+                queue->tail = (queue->tail + 1) % queue->capacity;
+                queue->count++;
             }
-            // add item to the queue
-            queue->items[queue->tail] = item_copy;
-            queue->tail = (queue->tail + 1) % queue->capacity;
-            queue->count++;
 
             // if queue is now full, reset the not_full monitor
             if (queue->count == queue->capacity) {
@@ -111,30 +159,33 @@ const char* consumer_producer_put(consumer_producer_t* queue, const char* item)
             // signal that queue is not empty
             monitor_signal(&queue->not_empty_monitor);
             pthread_mutex_unlock(&queue->mutex);
-            return NULL; // success
+            if (queue->published) {
+                queue->published(queue->hook_arg);
+            }
+            continue;
         }
         pthread_mutex_unlock(&queue->mutex);
 
         // wait until queue is not full
-        if (monitor_wait(&queue->not_full_monitor) != 0) {
-            return "Failed to wait for not_full condition";
+        if (wait_not_full(queue) != 0) {
+            break;
         }
         // loop and recheck
     }
+    return stored;
 }
 
-char* consumer_producer_get(consumer_producer_t* queue) { // get item from the queue
-    if (!queue) {
-        return NULL;
-    }
-    while (1) { // loop until item is retrieved
+static int locked_get_n(consumer_producer_t* queue, plugin_buffer_t* items, int max_items, int block) { // take up to max_items items
+    while (1) { // loop until at least one item is retrieved
         pthread_mutex_lock(&queue->mutex);
         if (queue->count > 0) {
-            // get item from the queue
-            char* item = queue->items[queue->head];
-            queue->items[queue->head] = NULL; // clear the slot
-            queue->head = (queue->head + 1) % queue->capacity;
-            queue->count--;
+            int taken = 0;
+            while (taken < max_items && queue->count > 0) {
+                items[taken++] = queue->items[queue->head];
+                queue->items[queue->head].ptr = NULL; // clear the slot
+                queue->head = (queue->head + 1) % queue->capacity;
+                queue->count--;
+            }
 
             // if queue is now empty, reset the not_empty monitor
             if (queue->count == 0) {
@@ -144,18 +195,309 @@ char* consumer_producer_get(consumer_producer_t* queue) { // get item from the q
             // signal that queue is not full
             monitor_signal(&queue->not_full_monitor);
             pthread_mutex_unlock(&queue->mutex);
-            return item;
+            return taken;
         }
         pthread_mutex_unlock(&queue->mutex);
+        if (!block) {
+            return 0;
+        }
 
         // wait until queue is not empty
         if (monitor_wait(&queue->not_empty_monitor) != 0) {
-            return NULL;
+            return -1;
         }
         // loop and recheck
     }
 }
 
+/*
+ * SPSC backend
+ * spsc_tail is only written by the producer and spsc_head only by the consumer, both
+ * grow monotonically and are reduced modulo capacity to index the ring. A side only
+ * touches a monitor when it has to park (ring empty/full) or when it sees that the
+ * other side announced it is parked. The waiting flag is raised before re-checking
+ * the ring and the peer publishes its index before checking the flag (both seq_cst),
+ * so at least one of them notices the other - and since monitors remember signals,
+ * a wakeup that lands before monitor_wait is not lost.
+ */
+static int spsc_put_n(consumer_producer_t* queue, plugin_buffer_t* items, int count) { // publish up to count items
+    size_t tail = atomic_load_explicit(&queue->spsc_tail, memory_order_relaxed);
+    size_t capacity = (size_t)queue->capacity;
+    int stored = 0;
+
+    while (stored < count) {
+        size_t used = tail - atomic_load_explicit(&queue->spsc_head, memory_order_acquire);
+        if (used >= capacity) {
+            // ring is full, announce we are parking and re-check before sleeping
+            monitor_reset(&queue->not_full_monitor);
+            atomic_store(&queue->producer_waiting, 1);
+            if (tail - atomic_load(&queue->spsc_head) < capacity) {
+                atomic_store(&queue->producer_waiting, 0);
+                continue;
+            }
+            int wait_result = wait_not_full(queue);
+            atomic_store(&queue->producer_waiting, 0);
+            if (wait_result != 0) {
+                break;
+            }
+            continue;
+        }
+
+        // fill every free slot, then publish them with a single store
+        while (stored < count && used < capacity) {
+            queue->items[tail % capacity] = items[stored++];
+            tail++;
+            used++;
+        }
+        atomic_store(&queue->spsc_tail, tail);
+
+        if (atomic_load(&queue->consumer_waiting)) { // wake the consumer only if it parked
+            monitor_signal(&queue->not_empty_monitor);
+        }
+        if (queue->published) {
+            queue->published(queue->hook_arg);
+        }
+    }
+    return stored;
+}
+
+static int spsc_get_n(consumer_producer_t* queue, plugin_buffer_t* items, int max_items, int block) { // take up to max_items items
+    size_t head = atomic_load_explicit(&queue->spsc_head, memory_order_relaxed);
+    size_t capacity = (size_t)queue->capacity;
+    size_t tail;
+
+    while ((tail = atomic_load_explicit(&queue->spsc_tail, memory_order_acquire)) == head) {
+        if (!block) {
+            return 0;
+        }
+        // ring is empty, announce we are parking and re-check before sleeping
+        monitor_reset(&queue->not_empty_monitor);
+        atomic_store(&queue->consumer_waiting, 1);
+        if (atomic_load(&queue->spsc_tail) != head) {
+            atomic_store(&queue->consumer_waiting, 0);
+            continue;
+        }
+        int wait_result = monitor_wait(&queue->not_empty_monitor);
+        atomic_store(&queue->consumer_waiting, 0);
+        if (wait_result != 0) {
+            return -1;
+        }
+    }
+
+    int taken = 0;
+    while (taken < max_items && head != tail) {
+        items[taken++] = queue->items[head % capacity];
+        queue->items[head % capacity].ptr = NULL; // clear the slot
+        head++;
+    }
+    atomic_store(&queue->spsc_head, head); // hand the slots back
+
+    if (atomic_load(&queue->producer_waiting)) { // wake the producer only if it parked
+        monitor_signal(&queue->not_full_monitor);
+    }
+    return taken;
+}
+
+static int queue_put_n(consumer_producer_t* queue, plugin_buffer_t* items, int count) { // dispatch to the backend
+    if (queue->mode == CONSUMER_PRODUCER_SPSC) {
+        return spsc_put_n(queue, items, count);
+    }
+    return locked_put_n(queue, items, count);
+}
+
+static int queue_get_n(consumer_producer_t* queue, plugin_buffer_t* items, int max_items, int block) { // dispatch to the backend
+    if (queue->mode == CONSUMER_PRODUCER_SPSC) {
+        return spsc_get_n(queue, items, max_items, block);
+    }
+    return locked_get_n(queue, items, max_items, block);
+}
+
+static void free_buffers(item_pool_t* pool, plugin_buffer_t* items, int count) { // release adopted buffers
+    for (int i = 0; i < count; i++) {
+        item_pool_free(pool, items[i].ptr);
+    }
+}
+
+const char* consumer_producer_put(consumer_producer_t* queue, const char* item) { // put item into the queue
+    if (!queue || !item) {
+        return "Invalid queue or item";
+    }
+    return consumer_producer_put_batch(queue, &item, 1);
+}
+
+const char* consumer_producer_put_owned(consumer_producer_t* queue, char* item) { // adopt item into the queue
+    if (!queue || !item) {
+        item_pool_free(queue ? queue->pool : NULL, item);
+        return "Invalid queue or item";
+    }
+    return consumer_producer_put_batch_owned(queue, &item, 1);
+}
+
+char* consumer_producer_get(consumer_producer_t* queue) { // get item from the queue
+    if (!queue) {
+        return NULL;
+    }
+    plugin_buffer_t item;
+    do { // control entries carry no bytes, the string interface passes over them
+        if (queue_get_n(queue, &item, 1, 1) != 1) {
+            return NULL;
+        }
+    } while (item.kind != PLUGIN_ITEM_DATA);
+    return item.ptr;
+}
+
+const char* consumer_producer_put_batch(consumer_producer_t* queue, const char* const* items, int count) { // put a batch
+    if (!queue || !items || count < 0) {
+        return "Invalid queue or items";
+    }
+
+    plugin_buffer_t copies[CONSUMER_PRODUCER_BATCH_CHUNK];
+    int done = 0;
+    while (done < count) { // copy and store one chunk at a time
+        int chunk = count - done;
+        if (chunk > CONSUMER_PRODUCER_BATCH_CHUNK) {
+            chunk = CONSUMER_PRODUCER_BATCH_CHUNK;
+        }
+
+        // create copies of the strings outside of any lock
+        for (int i = 0; i < chunk; i++) {
+            const char* item = items[done + i];
+            size_t len = item ? strlen(item) : 0;
+            copies[i].ptr = item ? (char*)item_pool_alloc(queue->pool, len + 1) : NULL;
+            if (!copies[i].ptr) {
+                free_buffers(queue->pool, copies, i);
+                return item ? "Failed to allocate memory for item copy" : "Invalid queue or item";
+            }
+            memcpy(copies[i].ptr, item, len + 1);
+            copies[i].len = len;
+            copies[i].capacity = len + 1;
+            copies[i].view = (plugin_view_t){ 0, 0 };
+            copies[i].kind = PLUGIN_ITEM_DATA;
+        }
+
+        int stored = queue_put_n(queue, copies, chunk);
+        if (stored < chunk) {
+            free_buffers(queue->pool, copies + stored, chunk - stored);
+            return "Failed to wait for not_full condition";
+        }
+        done += chunk;
+    }
+    return NULL; // success
+}
+
+const char* consumer_producer_put_batch_owned(consumer_producer_t* queue, char** items, int count) { // adopt a batch
+    if (!queue || !items || count < 0) {
+        if (items) {
+            for (int i = 0; i < count; i++) {
+                item_pool_free(queue ? queue->pool : NULL, items[i]);
+            }
+        }
+        return "Invalid queue or items";
+    }
+    for (int i = 0; i < count; i++) {
+        if (!items[i]) { // reject the whole batch before anything becomes visible
+            for (int j = 0; j < count; j++) {
+                item_pool_free(queue->pool, items[j]);
+            }
+            return "Invalid queue or item";
+        }
+    }
+
+    plugin_buffer_t buffers[CONSUMER_PRODUCER_BATCH_CHUNK];
+    int done = 0;
+    while (done < count) { // describe and store one chunk at a time
+        int chunk = count - done;
+        if (chunk > CONSUMER_PRODUCER_BATCH_CHUNK) {
+            chunk = CONSUMER_PRODUCER_BATCH_CHUNK;
+        }
+        for (int i = 0; i < chunk; i++) {
+            buffers[i].ptr = items[done + i];
+            buffers[i].len = strlen(items[done + i]);
+            buffers[i].capacity = buffers[i].len + 1;
+            buffers[i].view = (plugin_view_t){ 0, 0 };
+            buffers[i].kind = PLUGIN_ITEM_DATA;
+        }
+
+        const char* result = consumer_producer_put_buffers_owned(queue, buffers, chunk);
+        if (result != NULL) {
+            for (int i = done + chunk; i < count; i++) { // the rest is ours to release as well
+                item_pool_free(queue->pool, items[i]);
+            }
+            return result;
+        }
+        done += chunk;
+    }
+    return NULL; // success
+}
+
+int consumer_producer_get_batch(consumer_producer_t* queue, char** items, int max_items) { // get a batch
+    if (!queue || !items || max_items <= 0) {
+        return -1;
+    }
+
+    plugin_buffer_t buffers[CONSUMER_PRODUCER_BATCH_CHUNK];
+    if (max_items > CONSUMER_PRODUCER_BATCH_CHUNK) {
+        max_items = CONSUMER_PRODUCER_BATCH_CHUNK;
+    }
+    int kept = 0;
+    while (kept == 0) { // a batch of control entries only leaves nothing to return, wait for data
+        int count = queue_get_n(queue, buffers, max_items, 1);
+        if (count <= 0) {
+            return count;
+        }
+        for (int i = 0; i < count; i++) { // control entries carry no bytes, the string interface passes over them
+            if (buffers[i].kind == PLUGIN_ITEM_DATA) {
+                items[kept++] = buffers[i].ptr;
+            }
+        }
+    }
+    return kept;
+}
+
+const char* consumer_producer_put_buffers_owned(consumer_producer_t* queue, plugin_buffer_t* items, int count) { // adopt buffers
+    if (!queue || !items || count < 0) {
+        if (items && count > 0) {
+            free_buffers(queue ? queue->pool : NULL, items, count);
+        }
+        return "Invalid queue or items";
+    }
+    for (int i = 0; i < count; i++) {
+        if (!items[i].ptr && items[i].kind == PLUGIN_ITEM_DATA) { // reject the whole batch before anything becomes visible
+            free_buffers(queue->pool, items, count);
+            return "Invalid queue or item";
+        }
+    }
+
+    int stored = queue_put_n(queue, items, count);
+    if (stored < count) { // we own them, release what was not stored
+        free_buffers(queue->pool, items + stored, count - stored);
+        return "Failed to wait for not_full condition";
+    }
+    return NULL; // success
+}
+
+const char* consumer_producer_put_control(consumer_producer_t* queue, plugin_item_kind_t kind) { // put a control message
+    if (!queue || kind == PLUGIN_ITEM_DATA) {
+        return "Invalid queue or control message";
+    }
+    plugin_buffer_t item = { NULL, 0, 0, { 0, 0 }, kind };
+    return queue_put_n(queue, &item, 1) == 1 ? NULL : "Failed to wait for not_full condition";
+}
+
+int consumer_producer_get_buffers(consumer_producer_t* queue, plugin_buffer_t* items, int max_items) { // get buffers
+    if (!queue || !items || max_items <= 0) {
+        return -1;
+    }
+    return queue_get_n(queue, items, max_items, 1);
+}
+
+int consumer_producer_try_get_buffers(consumer_producer_t* queue, plugin_buffer_t* items, int max_items) { // get buffers, never wait
+    if (!queue || !items || max_items <= 0) {
+        return -1;
+    }
+    return queue_get_n(queue, items, max_items, 0);
+}
+
 void consumer_producer_signal_finished(consumer_producer_t* queue) { // signal finished
     if (!queue) {
         return;
@@ -170,4 +512,26 @@ int consumer_producer_wait_finished(consumer_producer_t* queue) { // wait for fi
     }
 
     return monitor_wait(&queue->finished_monitor); // wait for processing to finish
-}
\ No newline at end of file
+}
+
+int consumer_producer_wait_finished_timed(consumer_producer_t* queue, long timeout_ms) { // wait for finished, bounded
+    if (!queue) {
+        return -1;
+    }
+
+    return monitor_wait_timed(&queue->finished_monitor, timeout_ms); // wait for processing to finish or the timeout
+}
+
+int consumer_producer_count(consumer_producer_t* queue) { // items waiting
+    if (!queue) {
+        return -1;
+    }
+    if (queue->mode == CONSUMER_PRODUCER_SPSC) {
+        size_t head = atomic_load(&queue->spsc_head);
+        return (int)(atomic_load(&queue->spsc_tail) - head);
+    }
+    pthread_mutex_lock(&queue->mutex);
+    int count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
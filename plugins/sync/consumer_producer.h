@@ -2,32 +2,108 @@
 #define CONSUMER_PRODUCER_H
 
 #include "monitor.h"
+#include "item_pool.h"
+#include "../plugin_sdk.h"
 #include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define CONSUMER_PRODUCER_CACHE_LINE 64 /* padding unit used to keep ring indices apart */
+#define CONSUMER_PRODUCER_BATCH_CHUNK 64 /* items copied per step by consumer_producer_put_batch */
+
+/**
+ * Queue backends
+ * LOCKED - mutex protected ring, safe for any number of producers and consumers
+ * SPSC   - lock-free ring for exactly one producer thread and one consumer thread
+ */
+typedef enum {
+    CONSUMER_PRODUCER_LOCKED = 0,
+    CONSUMER_PRODUCER_SPSC = 1
+} consumer_producer_mode_t;
+
+/* backend used by consumer_producer_init, can be overridden at build time */
+#ifndef CONSUMER_PRODUCER_DEFAULT_MODE
+#define CONSUMER_PRODUCER_DEFAULT_MODE CONSUMER_PRODUCER_LOCKED
+#endif
 
 /**
  * Consumer-Producer Queue Structure for thread-safe producer-consumer pattern
  * Now using monitors for simpler implementation
  */
 typedef struct {
-    char** items;                    /* array of string pointers */
+    plugin_buffer_t* items;          /* ring of work item buffers */
     int capacity;                    /* maximum number of items */
     int count;                       /* current number of items */
     int head;                        /* index of first item */
     int tail;                        /* index of next insertion point */
+    consumer_producer_mode_t mode;   /* selected backend */
+    item_pool_t* pool;               /* allocator for item copies, NULL for malloc */
     pthread_mutex_t mutex;           /* mutex to protect queue state */
     monitor_t not_full_monitor;      /* monitor for "not full" state */
     monitor_t not_empty_monitor;     /* monitor for "not empty" state */
     monitor_t finished_monitor;      /* monitor for finished signal */
+    void (*published)(void* arg);    /* called after the producer published items, NULL if none */
+    int (*help)(void* arg);          /* run by a producer facing a full queue, NULL if none */
+    void* hook_arg;                  /* argument of published and help */
+
+    /* SPSC backend: consumer-owned line */
+    char consumer_pad[CONSUMER_PRODUCER_CACHE_LINE];
+    atomic_size_t spsc_head;         /* total items taken by the consumer */
+    atomic_int consumer_waiting;     /* consumer is parked on not_empty_monitor */
+
+    /* SPSC backend: producer-owned line */
+    char producer_pad[CONSUMER_PRODUCER_CACHE_LINE];
+    atomic_size_t spsc_tail;         /* total items published by the producer */
+    atomic_int producer_waiting;     /* producer is parked on not_full_monitor */
+    char tail_pad[CONSUMER_PRODUCER_CACHE_LINE];
 } consumer_producer_t;
 
 /**
- * Initialize a consumer-producer queue
+ * Initialize a consumer-producer queue using CONSUMER_PRODUCER_DEFAULT_MODE
  * @param queue Pointer to queue structure
  * @param capacity Maximum number of items
  * @return NULL on success, error message on failure
  */
 const char* consumer_producer_init(consumer_producer_t* queue, int capacity);
 
+/**
+ * Initialize a consumer-producer queue with an explicit backend
+ * The SPSC backend never takes a lock on the fast path and only parks when the
+ * ring is empty (consumer) or full (producer). It must only be used when a single
+ * thread calls put and a single thread calls get.
+ * @param queue Pointer to queue structure
+ * @param capacity Maximum number of items
+ * @param mode Queue backend
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_init_mode(consumer_producer_t* queue, int capacity,
+                                        consumer_producer_mode_t mode);
+
+/**
+ * Make the queue allocate (and free) its items from a pool instead of malloc
+ * Must be called before any item is put. Strings received from the queue and
+ * strings handed over with the *_owned calls then belong to that pool.
+ * @param queue Pointer to queue structure
+ * @param pool Pool to use, NULL for malloc
+ */
+void consumer_producer_set_pool(consumer_producer_t* queue, item_pool_t* pool);
+
+/**
+ * Let a scheduler (or a coroutine runner) drive the consumer instead of a thread parked in get
+ * published runs on the producer after every put that stored items (before it blocks on
+ * a full queue), so the consumer can be scheduled. A producer facing a full queue runs
+ * help before sleeping: 1 means it made progress elsewhere and the producer checks the
+ * queue again, 0 that nothing could be done now (the producer sleeps at most a
+ * millisecond before asking again), -1 that the producer can sleep until the consumer
+ * takes items. Must be called before any item is put.
+ * @param queue Pointer to queue structure
+ * @param published Hook run after items were published, NULL for none
+ * @param help Hook run instead of sleeping on a full queue, NULL for none
+ * @param arg Argument of both hooks
+ */
+void consumer_producer_set_hooks(consumer_producer_t* queue, void (*published)(void* arg), int (*help)(void* arg),
+                                 void* arg);
+
 /**
  * Destroy a consumer-producer queue and free its resources
  * @param queue Pointer to queue structure
@@ -43,14 +119,110 @@ void consumer_producer_destroy(consumer_producer_t* queue);
  */
 const char* consumer_producer_put(consumer_producer_t* queue, const char* item);
 
+/**
+ * Add an item to the queue without copying it (producer).
+ * The queue adopts the pointer, which must come from the queue's allocator (malloc
+ * unless consumer_producer_set_pool was called). Ownership is
+ * transferred even on failure, in which case the queue frees the item.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param item Heap allocated string to add (queue takes ownership)
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_owned(consumer_producer_t* queue, char* item);
+
 /**
  * Remove an item from the queue (consumer) and returns it.
  * Blocks if queue is empty.
+ * For queues that only carry data: control entries (end of stream, flush, checkpoint) are
+ * taken off and skipped, so NULL always means failure. Consumers that act on control
+ * entries use consumer_producer_get_buffers, which returns each entry's kind.
  * @param queue Pointer to queue structure
- * @return String item or NULL if queue is empty
+ * @return String item, NULL on failure
  */
 char* consumer_producer_get(consumer_producer_t* queue);
 
+/**
+ * Add several items to the queue (producer).
+ * Items are moved in chunks, as many as fit per lock acquisition (or per index update
+ * on the SPSC ring), and the consumer is woken once per chunk instead of once per item.
+ * Blocks while the queue is full until every item has been added.
+ * @param queue Pointer to queue structure
+ * @param items Array of strings to add (the queue stores copies)
+ * @param count Number of strings in items
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_batch(consumer_producer_t* queue, const char* const* items, int count);
+
+/**
+ * Add several items to the queue without copying them (producer).
+ * Same as consumer_producer_put_batch, but the queue adopts every pointer. Ownership
+ * of all items is transferred even on failure, items that could not be stored are freed.
+ * @param queue Pointer to queue structure
+ * @param items Array of heap allocated strings to add (queue takes ownership)
+ * @param count Number of strings in items
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_batch_owned(consumer_producer_t* queue, char** items, int count);
+
+/**
+ * Remove up to max_items items from the queue (consumer).
+ * Blocks until at least one item is available, then takes everything that is
+ * queued up to max_items in one step and wakes the producer once.
+ * For queues that only carry data: control entries are taken off and skipped like in
+ * consumer_producer_get, and a step that took nothing else waits for more.
+ * @param queue Pointer to queue structure
+ * @param items Output array receiving the strings (caller frees each one)
+ * @param max_items Capacity of items
+ * @return Number of items stored in items, -1 on error
+ */
+int consumer_producer_get_batch(consumer_producer_t* queue, char** items, int max_items);
+
+/**
+ * Add several buffers to the queue without copying them (producer).
+ * Like consumer_producer_put_batch_owned, but lengths travel with the items so nothing
+ * is rescanned, and an item may contain NUL bytes. Every ptr must come from the
+ * queue's allocator and be NUL terminated at ptr[len], except in control messages
+ * (kind other than PLUGIN_ITEM_DATA), which have no bytes. Ownership of all buffers is
+ * transferred even on failure, buffers that could not be stored are freed.
+ * @param queue Pointer to queue structure
+ * @param items Array of buffers to add (queue takes ownership of each ptr)
+ * @param count Number of buffers in items
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_buffers_owned(consumer_producer_t* queue, plugin_buffer_t* items, int count);
+
+/**
+ * Add a control message to the queue (producer).
+ * The entry carries no bytes and stays in order with the data around it.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param kind Control message to add, anything but PLUGIN_ITEM_DATA
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_control(consumer_producer_t* queue, plugin_item_kind_t kind);
+
+/**
+ * Remove up to max_items buffers from the queue (consumer).
+ * Same as consumer_producer_get_batch, but returns each item with its length and kind,
+ * so control messages are only seen through this call.
+ * @param queue Pointer to queue structure
+ * @param items Output array receiving the buffers (caller frees each ptr)
+ * @param max_items Capacity of items
+ * @return Number of buffers stored in items, -1 on error
+ */
+int consumer_producer_get_buffers(consumer_producer_t* queue, plugin_buffer_t* items, int max_items);
+
+/**
+ * Remove up to max_items buffers from the queue without blocking (consumer).
+ * Same as consumer_producer_get_buffers, but returns 0 right away when the queue is empty.
+ * @param queue Pointer to queue structure
+ * @param items Output array receiving the buffers (caller frees each ptr)
+ * @param max_items Capacity of items
+ * @return Number of buffers stored in items, 0 if the queue was empty, -1 on error
+ */
+int consumer_producer_try_get_buffers(consumer_producer_t* queue, plugin_buffer_t* items, int max_items);
+
 /**
  * Signal that processing is finished
  * @param queue Pointer to queue structure
@@ -60,8 +232,24 @@ void consumer_producer_signal_finished(consumer_producer_t* queue);
 /**
  * Wait for processing to be finished
  * @param queue Pointer to queue structure
- * @return 0 on success, -1 on timeout
+ * @return 0 on success, -1 on error
  */
 int consumer_producer_wait_finished(consumer_producer_t* queue);
 
-#endif // CONSUMER_PRODUCER_H
\ No newline at end of file
+/**
+ * Wait at most timeout_ms milliseconds for processing to be finished
+ * @param queue Pointer to queue structure
+ * @param timeout_ms Longest wait in milliseconds, 0 only checks
+ * @return 0 on success, -1 on timeout (errno ETIMEDOUT) or error
+ */
+int consumer_producer_wait_finished_timed(consumer_producer_t* queue, long timeout_ms);
+
+/**
+ * Number of items waiting in the queue
+ * A snapshot, the producer and the consumer may change it right after
+ * @param queue Pointer to queue structure
+ * @return Items queued, -1 on error
+ */
+int consumer_producer_count(consumer_producer_t* queue);
+
+#endif // CONSUMER_PRODUCER_H
@@ -146,21 +146,214 @@ void test_finished_signal() { // finished signal test
     const char* result = consumer_producer_init(&queue, 5);
     assert(result == NULL);
     
+    // a bounded wait gives up while nothing finished
+    assert(consumer_producer_wait_finished_timed(&queue, 50) == -1);
+
     // test finished signal directly
     consumer_producer_signal_finished(&queue);
     int wait_result = consumer_producer_wait_finished(&queue);
     assert(wait_result == 0);
+    assert(consumer_producer_wait_finished_timed(&queue, 50) == 0);
     
     consumer_producer_destroy(&queue);
     printf("✓ Finished signal test passed\n");
 }
 
+#define SPSC_ITEMS 20000
+
+void* spsc_producer_thread(void* arg) { // SPSC producer, puts a numbered sequence
+    consumer_producer_t* queue = (consumer_producer_t*)arg;
+    char item[32];
+    for (int i = 0; i < SPSC_ITEMS; i++) {
+        snprintf(item, sizeof(item), "%d", i);
+        if (consumer_producer_put(queue, item) != NULL) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+void test_spsc_ordering() { // lock-free SPSC backend keeps FIFO order under contention
+    printf("\n=== Test 4: SPSC Ring Ordering ===\n");
+
+    consumer_producer_t queue;
+    const char* result = consumer_producer_init_mode(&queue, 4, CONSUMER_PRODUCER_SPSC);
+    assert(result == NULL);
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, spsc_producer_thread, &queue);
+
+    // small capacity forces both sides to park on full and empty
+    for (int i = 0; i < SPSC_ITEMS; i++) {
+        char* item = consumer_producer_get(&queue);
+        assert(item != NULL);
+        assert(atoi(item) == i);
+        free(item);
+    }
+
+    pthread_join(producer, NULL);
+    consumer_producer_destroy(&queue);
+    printf("SPSC ring ordering test passed\n");
+}
+
+void test_batch_put_get() { // batch API on both backends
+    printf("\n=== Test 5: Batch Put/Get ===\n");
+
+    consumer_producer_mode_t modes[] = { CONSUMER_PRODUCER_LOCKED, CONSUMER_PRODUCER_SPSC };
+    for (int m = 0; m < 2; m++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, 8, modes[m]);
+        assert(result == NULL);
+
+        const char* in[] = { "one", "two", "three", "four", "five" };
+        result = consumer_producer_put_batch(&queue, in, 5);
+        assert(result == NULL);
+
+        // a batch get takes at most max_items, in order
+        char* out[8];
+        int got = consumer_producer_get_batch(&queue, out, 3);
+        assert(got == 3);
+        assert(strcmp(out[0], "one") == 0 && strcmp(out[2], "three") == 0);
+        for (int i = 0; i < got; i++) free(out[i]);
+
+        // and everything that is left when max_items is larger
+        got = consumer_producer_get_batch(&queue, out, 8);
+        assert(got == 2);
+        assert(strcmp(out[0], "four") == 0 && strcmp(out[1], "five") == 0);
+        for (int i = 0; i < got; i++) free(out[i]);
+
+        consumer_producer_destroy(&queue);
+    }
+    printf("Batch put/get test passed\n");
+}
+
+void test_owned_put() { // ownership transfer keeps the pointer
+    printf("\n=== Test 6: Owned Put ===\n");
+
+    consumer_producer_t queue;
+    const char* result = consumer_producer_init_mode(&queue, 4, CONSUMER_PRODUCER_SPSC);
+    assert(result == NULL);
+
+    char* original = strdup("moved");
+    result = consumer_producer_put_owned(&queue, original);
+    assert(result == NULL);
+
+    char* batch[2] = { strdup("b1"), strdup("b2") };
+    result = consumer_producer_put_batch_owned(&queue, batch, 2);
+    assert(result == NULL);
+
+    // the consumer receives the very same buffer, no copy was made
+    char* item = consumer_producer_get(&queue);
+    assert(item == original);
+    free(item);
+
+    // leave the batch queued, destroy must release it
+    consumer_producer_destroy(&queue);
+    printf("Owned put test passed\n");
+}
+
+void test_buffers() { // lengths travel with the items
+    printf("\n=== Test 7: Buffer Put/Get ===\n");
+
+    for (int mode = CONSUMER_PRODUCER_LOCKED; mode <= CONSUMER_PRODUCER_SPSC; mode++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, 4, (consumer_producer_mode_t)mode);
+        assert(result == NULL);
+
+        // an item with an embedded NUL byte keeps its full length
+        char* with_nul = malloc(4);
+        memcpy(with_nul, "a\0b", 4);
+        plugin_buffer_t items[2] = { { with_nul, 3, 4, { 0, 0 }, PLUGIN_ITEM_DATA },
+                                     { strdup("plain"), 5, 6, { 0, 0 }, PLUGIN_ITEM_DATA } };
+        result = consumer_producer_put_buffers_owned(&queue, items, 2);
+        assert(result == NULL);
+
+        // string puts are measured once on the way in
+        result = consumer_producer_put(&queue, "copied");
+        assert(result == NULL);
+        assert(consumer_producer_count(&queue) == 3);
+
+        plugin_buffer_t out[4];
+        int count = consumer_producer_get_buffers(&queue, out, 4);
+        assert(count == 3);
+        assert(out[0].ptr == with_nul && out[0].len == 3 && memcmp(out[0].ptr, "a\0b", 4) == 0);
+        assert(out[1].len == 5 && strcmp(out[1].ptr, "plain") == 0);
+        assert(out[2].len == 6 && strcmp(out[2].ptr, "copied") == 0);
+        for (int i = 0; i < count; i++) {
+            free(out[i].ptr);
+        }
+
+        consumer_producer_destroy(&queue);
+    }
+    printf("Buffer put/get test passed\n");
+}
+
+void test_control_messages() { // control messages keep their place among the data
+    printf("\n=== Test 8: Control Messages ===\n");
+
+    for (int mode = CONSUMER_PRODUCER_LOCKED; mode <= CONSUMER_PRODUCER_SPSC; mode++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, 8, (consumer_producer_mode_t)mode);
+        assert(result == NULL);
+
+        assert(consumer_producer_put(&queue, "<END>") == NULL); // only data through the string interface
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_FLUSH) == NULL);
+        plugin_buffer_t items[2] = { { strdup("x"), 1, 2, { 0, 0 }, PLUGIN_ITEM_DATA },
+                                     { NULL, 0, 0, { 0, 0 }, PLUGIN_ITEM_CHECKPOINT } };
+        assert(consumer_producer_put_buffers_owned(&queue, items, 2) == NULL);
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_END) == NULL);
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_DATA) != NULL); // data needs bytes
+
+        plugin_buffer_t out[8];
+        int count = consumer_producer_get_buffers(&queue, out, 8);
+        assert(count == 5);
+        assert(out[0].kind == PLUGIN_ITEM_DATA && out[0].len == 5 && strcmp(out[0].ptr, "<END>") == 0);
+        assert(out[1].kind == PLUGIN_ITEM_FLUSH && out[1].ptr == NULL);
+        assert(out[2].kind == PLUGIN_ITEM_DATA && strcmp(out[2].ptr, "x") == 0);
+        assert(out[3].kind == PLUGIN_ITEM_CHECKPOINT && out[3].ptr == NULL);
+        assert(out[4].kind == PLUGIN_ITEM_END && out[4].ptr == NULL);
+        for (int i = 0; i < count; i++) {
+            free(out[i].ptr);
+        }
+
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_CHECKPOINT) == NULL);
+        assert(consumer_producer_put(&queue, "y") == NULL);
+        char* item = consumer_producer_get(&queue); // the string getter passes over control entries
+        assert(item != NULL && strcmp(item, "y") == 0);
+        free(item);
+
+        assert(consumer_producer_put(&queue, "a") == NULL);
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_FLUSH) == NULL);
+        assert(consumer_producer_put(&queue, "b") == NULL);
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_END) == NULL);
+        char* strings[8];
+        int got = consumer_producer_get_batch(&queue, strings, 8); // so does the batch getter, compacting the rest
+        assert(got == 2 && strcmp(strings[0], "a") == 0 && strcmp(strings[1], "b") == 0);
+        free(strings[0]);
+        free(strings[1]);
+
+        assert(consumer_producer_put_control(&queue, PLUGIN_ITEM_CHECKPOINT) == NULL);
+        assert(consumer_producer_put(&queue, "c") == NULL);
+        got = consumer_producer_get_batch(&queue, strings, 1); // the first step takes only the checkpoint, it goes on
+        assert(got == 1 && strcmp(strings[0], "c") == 0);
+        free(strings[0]);
+
+        consumer_producer_destroy(&queue);
+    }
+    printf("Control messages test passed\n");
+}
+
 int main() { // Main test runner
     printf("Starting Consumer-Producer Queue Unit Tests...\n");
     
     test_basic_put_get();
     test_circular_buffer();
     test_finished_signal();
+    test_spsc_ordering();
+    test_batch_put_get();
+    test_owned_put();
+    test_buffers();
+    test_control_messages();
     
     printf("\n All consumer-producer queue tests passed!\n");
     return 0;
@@ -0,0 +1,289 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // MAP_ANONYMOUS, and the ucontext functions POSIX dropped
+#endif
+#include "coroutine.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static void coroutine_main(coroutine_t* coroutine);
+
+#if COROUTINE_USE_UCONTEXT
+
+static void coroutine_boot(unsigned int high, unsigned int low) { // makecontext passes ints, the pointer comes in halves
+    uintptr_t address = ((uintptr_t)high << 16 << 16) | (uintptr_t)low;
+    coroutine_main((coroutine_t*)address);
+}
+
+static int context_init(coroutine_t* coroutine, char* stack, size_t size) { // first switch enters coroutine_boot
+    if (getcontext(&coroutine->context) != 0) {
+        return -1;
+    }
+    uintptr_t address = (uintptr_t)coroutine;
+    coroutine->context.uc_stack.ss_sp = stack;
+    coroutine->context.uc_stack.ss_size = size;
+    coroutine->context.uc_link = NULL;
+    makecontext(&coroutine->context, (void (*)(void))coroutine_boot, 2, (unsigned int)(address >> 16 >> 16),
+                (unsigned int)address);
+    return 0;
+}
+
+static void switch_context(coroutine_t* from, coroutine_t* to) { // save into from, resume to
+    swapcontext(&from->context, &to->context);
+}
+
+#else
+
+/*
+ * x86-64 stack switch
+ * coroutine_switch_stack pushes the callee-saved registers, stores the stack pointer in
+ * *save, loads the other stack and pops its registers, and returns to wherever that stack
+ * switched out. Everything else is caller-saved at a call, so nothing more needs saving
+ * (the floating point control words are left as they are, nothing here changes them).
+ * A new stack is laid out as if it had switched out right before coroutine_boot, which
+ * calls coroutine_main (from r12) with the coroutine (from rbx).
+ * The symbols are hidden, every plugin carries its own copy.
+ */
+void coroutine_switch_stack(void** save, void* load) __attribute__((visibility("hidden")));
+void coroutine_boot(void) __attribute__((visibility("hidden")));
+
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl coroutine_switch_stack\n"
+    ".hidden coroutine_switch_stack\n"
+    ".type coroutine_switch_stack, @function\n"
+    "coroutine_switch_stack:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size coroutine_switch_stack, .-coroutine_switch_stack\n"
+    ".p2align 4\n"
+    ".globl coroutine_boot\n"
+    ".hidden coroutine_boot\n"
+    ".type coroutine_boot, @function\n"
+    "coroutine_boot:\n"
+    "    movq %rbx, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size coroutine_boot, .-coroutine_boot\n");
+
+static int context_init(coroutine_t* coroutine, char* stack, size_t size) { // first switch enters coroutine_boot
+    void** sp = (void**)((uintptr_t)(stack + size) & ~(uintptr_t)15); // coroutine_main is called with it aligned
+    *--sp = (void*)coroutine_boot;   // return address
+    *--sp = NULL;                    // rbp
+    *--sp = coroutine;               // rbx
+    *--sp = (void*)coroutine_main;   // r12
+    *--sp = NULL;                    // r13
+    *--sp = NULL;                    // r14
+    *--sp = NULL;                    // r15
+    coroutine->sp = sp;
+    return 0;
+}
+
+static void switch_context(coroutine_t* from, coroutine_t* to) { // save into from, resume to
+    coroutine_switch_stack(&from->sp, to->sp);
+}
+
+#endif
+
+static void ready_push(coroutine_runner_t* runner, coroutine_t* coroutine) { // append to the ready list, mutex held
+    coroutine->state = COROUTINE_READY;
+    coroutine->next = NULL;
+    if (runner->ready_tail) {
+        runner->ready_tail->next = coroutine;
+    } else {
+        runner->ready_head = coroutine;
+    }
+    runner->ready_tail = coroutine;
+}
+
+static void coroutine_main(coroutine_t* coroutine) { // first frame of every coroutine
+    coroutine->entry(coroutine->arg);
+    coroutine->returned = 1; // the runner marks it done once off this stack
+    switch_context(coroutine, &coroutine->runner->home); // never resumed
+}
+
+static void* runner_thread(void* arg) { // resumes ready coroutines in turn
+    coroutine_runner_t* runner = (coroutine_runner_t*)arg;
+    pthread_mutex_lock(&runner->mutex);
+    while (1) {
+        coroutine_t* coroutine = runner->ready_head;
+        if (!coroutine) {
+            if (runner->stopping) {
+                break;
+            }
+            pthread_cond_wait(&runner->ready_cond, &runner->mutex);
+            continue;
+        }
+        runner->ready_head = coroutine->next;
+        if (!runner->ready_head) {
+            runner->ready_tail = NULL;
+        }
+        coroutine->next = NULL;
+        coroutine->state = COROUTINE_RUNNING;
+        pthread_mutex_unlock(&runner->mutex);
+
+        runner->current = coroutine;
+        runner->switches++;
+        switch_context(&runner->home, coroutine); // back here when it parks, yields or returns
+        runner->current = NULL;
+
+        pthread_mutex_lock(&runner->mutex);
+        if (coroutine->returned) { // its stack is no longer in use, coroutine_join may release it
+            coroutine->state = COROUTINE_DONE;
+            pthread_cond_broadcast(&runner->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&runner->mutex);
+    return NULL;
+}
+
+int coroutine_runner_init(coroutine_runner_t* runner) { // Start the runner thread
+    if (!runner) {
+        return -1;
+    }
+    memset(runner, 0, sizeof(*runner));
+    if (pthread_mutex_init(&runner->mutex, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_cond_init(&runner->ready_cond, NULL) != 0) {
+        pthread_mutex_destroy(&runner->mutex);
+        return -1;
+    }
+    if (pthread_cond_init(&runner->done_cond, NULL) != 0) {
+        pthread_cond_destroy(&runner->ready_cond);
+        pthread_mutex_destroy(&runner->mutex);
+        return -1;
+    }
+    if (pthread_create(&runner->thread, NULL, runner_thread, runner) != 0) {
+        pthread_cond_destroy(&runner->done_cond);
+        pthread_cond_destroy(&runner->ready_cond);
+        pthread_mutex_destroy(&runner->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+int coroutine_start(coroutine_runner_t* runner, coroutine_t* coroutine, void (*entry)(void* arg), void* arg,
+                    size_t stack_size) { // Create a coroutine and make it ready
+    if (!runner || !coroutine || !entry) {
+        return -1;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (stack_size == 0) {
+        stack_size = COROUTINE_STACK_SIZE;
+    }
+    stack_size = (stack_size + page - 1) / page * page;
+
+    memset(coroutine, 0, sizeof(*coroutine));
+    char* stack = (char*)mmap(NULL, stack_size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        return -1;
+    }
+    if (mprotect(stack, page, PROT_NONE) != 0 || // stacks grow down, an overflow faults instead of corrupting
+        context_init(coroutine, stack + page, stack_size) != 0) {
+        munmap(stack, stack_size + page);
+        return -1;
+    }
+    coroutine->entry = entry;
+    coroutine->arg = arg;
+    coroutine->stack = stack;
+    coroutine->stack_size = stack_size + page;
+    coroutine->runner = runner;
+
+    pthread_mutex_lock(&runner->mutex);
+    ready_push(runner, coroutine);
+    pthread_cond_signal(&runner->ready_cond);
+    pthread_mutex_unlock(&runner->mutex);
+    return 0;
+}
+
+coroutine_t* coroutine_current(coroutine_runner_t* runner) { // running coroutine, on the runner thread
+    if (!runner || !pthread_equal(pthread_self(), runner->thread)) {
+        return NULL;
+    }
+    return runner->current;
+}
+
+void coroutine_yield(coroutine_t* coroutine) { // Let the other ready coroutines run first
+    coroutine_runner_t* runner = coroutine->runner;
+    pthread_mutex_lock(&runner->mutex);
+    if (!runner->ready_head) { // nobody else to run, carry on
+        pthread_mutex_unlock(&runner->mutex);
+        return;
+    }
+    ready_push(runner, coroutine);
+    pthread_mutex_unlock(&runner->mutex);
+    switch_context(coroutine, &runner->home);
+}
+
+void coroutine_park(coroutine_t* coroutine) { // Switch out until woken
+    coroutine_runner_t* runner = coroutine->runner;
+    pthread_mutex_lock(&runner->mutex);
+    if (coroutine->wake_pending) { // woken since the caller last checked
+        coroutine->wake_pending = 0;
+        pthread_mutex_unlock(&runner->mutex);
+        return;
+    }
+    coroutine->state = COROUTINE_PARKED;
+    pthread_mutex_unlock(&runner->mutex); // a wake from here on queues it, only this thread resumes it
+    switch_context(coroutine, &runner->home);
+}
+
+void coroutine_wake(coroutine_t* coroutine) { // Make a parked coroutine ready
+    if (!coroutine || !coroutine->runner) {
+        return;
+    }
+    coroutine_runner_t* runner = coroutine->runner;
+    pthread_mutex_lock(&runner->mutex);
+    if (coroutine->state == COROUTINE_PARKED) {
+        ready_push(runner, coroutine);
+        pthread_cond_signal(&runner->ready_cond);
+    } else if (coroutine->state != COROUTINE_DONE) {
+        coroutine->wake_pending = 1;
+    }
+    pthread_mutex_unlock(&runner->mutex);
+}
+
+int coroutine_join(coroutine_t* coroutine) { // Wait for a coroutine and release its stack
+    if (!coroutine || !coroutine->runner || !coroutine->stack) {
+        return -1;
+    }
+    coroutine_runner_t* runner = coroutine->runner;
+    pthread_mutex_lock(&runner->mutex);
+    while (coroutine->state != COROUTINE_DONE) {
+        pthread_cond_wait(&runner->done_cond, &runner->mutex);
+    }
+    pthread_mutex_unlock(&runner->mutex);
+    munmap(coroutine->stack, coroutine->stack_size);
+    coroutine->stack = NULL;
+    return 0;
+}
+
+void coroutine_runner_destroy(coroutine_runner_t* runner) { // Stop the runner thread
+    if (!runner) {
+        return;
+    }
+    pthread_mutex_lock(&runner->mutex);
+    runner->stopping = 1;
+    pthread_cond_signal(&runner->ready_cond);
+    pthread_mutex_unlock(&runner->mutex);
+    pthread_join(runner->thread, NULL);
+    pthread_cond_destroy(&runner->done_cond);
+    pthread_cond_destroy(&runner->ready_cond);
+    pthread_mutex_destroy(&runner->mutex);
+}
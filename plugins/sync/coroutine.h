@@ -0,0 +1,134 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * Context switch selection: on x86-64 coroutines switch stacks with a few instructions
+ * that save the callee-saved registers, elsewhere (or with -DCOROUTINE_USE_UCONTEXT=1)
+ * with swapcontext, which also saves the signal mask and so enters the kernel every time.
+ */
+#ifndef COROUTINE_USE_UCONTEXT
+#if defined(__x86_64__)
+#define COROUTINE_USE_UCONTEXT 0
+#else
+#define COROUTINE_USE_UCONTEXT 1
+#endif
+#endif
+
+#if COROUTINE_USE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+#define COROUTINE_STACK_SIZE (256 * 1024) /* stack of a coroutine, below it a guard page */
+
+/**
+ * Coroutine runner
+ * One thread runs any number of stackful coroutines, one at a time and each until it
+ * parks or yields. A parked coroutine runs again once something wakes it, from the runner
+ * or from any other thread. The runner sleeps only when no coroutine is ready.
+ * Wakes are remembered: waking a coroutine that is not parked makes its next park return
+ * at once, so "check, then park" cannot miss a wake that lands in between.
+ * Which coroutine is running is kept in the runner, not in thread-local storage, so copies
+ * of this code linked into different plugins all agree on it.
+ */
+
+typedef enum {
+    COROUTINE_READY = 0,             /* in the ready list */
+    COROUTINE_RUNNING = 1,
+    COROUTINE_PARKED = 2,            /* waits for coroutine_wake */
+    COROUTINE_DONE = 3               /* its function returned */
+} coroutine_state_t;
+
+struct coroutine_runner;
+
+typedef struct coroutine {
+#if COROUTINE_USE_UCONTEXT
+    ucontext_t context;              /* saved registers while switched out */
+#else
+    void* sp;                        /* saved stack pointer while switched out */
+#endif
+    void (*entry)(void* arg);
+    void* arg;
+    char* stack;                     /* mapping holding the guard page and the stack */
+    size_t stack_size;               /* bytes mapped at stack */
+    struct coroutine_runner* runner;
+    struct coroutine* next;          /* link in the ready list */
+    coroutine_state_t state;         /* protected by the runner's mutex */
+    int wake_pending;                /* woken while not parked, protected by the runner's mutex */
+    int returned;                    /* entry returned, only touched by the runner thread */
+} coroutine_t;
+
+typedef struct coroutine_runner {
+    pthread_t thread;
+    coroutine_t home;                /* the runner thread's own context, coroutines switch back to it */
+    coroutine_t* current;            /* running coroutine, only touched by the runner thread */
+    pthread_mutex_t mutex;           /* protects the ready list, states and stopping */
+    pthread_cond_t ready_cond;       /* a coroutine became ready or the runner is stopping */
+    pthread_cond_t done_cond;        /* a coroutine finished */
+    coroutine_t* ready_head;
+    coroutine_t* ready_tail;
+    int stopping;
+    unsigned long long switches;     /* coroutines resumed (statistics), only touched by the runner thread */
+} coroutine_runner_t;
+
+/**
+ * Initialize a runner and start its thread
+ * @param runner Pointer to runner structure
+ * @return 0 on success, -1 on failure
+ */
+int coroutine_runner_init(coroutine_runner_t* runner);
+
+/**
+ * Create a coroutine and make it ready, callable from any thread
+ * @param runner The runner that will run it
+ * @param coroutine Coroutine to start, must stay in place until coroutine_join returned
+ * @param entry Function the coroutine runs, the coroutine is done when it returns
+ * @param arg Argument of entry
+ * @param stack_size Stack size in bytes, 0 for COROUTINE_STACK_SIZE
+ * @return 0 on success, -1 on failure
+ */
+int coroutine_start(coroutine_runner_t* runner, coroutine_t* coroutine, void (*entry)(void* arg), void* arg,
+                    size_t stack_size);
+
+/**
+ * The coroutine the calling code runs in
+ * @param runner The runner
+ * @return The running coroutine, NULL when called from any other thread than the runner's
+ */
+coroutine_t* coroutine_current(coroutine_runner_t* runner);
+
+/**
+ * Give the other ready coroutines a turn, the caller runs again after them
+ * @param coroutine The calling coroutine
+ */
+void coroutine_yield(coroutine_t* coroutine);
+
+/**
+ * Switch out until coroutine_wake, returns at once if a wake arrived since the last park
+ * @param coroutine The calling coroutine
+ */
+void coroutine_park(coroutine_t* coroutine);
+
+/**
+ * Make a parked coroutine ready, callable from any thread
+ * @param coroutine Coroutine to wake, its next park returns at once if it is not parked
+ */
+void coroutine_wake(coroutine_t* coroutine);
+
+/**
+ * Wait until a coroutine is done and release its stack
+ * @param coroutine The coroutine, called from any other thread than the runner's
+ * @return 0 on success, -1 on failure
+ */
+int coroutine_join(coroutine_t* coroutine);
+
+/**
+ * Stop the runner thread, wait for it and release the runner
+ * Every coroutine started on it must be done (joined)
+ * @param runner The runner
+ */
+void coroutine_runner_destroy(coroutine_runner_t* runner);
+
+#endif // COROUTINE_H
@@ -0,0 +1,185 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
+#include <time.h>
+#include "sync/coroutine.h"
+
+#define TEST_COROUTINES 100
+#define TEST_YIELDS 1000
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+typedef struct { // coroutine appending its id to a shared trace
+    coroutine_t coroutine;
+    coroutine_runner_t* runner;
+    int id;
+    int rounds;
+    char* trace;                     // shared, only written on the runner thread
+    int* trace_length;
+    int was_current;                 // coroutine_current saw this coroutine
+} trace_arg_t;
+
+static void trace_run(void* arg) {
+    trace_arg_t* self = (trace_arg_t*)arg;
+    self->was_current = coroutine_current(self->runner) == &self->coroutine;
+    for (int i = 0; i < self->rounds; i++) {
+        self->trace[(*self->trace_length)++] = (char)('a' + self->id);
+        coroutine_yield(&self->coroutine);
+    }
+}
+
+void test_yield_order() { // yielding coroutines take turns on the runner thread
+    printf("\n=== Test 1: Yield Order ===\n");
+
+    coroutine_runner_t runner;
+    assert(coroutine_runner_init(&runner) == 0);
+
+    char trace[16] = { 0 };
+    int trace_length = 0;
+    trace_arg_t args[3];
+    for (int i = 0; i < 3; i++) {
+        args[i] = (trace_arg_t){ .runner = &runner, .id = i, .rounds = 3, .trace = trace, .trace_length = &trace_length };
+        assert(coroutine_start(&runner, &args[i].coroutine, trace_run, &args[i], 0) == 0);
+    }
+    for (int i = 0; i < 3; i++) {
+        assert(coroutine_join(&args[i].coroutine) == 0);
+        assert(args[i].was_current);
+    }
+    assert(trace_length == 9);
+    assert(strspn(trace, "abc") == 9 && trace[8] == 'c'); // c became ready last and yields to nobody
+    assert(coroutine_current(&runner) == NULL); // not the runner thread
+
+    coroutine_runner_destroy(&runner);
+    printf("Yield order test passed\n");
+}
+
+typedef struct { // coroutine parking until woken
+    coroutine_t coroutine;
+    atomic_int stage;                // how far it got
+} park_arg_t;
+
+static void park_run(void* arg) {
+    park_arg_t* self = (park_arg_t*)arg;
+    atomic_store(&self->stage, 1);
+    coroutine_park(&self->coroutine); // woken by the test thread
+    atomic_store(&self->stage, 2);
+    coroutine_park(&self->coroutine); // the wake came first, returns at once
+    atomic_store(&self->stage, 3);
+}
+
+void test_park_and_wake() { // wakes from another thread, before and after the park
+    printf("\n=== Test 2: Park and Wake ===\n");
+
+    coroutine_runner_t runner;
+    assert(coroutine_runner_init(&runner) == 0);
+
+    park_arg_t arg;
+    atomic_init(&arg.stage, 0);
+    assert(coroutine_start(&runner, &arg.coroutine, park_run, &arg, 0) == 0);
+    for (int i = 0; i < 5000 && atomic_load(&arg.stage) < 1; i++) {
+        sleep_ms(1);
+    }
+    sleep_ms(20);
+    assert(atomic_load(&arg.stage) == 1); // parked
+    pthread_mutex_lock(&runner.mutex);
+    int parked = arg.coroutine.state == COROUTINE_PARKED;
+    pthread_mutex_unlock(&runner.mutex);
+    assert(parked);
+
+    coroutine_wake(&arg.coroutine);
+    coroutine_wake(&arg.coroutine); // lands while it is ready or running, remembered for the next park
+    assert(coroutine_join(&arg.coroutine) == 0);
+    assert(atomic_load(&arg.stage) == 3);
+    coroutine_wake(&arg.coroutine); // done, ignored
+
+    coroutine_runner_destroy(&runner);
+    printf("Park and wake test passed\n");
+}
+
+typedef struct { // coroutine counting its turns
+    coroutine_t coroutine;
+    atomic_int* counter;
+} count_arg_t;
+
+static void count_run(void* arg) {
+    count_arg_t* self = (count_arg_t*)arg;
+    for (int i = 0; i < TEST_YIELDS; i++) {
+        atomic_fetch_add_explicit(self->counter, 1, memory_order_relaxed);
+        coroutine_yield(&self->coroutine);
+    }
+}
+
+void test_many() { // many coroutines on one thread, switched often
+    printf("\n=== Test 3: Many Coroutines ===\n");
+
+    coroutine_runner_t runner;
+    assert(coroutine_runner_init(&runner) == 0);
+
+    static count_arg_t args[TEST_COROUTINES];
+    atomic_int counter;
+    atomic_init(&counter, 0);
+    for (int i = 0; i < TEST_COROUTINES; i++) {
+        args[i].counter = &counter;
+        assert(coroutine_start(&runner, &args[i].coroutine, count_run, &args[i], 64 * 1024) == 0);
+    }
+    for (int i = 0; i < TEST_COROUTINES; i++) {
+        assert(coroutine_join(&args[i].coroutine) == 0);
+    }
+    assert(atomic_load(&counter) == TEST_COROUTINES * TEST_YIELDS);
+
+    coroutine_runner_destroy(&runner);
+    printf("Many coroutines test passed\n");
+}
+
+static int deep(int depth) { // about 100 KiB of stack
+    volatile char frame[1024];
+    frame[0] = (char)depth;
+    frame[sizeof(frame) - 1] = (char)depth;
+    return depth == 0 ? frame[0] : deep(depth - 1) + frame[sizeof(frame) - 1];
+}
+
+typedef struct {
+    coroutine_t coroutine;
+    int result;
+} deep_arg_t;
+
+static void deep_run(void* arg) {
+    deep_arg_t* self = (deep_arg_t*)arg;
+    self->result = deep(100);
+}
+
+void test_stack() { // a coroutine has a full stack of its own
+    printf("\n=== Test 4: Stack ===\n");
+
+    coroutine_runner_t runner;
+    assert(coroutine_runner_init(&runner) == 0);
+
+    deep_arg_t arg = { .result = -1 };
+    assert(coroutine_start(&runner, &arg.coroutine, deep_run, &arg, 0) == 0);
+    assert(coroutine_join(&arg.coroutine) == 0);
+    assert(arg.result == 100 * 101 / 2);
+
+    assert(coroutine_start(&runner, NULL, deep_run, &arg, 0) == -1);
+    assert(coroutine_start(&runner, &arg.coroutine, NULL, &arg, 0) == -1);
+    coroutine_runner_destroy(&runner);
+    printf("Stack test passed\n");
+}
+
+int main() { // main test runner
+    printf("Starting Coroutine Unit Tests...\n");
+
+    test_yield_order();
+    test_park_and_wake();
+    test_many();
+    test_stack();
+
+    printf("\n All coroutine tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Length-prefixed record framing (--framing=lenprefix)
+ * Every frame starts with an unsigned LEB128 varint header h. An even h is a data record,
+ * followed by h / 2 payload bytes taken as they are (newlines and NUL bytes included).
+ * Odd headers are control frames without payload: h == 1 ends the stream, h == 3 asks the
+ * pipeline to flush what it holds and h == 5 is a checkpoint. Other odd headers are
+ * reserved and rejected.
+ */
+
+#define FRAME_HEADER_MAX 10                          /* bytes of the longest 64-bit varint */
+#define FRAME_END_OF_STREAM 1                        /* header of the end-of-stream frame */
+#define FRAME_FLUSH 3                                /* header of the flush frame */
+#define FRAME_CHECKPOINT 5                           /* header of the checkpoint frame */
+
+typedef enum {
+    FRAMING_LINES = 0,               /* newline-delimited text, the default */
+    FRAMING_LENPREFIX = 1            /* varint length + payload frames */
+} framing_t;
+
+/**
+ * Encode a frame header
+ * @param out Receives the header, at least FRAME_HEADER_MAX bytes
+ * @param header The header value, 2 * payload length for a data record
+ * @return Number of bytes written
+ */
+static inline size_t frame_encode_header(unsigned char* out, uint64_t header) {
+    size_t used = 0;
+    while (header >= 0x80) {
+        out[used++] = (unsigned char)(header | 0x80);
+        header >>= 7;
+    }
+    out[used++] = (unsigned char)header;
+    return used;
+}
+
+/**
+ * Decode a frame header
+ * @param in Bytes available
+ * @param avail Number of bytes available
+ * @param header Receives the header value
+ * @param used Receives the number of header bytes
+ * @return 1 when decoded, 0 if more bytes are needed, -1 if the header is malformed
+ */
+static inline int frame_decode_header(const unsigned char* in, size_t avail, uint64_t* header, size_t* used) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < avail && i < FRAME_HEADER_MAX; i++) {
+        if (i == FRAME_HEADER_MAX - 1 && in[i] > 1) {
+            return -1; // more than 64 bits
+        }
+        value |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *header = value;
+            *used = i + 1;
+            return 1;
+        }
+    }
+    return avail >= FRAME_HEADER_MAX ? -1 : 0;
+}
+
+#endif // FRAMING_H
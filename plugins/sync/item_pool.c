@@ -0,0 +1,247 @@
+#include "item_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ITEM_POOL_LARGE -1 // class of blocks that bypass the size classes
+
+typedef struct { // prefix of every pooled block, keeps the payload 16 byte aligned
+    item_pool_t* pool;               /* pool owning the block */
+    intptr_t size_class;             /* class index, ITEM_POOL_LARGE for malloc'd blocks */
+} item_block_header_t;
+
+typedef struct { // per thread cache, bound to one pool at a time
+    item_pool_t* pool;
+    void* head[ITEM_POOL_NUM_CLASSES];
+    int count[ITEM_POOL_NUM_CLASSES];
+} item_thread_cache_t;
+
+static _Thread_local item_thread_cache_t tls_cache;
+
+static inline void** block_next(void* payload) { // free blocks are linked through their payload
+    return (void**)payload;
+}
+
+static inline item_block_header_t* block_header(void* payload) { // header sits right before the payload
+    return (item_block_header_t*)payload - 1;
+}
+
+static int size_to_class(size_t size) { // smallest class that fits size, -1 if too large
+    if (size > ITEM_POOL_MAX_BLOCK) {
+        return ITEM_POOL_LARGE;
+    }
+    int size_class = 0;
+    size_t class_size = (size_t)1 << ITEM_POOL_MIN_SHIFT;
+    while (class_size < size) {
+        class_size <<= 1;
+        size_class++;
+    }
+    return size_class;
+}
+
+static inline size_t class_size(int size_class) { // payload bytes of a class
+    return (size_t)1 << (ITEM_POOL_MIN_SHIFT + size_class);
+}
+
+static int cache_limit(int size_class) { // blocks a thread may keep for a class
+    size_t limit = ITEM_POOL_CACHE_BYTES / class_size(size_class);
+    if (limit < 4) limit = 4;
+    if (limit > 64) limit = 64;
+    return (int)limit;
+}
+
+static void depot_push(item_pool_t* pool, int size_class, void* list) { // give a chain of blocks back
+    item_pool_depot_t* depot = &pool->depots[size_class];
+    size_t depot_limit = ITEM_POOL_DEPOT_BYTES / class_size(size_class);
+
+    pthread_mutex_lock(&depot->mutex);
+    while (list && depot->free_count < depot_limit) { // keep what fits in the depot budget
+        void* next = *block_next(list);
+        *block_next(list) = depot->free_list;
+        depot->free_list = list;
+        depot->free_count++;
+        list = next;
+    }
+    pthread_mutex_unlock(&depot->mutex);
+
+    while (list) { // the rest goes back to the system
+        void* next = *block_next(list);
+        free(block_header(list));
+        atomic_fetch_add_explicit(&pool->system_frees, 1, memory_order_relaxed);
+        list = next;
+    }
+}
+
+static void cache_flush_class(int size_class, int keep) { // move all but keep cached blocks to the depot
+    item_thread_cache_t* cache = &tls_cache;
+    if (cache->count[size_class] <= keep) {
+        return;
+    }
+
+    void* list = cache->head[size_class];
+    int moved = cache->count[size_class] - keep;
+    void* last = list;
+    for (int i = 1; i < moved; i++) {
+        last = *block_next(last);
+    }
+    cache->head[size_class] = *block_next(last);
+    cache->count[size_class] = keep;
+    *block_next(last) = NULL;
+
+    depot_push(cache->pool, size_class, list);
+}
+
+static void cache_bind(item_pool_t* pool) { // switch the calling thread's cache to another pool
+    if (tls_cache.pool == pool) {
+        return;
+    }
+    item_pool_thread_flush();
+    tls_cache.pool = pool;
+}
+
+static void cache_refill(item_pool_t* pool, int size_class) { // pull half a cache worth from the depot
+    item_pool_depot_t* depot = &pool->depots[size_class];
+    int wanted = cache_limit(size_class) / 2;
+
+    pthread_mutex_lock(&depot->mutex);
+    while (depot->free_list && wanted > 0) {
+        void* block = depot->free_list;
+        depot->free_list = *block_next(block);
+        depot->free_count--;
+        *block_next(block) = tls_cache.head[size_class];
+        tls_cache.head[size_class] = block;
+        tls_cache.count[size_class]++;
+        wanted--;
+    }
+    pthread_mutex_unlock(&depot->mutex);
+}
+
+int item_pool_init(item_pool_t* pool) { // initialize pool
+    if (!pool) {
+        return -1;
+    }
+
+    for (int i = 0; i < ITEM_POOL_NUM_CLASSES; i++) {
+        if (pthread_mutex_init(&pool->depots[i].mutex, NULL) != 0) {
+            for (int j = 0; j < i; j++) {
+                pthread_mutex_destroy(&pool->depots[j].mutex);
+            }
+            return -1;
+        }
+        pool->depots[i].free_list = NULL;
+        pool->depots[i].free_count = 0;
+    }
+    atomic_init(&pool->system_allocs, 0);
+    atomic_init(&pool->system_frees, 0);
+
+    return 0;
+}
+
+void item_pool_destroy(item_pool_t* pool) { // release the depots
+    if (!pool) {
+        return;
+    }
+
+    if (tls_cache.pool == pool) { // the destroying thread's own cache
+        item_pool_thread_flush();
+    }
+
+    for (int i = 0; i < ITEM_POOL_NUM_CLASSES; i++) {
+        item_pool_depot_t* depot = &pool->depots[i];
+        while (depot->free_list) {
+            void* next = *block_next(depot->free_list);
+            free(block_header(depot->free_list));
+            depot->free_list = next;
+        }
+        depot->free_count = 0;
+        pthread_mutex_destroy(&depot->mutex);
+    }
+}
+
+void* item_pool_alloc(item_pool_t* pool, size_t size) { // allocate a buffer
+    if (!pool) {
+        return malloc(size);
+    }
+
+    int size_class = size_to_class(size);
+    if (size_class == ITEM_POOL_LARGE) { // too large to pool
+        item_block_header_t* header = (item_block_header_t*)malloc(sizeof(item_block_header_t) + size);
+        if (!header) {
+            return NULL;
+        }
+        header->pool = pool;
+        header->size_class = ITEM_POOL_LARGE;
+        return header + 1;
+    }
+
+    cache_bind(pool);
+    if (!tls_cache.head[size_class]) { // cache miss, try the shared depot
+        cache_refill(pool, size_class);
+    }
+
+    void* block = tls_cache.head[size_class];
+    if (block) { // fast path, no locks and no system calls
+        tls_cache.head[size_class] = *block_next(block);
+        tls_cache.count[size_class]--;
+        return block;
+    }
+
+    // pool is cold, get a fresh block from the system
+    item_block_header_t* header = (item_block_header_t*)malloc(sizeof(item_block_header_t) + class_size(size_class));
+    if (!header) {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&pool->system_allocs, 1, memory_order_relaxed);
+    header->pool = pool;
+    header->size_class = size_class;
+    return header + 1;
+}
+
+char* item_pool_strdup(item_pool_t* pool, const char* str) { // copy a string into a pooled buffer
+    if (!str) {
+        return NULL;
+    }
+    size_t len = strlen(str);
+    char* copy = (char*)item_pool_alloc(pool, len + 1);
+    if (copy) {
+        memcpy(copy, str, len + 1);
+    }
+    return copy;
+}
+
+void item_pool_free(item_pool_t* pool, void* ptr) { // release a buffer
+    if (!ptr) {
+        return;
+    }
+    if (!pool) {
+        free(ptr);
+        return;
+    }
+
+    item_block_header_t* header = block_header(ptr);
+    if (header->size_class == ITEM_POOL_LARGE) {
+        free(header);
+        return;
+    }
+
+    // blocks go back to the pool that allocated them
+    int size_class = (int)header->size_class;
+    cache_bind(header->pool);
+    *block_next(ptr) = tls_cache.head[size_class];
+    tls_cache.head[size_class] = ptr;
+    tls_cache.count[size_class]++;
+
+    if (tls_cache.count[size_class] > cache_limit(size_class)) { // overflow, share half with other threads
+        cache_flush_class(size_class, cache_limit(size_class) / 2);
+    }
+}
+
+void item_pool_thread_flush(void) { // hand all cached blocks back to the depots
+    if (!tls_cache.pool) {
+        return;
+    }
+    for (int i = 0; i < ITEM_POOL_NUM_CLASSES; i++) {
+        cache_flush_class(i, 0);
+    }
+    tls_cache.pool = NULL;
+}
@@ -0,0 +1,78 @@
+#ifndef ITEM_POOL_H
+#define ITEM_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/**
+ * Pooled allocator for work item buffers
+ * Blocks are grouped in power-of-two size classes. Every thread keeps a small cache
+ * per class and exchanges blocks with the pool's shared depot in bulk, so a pipeline
+ * that frees about as much as it allocates stops calling malloc/free once warm.
+ * Every block carries a header naming its pool and class, so a block can be freed
+ * by any thread (and from any plugin sharing the pool) without knowing its size.
+ */
+
+#define ITEM_POOL_MIN_SHIFT 5                        /* smallest class holds 32 bytes */
+#define ITEM_POOL_NUM_CLASSES 12                     /* 32 bytes .. 64 KB, larger blocks go to malloc */
+#define ITEM_POOL_MAX_BLOCK ((size_t)1 << (ITEM_POOL_MIN_SHIFT + ITEM_POOL_NUM_CLASSES - 1))
+#define ITEM_POOL_CACHE_BYTES (256 * 1024)           /* per thread, per class cache budget */
+#define ITEM_POOL_DEPOT_BYTES (4 * 1024 * 1024)      /* per class depot budget */
+
+typedef struct { // shared free list of one size class
+    pthread_mutex_t mutex;           /* protects free_list and free_count */
+    void* free_list;                 /* singly linked through the block payload */
+    size_t free_count;               /* number of blocks in free_list */
+} item_pool_depot_t;
+
+typedef struct item_pool {
+    item_pool_depot_t depots[ITEM_POOL_NUM_CLASSES]; /* one depot per size class */
+    atomic_size_t system_allocs;     /* blocks obtained from malloc (statistics) */
+    atomic_size_t system_frees;      /* blocks returned to free (statistics) */
+} item_pool_t;
+
+/**
+ * Initialize a pool
+ * @param pool Pointer to pool structure
+ * @return 0 on success, -1 on failure
+ */
+int item_pool_init(item_pool_t* pool);
+
+/**
+ * Destroy a pool and release every block kept in its depots
+ * Blocks still cached by running threads should be flushed first (item_pool_thread_flush)
+ * @param pool Pointer to pool structure
+ */
+void item_pool_destroy(item_pool_t* pool);
+
+/**
+ * Allocate a buffer of at least size bytes
+ * @param pool Pool to allocate from, NULL to use plain malloc
+ * @param size Number of bytes needed
+ * @return Pointer to the buffer, NULL on failure
+ */
+void* item_pool_alloc(item_pool_t* pool, size_t size);
+
+/**
+ * Allocate a copy of a NUL terminated string
+ * @param pool Pool to allocate from, NULL to use plain malloc
+ * @param str String to copy
+ * @return Pointer to the copy, NULL on failure
+ */
+char* item_pool_strdup(item_pool_t* pool, const char* str);
+
+/**
+ * Release a buffer obtained from item_pool_alloc/item_pool_strdup
+ * @param pool Pool the buffer was allocated from (NULL if it came from malloc)
+ * @param ptr Buffer to release, NULL is ignored
+ */
+void item_pool_free(item_pool_t* pool, void* ptr);
+
+/**
+ * Return every block cached by the calling thread to its pool's depots
+ * Call before a thread that used the pool exits
+ */
+void item_pool_thread_flush(void);
+
+#endif // ITEM_POOL_H
@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include "sync/item_pool.h"
+#include "sync/consumer_producer.h"
+
+#define PIPE_ITEMS 20000
+
+void test_reuse() { // a freed block is handed out again
+    printf("\n=== Test 1: Block Reuse ===\n");
+
+    item_pool_t pool;
+    assert(item_pool_init(&pool) == 0);
+
+    char* first = item_pool_strdup(&pool, "hello");
+    assert(first != NULL && strcmp(first, "hello") == 0);
+    item_pool_free(&pool, first);
+
+    // same size class, served from the thread cache
+    char* second = (char*)item_pool_alloc(&pool, 6);
+    assert(second == first);
+    item_pool_free(&pool, second);
+    assert(atomic_load(&pool.system_allocs) == 1);
+
+    item_pool_destroy(&pool);
+    printf("Block reuse test passed\n");
+}
+
+void test_large_and_null_pool() { // oversized blocks and the malloc fallback
+    printf("\n=== Test 2: Large Blocks and NULL Pool ===\n");
+
+    item_pool_t pool;
+    assert(item_pool_init(&pool) == 0);
+
+    char* large = (char*)item_pool_alloc(&pool, ITEM_POOL_MAX_BLOCK + 1);
+    assert(large != NULL);
+    memset(large, 'x', ITEM_POOL_MAX_BLOCK + 1);
+    item_pool_free(&pool, large);
+
+    char* plain = item_pool_strdup(NULL, "plain");
+    assert(plain != NULL && strcmp(plain, "plain") == 0);
+    item_pool_free(NULL, plain);
+
+    item_pool_destroy(&pool);
+    printf("Large blocks and NULL pool test passed\n");
+}
+
+void* pipe_consumer(void* arg) { // frees what the producer allocated, like the last plugin
+    consumer_producer_t* queue = (consumer_producer_t*)arg;
+    for (int i = 0; i < PIPE_ITEMS; i++) {
+        char* item = consumer_producer_get(queue);
+        assert(item != NULL);
+        item_pool_free(queue->pool, item);
+    }
+    item_pool_thread_flush();
+    return NULL;
+}
+
+void test_cross_thread_steady_state() { // blocks recycle from the consumer back to the producer
+    printf("\n=== Test 3: Cross Thread Steady State ===\n");
+
+    item_pool_t pool;
+    assert(item_pool_init(&pool) == 0);
+    consumer_producer_t queue;
+    assert(consumer_producer_init_mode(&queue, 16, CONSUMER_PRODUCER_SPSC) == NULL);
+    consumer_producer_set_pool(&queue, &pool);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, pipe_consumer, &queue);
+    for (int i = 0; i < PIPE_ITEMS; i++) {
+        char* item = item_pool_strdup(&pool, "some line of input");
+        assert(item != NULL);
+        assert(consumer_producer_put_owned(&queue, item) == NULL);
+    }
+    pthread_join(consumer, NULL);
+
+    // only the warm-up touched malloc, far fewer than one block per item
+    size_t allocs = atomic_load(&pool.system_allocs);
+    printf("system allocations for %d items: %zu\n", PIPE_ITEMS, allocs);
+    assert(allocs < PIPE_ITEMS / 10);
+
+    consumer_producer_destroy(&queue);
+    item_pool_destroy(&pool);
+    printf("Cross thread steady state test passed\n");
+}
+
+int main() { // main test runner
+    printf("Starting Item Pool Unit Tests...\n");
+
+    test_reuse();
+    test_large_and_null_pool();
+    test_cross_thread_steady_state();
+
+    printf("\n All item pool tests passed!\n");
+    return 0;
+}
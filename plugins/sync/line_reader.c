@@ -0,0 +1,230 @@
+#define _DEFAULT_SOURCE // madvise and MADV_DONTNEED, posix_madvise cannot drop pages
+#include "line_reader.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* find_newline(line_reader_t* reader) { // '\n' in the unscanned bytes, remembered across reads
+    const char* from = reader->buffer + reader->start + reader->scanned;
+    const char* newline = memchr(from, '\n', reader->end - reader->start - reader->scanned);
+    reader->scanned = newline ? (size_t)(newline - (reader->buffer + reader->start)) : reader->end - reader->start;
+    return newline;
+}
+
+static int fill(line_reader_t* reader) { // read another block, 0 at end of input
+    if (reader->start > 0 && reader->end - reader->start < reader->capacity / 2) { // keep the partial line, drop the rest
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->capacity - reader->end < reader->block) { // a long line, make room for another block
+        size_t capacity = reader->capacity * 2;
+        while (capacity - (reader->end - reader->start) < reader->block) capacity *= 2;
+        char* buffer = malloc(capacity);
+        if (!buffer) {
+            return -1;
+        }
+        memcpy(buffer, reader->buffer + reader->start, reader->end - reader->start);
+        free(reader->buffer);
+        reader->buffer = buffer;
+        reader->capacity = capacity;
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    ssize_t got;
+    do {
+        got = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) {
+        return -1;
+    }
+    if (got == 0) {
+        reader->eof = 1;
+        return 0;
+    }
+    reader->end += (size_t)got;
+    reader->bytes_read += (unsigned long long)got;
+    return 1;
+}
+
+int line_reader_init(line_reader_t* reader, int fd, size_t block) { // Initialize a reader
+    if (!reader || fd < 0) {
+        return -1;
+    }
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->block = block > 0 ? block : LINE_READER_BLOCK;
+    reader->capacity = reader->block * 2; // a block plus the partial line carried over
+    reader->buffer = malloc(reader->capacity);
+    return reader->buffer ? 0 : -1;
+}
+
+int line_reader_init_mapped(line_reader_t* reader, int fd) { // Initialize a reader over a file mapping
+    if (!reader || fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || (unsigned long long)st.st_size > SIZE_MAX) {
+        return line_reader_init(reader, fd, 0); // nothing to map, read it instead
+    }
+    void* mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return line_reader_init(reader, fd, 0);
+    }
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->buffer = mapping;
+    reader->capacity = (size_t)st.st_size;
+    reader->end = reader->capacity;
+    reader->eof = 1; // every byte is already in the buffer
+    reader->mapped = 1;
+    reader->bytes_read = (unsigned long long)reader->capacity;
+    madvise(mapping, reader->capacity, MADV_SEQUENTIAL); // aggressive readahead, pages behind are reclaimed first
+    reader->advised = reader->capacity < LINE_READER_WINDOW ? reader->capacity : LINE_READER_WINDOW;
+    madvise(mapping, reader->advised, MADV_WILLNEED);
+    return 0;
+}
+
+static void advise_window(line_reader_t* reader) { // keep a window read ahead, drop what was handed out
+    if (reader->start + LINE_READER_WINDOW / 2 < reader->advised || reader->advised == reader->capacity) {
+        return;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t from = reader->advised & ~(page - 1);
+    size_t to = reader->advised + LINE_READER_WINDOW < reader->capacity ? reader->advised + LINE_READER_WINDOW : reader->capacity;
+    madvise(reader->buffer + from, to - from, MADV_WILLNEED);
+    reader->advised = to;
+
+    // lines handed out are copied by the caller before the next call, a window behind
+    // the reader is safe to give back (the file stays in the page cache)
+    size_t done = reader->start > LINE_READER_WINDOW ? (reader->start - LINE_READER_WINDOW) & ~(page - 1) : 0;
+    if (done > 0) {
+        madvise(reader->buffer, done, MADV_DONTNEED);
+    }
+}
+
+void line_reader_set_framing(line_reader_t* reader, framing_t framing) { // Lines or frames
+    if (reader) {
+        reader->framing = framing;
+    }
+}
+
+static int frame_buffered(line_reader_t* reader, uint64_t* header, size_t* used) { // 1 complete, 0 partial, -1 malformed
+    int decoded = frame_decode_header((const unsigned char*)reader->buffer + reader->start, reader->end - reader->start,
+                                      header, used);
+    if (decoded <= 0) {
+        return decoded;
+    }
+    if (*header == FRAME_END_OF_STREAM || *header == FRAME_FLUSH || *header == FRAME_CHECKPOINT) {
+        return 1;
+    }
+    if (*header & 1) { // reserved control frame
+        return -1;
+    }
+    return (*header >> 1) <= reader->end - reader->start - *used ? 1 : 0;
+}
+
+static int next_frame(line_reader_t* reader, const char** line, size_t* len) { // records cut at their length
+    for (;;) {
+        uint64_t header = 0;
+        size_t used = 0;
+        int buffered = frame_buffered(reader, &header, &used);
+        if (buffered < 0) {
+            errno = EBADMSG;
+            return -1;
+        }
+        if (buffered > 0 && header == FRAME_END_OF_STREAM) {
+            reader->start += used;
+            reader->end_frame = 1;
+            return 0;
+        }
+        if (buffered > 0 && (header & 1)) { // flush or checkpoint, no payload
+            reader->start += used;
+            reader->control = header;
+            *line = NULL;
+            *len = 0;
+            return 2;
+        }
+        if (buffered > 0) {
+            *line = reader->buffer + reader->start + used;
+            *len = (size_t)(header >> 1);
+            reader->start += used + *len;
+            return 1;
+        }
+        if (reader->eof) {
+            if (reader->start == reader->end) {
+                return 0;
+            }
+            errno = EBADMSG; // the input stops inside a frame
+            return -1;
+        }
+        if (fill(reader) < 0) {
+            return -1;
+        }
+    }
+}
+
+int line_reader_next(line_reader_t* reader, const char** line, size_t* len) { // Next line, in place
+    if (!reader || !reader->buffer || !line || !len) {
+        return -1;
+    }
+    if (reader->mapped) {
+        advise_window(reader);
+    }
+    if (reader->framing == FRAMING_LENPREFIX) {
+        return reader->end_frame ? 0 : next_frame(reader, line, len);
+    }
+    for (;;) {
+        const char* newline = find_newline(reader);
+        if (newline) {
+            *line = reader->buffer + reader->start;
+            *len = (size_t)(newline - *line);
+            reader->start += *len + 1;
+            reader->scanned = 0;
+            return 1;
+        }
+        if (reader->eof) {
+            if (reader->start == reader->end) {
+                return 0;
+            }
+            *line = reader->buffer + reader->start; // last line without a '\n'
+            *len = reader->end - reader->start;
+            reader->start = reader->end;
+            reader->scanned = 0;
+            return 1;
+        }
+        if (fill(reader) < 0) {
+            return -1;
+        }
+    }
+}
+
+int line_reader_ready(line_reader_t* reader) { // a line is buffered
+    if (!reader || !reader->buffer) {
+        return 0;
+    }
+    if (reader->framing == FRAMING_LENPREFIX) {
+        uint64_t header;
+        size_t used;
+        return reader->eof || reader->end_frame || frame_buffered(reader, &header, &used) != 0;
+    }
+    return reader->eof || find_newline(reader) != NULL;
+}
+
+void line_reader_destroy(line_reader_t* reader) { // Release the buffer
+    if (!reader) {
+        return;
+    }
+    if (reader->mapped) {
+        munmap(reader->buffer, reader->capacity);
+    } else {
+        free(reader->buffer);
+    }
+    reader->buffer = NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stddef.h>
+#include "framing.h"
+
+/**
+ * Block line reader
+ * Input is read with read() a large block at a time and cut into lines with memchr, so a
+ * line costs one vectorized scan of its bytes and no system call of its own. Lines are
+ * handed out in place, pointing into the block. A line longer than the block grows the
+ * buffer, so lines may be of any length. Lines end at '\n', which is not included. The
+ * last line may lack one, and lines may contain NUL bytes.
+ * A regular file can be mapped instead: lines then point straight into the mapping, with
+ * no read() copy at all. The kernel is told the access is sequential, the next window is
+ * asked for ahead of the reader and the pages behind it are dropped from the mapping.
+ * With FRAMING_LENPREFIX the input is a sequence of frames (see framing.h) instead of
+ * lines: records are cut at their length, nothing is scanned.
+ */
+
+#define LINE_READER_BLOCK (64 * 1024)                /* default read size */
+#define LINE_READER_WINDOW (8 * 1024 * 1024)         /* readahead and release step of a mapping */
+
+typedef struct {
+    int fd;                          /* descriptor read from */
+    char* buffer;
+    size_t capacity;                 /* bytes allocated, grows for long lines */
+    size_t block;                    /* bytes asked for per read() */
+    size_t start;                    /* first byte not handed out yet */
+    size_t end;                      /* end of the bytes read */
+    size_t scanned;                  /* bytes from start known to hold no '\n' */
+    int eof;                         /* read() returned 0, or the whole file is mapped */
+    int mapped;                      /* buffer is a read-only mapping of the file */
+    framing_t framing;               /* lines or length-prefixed frames */
+    int end_frame;                   /* the end-of-stream frame was read */
+    unsigned long long control;      /* header of the control frame returned last (FRAME_FLUSH, FRAME_CHECKPOINT) */
+    size_t advised;                  /* mapped bytes up to which readahead was asked for */
+    unsigned long long bytes_read;   /* total read (statistics) */
+} line_reader_t;
+
+/**
+ * Initialize a reader
+ * @param reader Pointer to reader structure
+ * @param fd Descriptor to read from
+ * @param block Bytes per read() call, 0 for LINE_READER_BLOCK
+ * @return 0 on success, -1 on failure
+ */
+int line_reader_init(line_reader_t* reader, int fd, size_t block);
+
+/**
+ * Initialize a reader over a mapping of a regular file
+ * Falls back to block reads (as line_reader_init) for a descriptor that cannot be mapped,
+ * such as a pipe or an empty file. The file must not shrink while it is mapped
+ * @param reader Pointer to reader structure
+ * @param fd Descriptor of the file, read from its start, kept open until the reader is destroyed
+ * @return 0 on success, -1 on failure
+ */
+int line_reader_init_mapped(line_reader_t* reader, int fd);
+
+/**
+ * Select how the input is cut into records, lines unless set
+ * @param reader The reader
+ * @param framing FRAMING_LINES or FRAMING_LENPREFIX
+ */
+void line_reader_set_framing(line_reader_t* reader, framing_t framing);
+
+/**
+ * Get the next line (or frame payload)
+ * Blocks in read() when no complete line is buffered
+ * @param reader The reader
+ * @param line Receives the line, valid until the next call
+ * @param len Receives the line length, without the '\n'
+ * @return 1 for a line, 2 for a flush or checkpoint frame (its header is in control, line is
+ *         NULL), 0 at end of input or after the end-of-stream frame (end_frame is then set),
+ *         -1 on a read or allocation failure, or with errno EBADMSG on a malformed or
+ *         truncated frame
+ */
+int line_reader_next(line_reader_t* reader, const char** line, size_t* len);
+
+/**
+ * Check whether line_reader_next can answer without reading
+ * @param reader The reader
+ * @return 1 if a complete line or frame (or the end of input) is buffered, 0 otherwise
+ */
+int line_reader_ready(line_reader_t* reader);
+
+/**
+ * Release the reader's buffer or mapping (the descriptor stays open)
+ * @param reader The reader
+ */
+void line_reader_destroy(line_reader_t* reader);
+
+#endif // LINE_READER_H
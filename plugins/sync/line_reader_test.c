@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "sync/line_reader.h"
+
+static int input_fd(const char* data, size_t size) { // a file holding data, positioned at its start
+    char path[] = "/tmp/line_reader_testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+    assert(write(fd, data, size) == (ssize_t)size);
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    return fd;
+}
+
+static void expect_line(line_reader_t* reader, const char* expected, size_t expected_len) {
+    const char* line;
+    size_t len;
+    assert(line_reader_next(reader, &line, &len) == 1);
+    assert(len == expected_len && memcmp(line, expected, len) == 0);
+}
+
+void test_basic_lines() { // empty lines, a missing final newline and NUL bytes
+    printf("\n=== Test 1: Basic Lines ===\n");
+
+    static const char data[] = "hello\n\nwith\0nul\r\nlast";
+    int fd = input_fd(data, sizeof(data) - 1);
+    line_reader_t reader;
+    assert(line_reader_init(&reader, fd, 4) == 0); // tiny blocks, lines span reads
+
+    expect_line(&reader, "hello", 5);
+    expect_line(&reader, "", 0);
+    expect_line(&reader, "with\0nul\r", 9);
+    expect_line(&reader, "last", 4);
+    const char* line;
+    size_t len;
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    assert(line_reader_ready(&reader) == 1);
+
+    line_reader_destroy(&reader);
+    close(fd);
+    printf("Basic lines test passed\n");
+}
+
+void test_long_lines() { // lines many times the block size grow the buffer
+    printf("\n=== Test 2: Long Lines ===\n");
+
+    size_t long_len = 1000000;
+    char* data = malloc(long_len * 2 + 16);
+    assert(data != NULL);
+    memset(data, 'a', long_len);
+    memcpy(data + long_len, "\nshort\n", 7);
+    memset(data + long_len + 7, 'b', long_len);
+    int fd = input_fd(data, long_len * 2 + 7);
+
+    line_reader_t reader;
+    assert(line_reader_init(&reader, fd, 1024) == 0);
+    const char* line;
+    size_t len;
+    assert(line_reader_next(&reader, &line, &len) == 1);
+    assert(len == long_len && line[0] == 'a' && line[len - 1] == 'a');
+    expect_line(&reader, "short", 5);
+    assert(line_reader_next(&reader, &line, &len) == 1);
+    assert(len == long_len && line[0] == 'b' && line[len - 1] == 'b');
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    assert(reader.bytes_read == long_len * 2 + 7);
+
+    line_reader_destroy(&reader);
+    close(fd);
+    free(data);
+    printf("Long lines test passed\n");
+}
+
+void test_ready_on_pipe() { // ready only when a whole line is buffered
+    printf("\n=== Test 3: Ready on a Pipe ===\n");
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    line_reader_t reader;
+    assert(line_reader_init(&reader, fds[0], 0) == 0);
+    assert(line_reader_ready(&reader) == 0);
+
+    assert(write(fds[1], "one\ntw", 6) == 6);
+    expect_line(&reader, "one", 3);
+    assert(line_reader_ready(&reader) == 0); // "tw" is not a line yet
+    assert(write(fds[1], "o\nthree\n", 8) == 8);
+    expect_line(&reader, "two", 3);
+    assert(line_reader_ready(&reader) == 1);
+    expect_line(&reader, "three", 5);
+
+    close(fds[1]);
+    const char* line;
+    size_t len;
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    line_reader_destroy(&reader);
+    close(fds[0]);
+    printf("Ready on a pipe test passed\n");
+}
+
+void test_mapped_file() { // lines point into the mapping, pipes and empty files fall back to reads
+    printf("\n=== Test 4: Mapped File ===\n");
+
+    static const char data[] = "first\n\nwith\0nul\nlast";
+    int fd = input_fd(data, sizeof(data) - 1);
+    line_reader_t reader;
+    assert(line_reader_init_mapped(&reader, fd) == 0);
+    assert(reader.mapped == 1);
+    assert(line_reader_ready(&reader) == 1);
+    expect_line(&reader, "first", 5);
+    expect_line(&reader, "", 0);
+    expect_line(&reader, "with\0nul", 8);
+    expect_line(&reader, "last", 4);
+    const char* line;
+    size_t len;
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    line_reader_destroy(&reader);
+    close(fd);
+
+    fd = input_fd("", 0);
+    assert(line_reader_init_mapped(&reader, fd) == 0);
+    assert(reader.mapped == 0);
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    line_reader_destroy(&reader);
+    close(fd);
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(line_reader_init_mapped(&reader, fds[0]) == 0);
+    assert(reader.mapped == 0);
+    assert(write(fds[1], "piped\n", 6) == 6);
+    close(fds[1]);
+    expect_line(&reader, "piped", 5);
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    line_reader_destroy(&reader);
+    close(fds[0]);
+    printf("Mapped file test passed\n");
+}
+
+void test_frames() { // records cut at their varint length, the end frame stops the stream
+    printf("\n=== Test 5: Length-Prefixed Frames ===\n");
+
+    char data[400];
+    size_t size = 0;
+    data[size++] = 0x0A; // "hello"
+    memcpy(data + size, "hello", 5);
+    size += 5;
+    data[size++] = 0x00; // empty record
+    data[size++] = (char)0xD8; // 300 bytes, two byte header
+    data[size++] = 0x04;
+    memset(data + size, 'x', 300);
+    data[size + 150] = '\n';
+    size += 300;
+    data[size++] = 0x01; // end of stream
+    data[size++] = 0x0A; // ignored after the end frame
+
+    int fd = input_fd(data, size);
+    line_reader_t reader;
+    assert(line_reader_init(&reader, fd, 16) == 0); // frames span reads
+    line_reader_set_framing(&reader, FRAMING_LENPREFIX);
+    expect_line(&reader, "hello", 5);
+    expect_line(&reader, "", 0);
+    const char* line;
+    size_t len;
+    assert(line_reader_next(&reader, &line, &len) == 1);
+    assert(len == 300 && line[0] == 'x' && line[150] == '\n');
+    assert(line_reader_next(&reader, &line, &len) == 0);
+    assert(reader.end_frame == 1);
+    line_reader_destroy(&reader);
+    close(fd);
+
+    static const char control[] = "\x0ahello\x03\x05\x07";
+    fd = input_fd(control, sizeof(control) - 1);
+    assert(line_reader_init_mapped(&reader, fd) == 0);
+    line_reader_set_framing(&reader, FRAMING_LENPREFIX);
+    expect_line(&reader, "hello", 5);
+    assert(line_reader_next(&reader, &line, &len) == 2 && reader.control == FRAME_FLUSH && len == 0);
+    assert(line_reader_next(&reader, &line, &len) == 2 && reader.control == FRAME_CHECKPOINT);
+    assert(line_reader_next(&reader, &line, &len) == -1); // reserved
+    line_reader_destroy(&reader);
+    close(fd);
+
+    static const char truncated[] = "\x0ahel";
+    fd = input_fd(truncated, sizeof(truncated) - 1);
+    assert(line_reader_init(&reader, fd, 0) == 0);
+    line_reader_set_framing(&reader, FRAMING_LENPREFIX);
+    assert(line_reader_next(&reader, &line, &len) == -1);
+    line_reader_destroy(&reader);
+    close(fd);
+
+    unsigned char header[FRAME_HEADER_MAX];
+    uint64_t value;
+    size_t used;
+    size_t written = frame_encode_header(header, UINT64_MAX);
+    assert(written == FRAME_HEADER_MAX);
+    assert(frame_decode_header(header, written, &value, &used) == 1 && value == UINT64_MAX && used == written);
+    assert(frame_decode_header(header, 3, &value, &used) == 0);
+    printf("Length-prefixed frames test passed\n");
+}
+
+int main() { // main test runner
+    printf("Starting Line Reader Unit Tests...\n");
+
+    test_basic_lines();
+    test_long_lines();
+    test_ready_on_pipe();
+    test_mapped_file();
+    test_frames();
+
+    printf("\n All line reader tests passed!\n");
+    return 0;
+}
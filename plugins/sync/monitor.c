@@ -1,5 +1,158 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // syscall() for the futex build
+#endif
 #include "monitor.h"
 #include <errno.h>
+#include <time.h>
+
+static void deadline_after(long timeout_ms, struct timespec* deadline) { // now + timeout_ms on CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+#if MONITOR_USE_FUTEX
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static int futex_wait(atomic_int* word, int expected, const struct timespec* timeout) { // sleep while *word == expected
+    return (int)syscall(SYS_futex, (int*)word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+}
+
+static void futex_wake_all(atomic_int* word) { // wake every thread sleeping on word
+    syscall(SYS_futex, (int*)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void) { // hint the core that we are busy-waiting
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static int spin_limit(void) { // spinning only helps if the signaler can run meanwhile
+    static atomic_int limit = -1;
+    int value = atomic_load_explicit(&limit, memory_order_relaxed);
+    if (value < 0) {
+        value = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? MONITOR_SPIN_LIMIT : 0;
+        atomic_store_explicit(&limit, value, memory_order_relaxed);
+    }
+    return value;
+}
+
+int monitor_init(monitor_t* monitor) { // initialize monitor
+    if (!monitor) {
+        return -1;
+    }
+
+    // initialize signaled state to false, nobody waits yet
+    atomic_init(&monitor->signaled, 0);
+    atomic_init(&monitor->waiters, 0);
+
+    return 0;
+}
+
+void monitor_destroy(monitor_t* monitor) { // destroy monitor
+    if (!monitor) {
+        return;
+    }
+
+    // a futex word holds no kernel resources
+    atomic_store(&monitor->signaled, 0);
+    atomic_store(&monitor->waiters, 0);
+}
+
+void monitor_signal(monitor_t* monitor) { // signal monitor
+    if (!monitor) {
+        return;
+    }
+
+    // set the signaled flag, only enter the kernel if it was clear and somebody parked.
+    // The exchange and the waiters increment are both seq_cst, so either the waiter
+    // sees the flag before parking or we see the waiter here.
+    if (atomic_exchange(&monitor->signaled, 1) == 0 && atomic_load(&monitor->waiters) > 0) {
+        futex_wake_all(&monitor->signaled);
+    }
+}
+
+void monitor_reset(monitor_t* monitor) { // reset monitor
+    if (!monitor) {
+        return;
+    }
+
+    atomic_store(&monitor->signaled, 0);
+}
+
+int monitor_wait(monitor_t* monitor) { // wait for signal
+    if (!monitor) {
+        return -1;
+    }
+
+    // spin briefly, a signal usually arrives within a few microseconds in a busy pipeline
+    int spins = spin_limit();
+    for (int i = 0; i < spins; i++) {
+        if (atomic_load_explicit(&monitor->signaled, memory_order_acquire)) {
+            return 0;
+        }
+        cpu_relax();
+    }
+
+    // park until the monitor is signaled
+    atomic_fetch_add(&monitor->waiters, 1);
+    while (!atomic_load(&monitor->signaled)) {
+        if (futex_wait(&monitor->signaled, 0, NULL) != 0 && errno != EAGAIN && errno != EINTR) {
+            atomic_fetch_sub(&monitor->waiters, 1);
+            return -1;
+        }
+    }
+    atomic_fetch_sub(&monitor->waiters, 1);
+    return 0;
+}
+
+int monitor_wait_timed(monitor_t* monitor, long timeout_ms) { // wait for signal, bounded
+    if (!monitor || timeout_ms < 0) {
+        return -1;
+    }
+    if (atomic_load_explicit(&monitor->signaled, memory_order_acquire)) {
+        return 0;
+    }
+
+    // FUTEX_WAIT takes a relative timeout, recomputed from the deadline after every wakeup
+    struct timespec deadline;
+    deadline_after(timeout_ms, &deadline);
+    atomic_fetch_add(&monitor->waiters, 1);
+    int result = 0;
+    while (!atomic_load(&monitor->signaled)) {
+        struct timespec now, left;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left.tv_sec = deadline.tv_sec - now.tv_sec;
+        left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (left.tv_nsec < 0) {
+            left.tv_sec--;
+            left.tv_nsec += 1000000000L;
+        }
+        if (left.tv_sec < 0) {
+            errno = ETIMEDOUT;
+            result = -1;
+            break;
+        }
+        if (futex_wait(&monitor->signaled, 0, &left) != 0 && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            result = -1;
+            break;
+        }
+    }
+    atomic_fetch_sub(&monitor->waiters, 1);
+    return result;
+}
+
+#else // mutex + condition variable monitor
 
 int monitor_init(monitor_t* monitor) { // initialize monitor
     if (!monitor) {
@@ -11,8 +164,13 @@ int monitor_init(monitor_t* monitor) { // initialize monitor
         return -1;
     }
 
-    // initialize condition variable
-    if (pthread_cond_init(&monitor->condition, NULL) != 0) {
+    // initialize condition variable, timed waits measure on CLOCK_MONOTONIC
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int cond_result = pthread_cond_init(&monitor->condition, &attr);
+    pthread_condattr_destroy(&attr);
+    if (cond_result != 0) {
         pthread_mutex_destroy(&monitor->mutex);
         return -1;
     }
@@ -75,4 +233,30 @@ int monitor_wait(monitor_t* monitor) { // wait for signal
     
     pthread_mutex_unlock(&monitor->mutex);
     return 0;
-}
\ No newline at end of file
+}
+
+int monitor_wait_timed(monitor_t* monitor, long timeout_ms) { // wait for signal, bounded
+    if (!monitor || timeout_ms < 0) {
+        return -1;
+    }
+
+    struct timespec deadline;
+    deadline_after(timeout_ms, &deadline);
+    pthread_mutex_lock(&monitor->mutex);
+
+    // wait until the monitor is signaled or the deadline passes
+    int result = 0;
+    while (!monitor->signaled && result == 0) {
+        result = pthread_cond_timedwait(&monitor->condition, &monitor->mutex, &deadline);
+    }
+    int signaled = monitor->signaled;
+
+    pthread_mutex_unlock(&monitor->mutex);
+    if (!signaled) {
+        errno = result;
+        return -1;
+    }
+    return 0;
+}
+
+#endif // MONITOR_USE_FUTEX
@@ -1,48 +1,81 @@
-#ifndef MONITOR_H
-#define MONITOR_H
-
-#include <pthread.h>
-
-/**
- * Monitor structure that can remember its state
- * This solves the race condition where signals sent before waiting are lost
- */
-typedef struct {
-    pthread_mutex_t mutex;      /* Mutex for thread safety */
-    pthread_cond_t condition;   /* Condition variable */
-    int signaled;              /* Flag to remember if monitor was signaled */
-} monitor_t;
-
-/**
- * Initialize a monitor
- * @param monitor Pointer to monitor structure
- * @return 0 on success, -1 on failure
- */
-int monitor_init(monitor_t* monitor);
-
-/**
- * Destroy a monitor and free its resources
- * @param monitor Pointer to monitor structure
- */
-void monitor_destroy(monitor_t* monitor);
-
-/**
- * Signal a monitor (sets the monitor state)
- * @param monitor Pointer to monitor structure
- */
-void monitor_signal(monitor_t* monitor);
-
-/**
- * Reset a monitor (clears the monitor state)
- * @param monitor Pointer to monitor structure
- */
-void monitor_reset(monitor_t* monitor);
-
-/**
- * Wait for a monitor to be signaled (infinite wait)
- * @param monitor Pointer to monitor structure
- * @return 0 on success, -1 on error
- */
-int monitor_wait(monitor_t* monitor);
-
-#endif // MONITOR_H
\ No newline at end of file
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Implementation selection: on Linux the monitor is built on a futex word, elsewhere
+ * (or with -DMONITOR_USE_FUTEX=0) it uses a mutex and a condition variable.
+ */
+#ifndef MONITOR_USE_FUTEX
+#if defined(__linux__)
+#define MONITOR_USE_FUTEX 1
+#else
+#define MONITOR_USE_FUTEX 0
+#endif
+#endif
+
+#define MONITOR_SPIN_LIMIT 200 /* polls of the signaled flag before parking (futex build, SMP only) */
+
+/**
+ * Monitor structure that can remember its state
+ * This solves the race condition where signals sent before waiting are lost
+ */
+#if MONITOR_USE_FUTEX
+typedef struct {
+    atomic_int signaled;        /* Futex word, 1 while the monitor is signaled */
+    atomic_int waiters;         /* Threads parked (or about to park) in the kernel */
+} monitor_t;
+#else
+typedef struct {
+    pthread_mutex_t mutex;      /* Mutex for thread safety */
+    pthread_cond_t condition;   /* Condition variable */
+    int signaled;              /* Flag to remember if monitor was signaled */
+} monitor_t;
+#endif
+
+/**
+ * Initialize a monitor
+ * @param monitor Pointer to monitor structure
+ * @return 0 on success, -1 on failure
+ */
+int monitor_init(monitor_t* monitor);
+
+/**
+ * Destroy a monitor and free its resources
+ * @param monitor Pointer to monitor structure
+ */
+void monitor_destroy(monitor_t* monitor);
+
+/**
+ * Signal a monitor (sets the monitor state)
+ * Wakes every waiting thread; the futex build skips the wake syscall when nobody waits
+ * @param monitor Pointer to monitor structure
+ */
+void monitor_signal(monitor_t* monitor);
+
+/**
+ * Reset a monitor (clears the monitor state)
+ * @param monitor Pointer to monitor structure
+ */
+void monitor_reset(monitor_t* monitor);
+
+/**
+ * Wait for a monitor to be signaled (infinite wait)
+ * The futex build spins briefly before parking in the kernel
+ * @param monitor Pointer to monitor structure
+ * @return 0 on success, -1 on error
+ */
+int monitor_wait(monitor_t* monitor);
+
+/**
+ * Wait for a monitor to be signaled, at most timeout_ms milliseconds
+ * Measured on CLOCK_MONOTONIC, so changes of the wall clock do not shorten or extend it
+ * @param monitor Pointer to monitor structure
+ * @param timeout_ms Longest wait in milliseconds, 0 only checks the state
+ * @return 0 when signaled, -1 on timeout (errno ETIMEDOUT) or error
+ */
+int monitor_wait_timed(monitor_t* monitor, long timeout_ms);
+
+#endif // MONITOR_H
@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <assert.h>
 #include <sched.h>
+#include <errno.h>
+#include <time.h>
 #include "sync/monitor.h"
 
 // test data structure
@@ -160,6 +162,48 @@ void test_reset_functionality() { // test reset functionality
     monitor_destroy(&monitor);
 }
 
+static long elapsed_ms(const struct timespec* start) { // milliseconds since start
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+void test_timed_wait() { // test the bounded wait
+    printf("\n=== Test 5: Timed Wait ===\n");
+
+    monitor_t monitor;
+    assert(monitor_init(&monitor) == 0);
+
+    // nobody signals: the wait gives up after the timeout
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    errno = 0;
+    assert(monitor_wait_timed(&monitor, 100) == -1);
+    assert(errno == ETIMEDOUT);
+    long waited = elapsed_ms(&start);
+    assert(waited >= 100 && waited < 2000);
+    assert(monitor_wait_timed(&monitor, 0) == -1); // only checks
+
+    // a signal already given is remembered
+    monitor_signal(&monitor);
+    assert(monitor_wait_timed(&monitor, 0) == 0);
+    monitor_reset(&monitor);
+
+    // a signal during the wait ends it early
+    int data = 0;
+    test_data_t thread_data = {&monitor, &data, 1};
+    pthread_t signaler_thread;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&signaler_thread, NULL, test_thread_signal_after_delay, &thread_data);
+    assert(monitor_wait_timed(&monitor, 10000) == 0);
+    waited = elapsed_ms(&start);
+    assert(waited < 5000);
+    pthread_join(signaler_thread, NULL);
+    printf("Timed wait test passed (signaled after %ld ms)\n", waited);
+
+    monitor_destroy(&monitor);
+}
+
 int main() { // main function
     printf("Starting Monitor Unit Tests...\n");
     
@@ -167,6 +211,7 @@ int main() { // main function
     test_signal_before_wait();
     test_multiple_waiters();
     test_reset_functionality();
+    test_timed_wait();
     
     printf("\n All monitor tests passed!\n");
     return 0;
@@ -0,0 +1,319 @@
+#include "output_sink.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int writev_all(int fd, struct iovec* iov, int count) { // write every piece, resuming after short writes
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) { // drop the pieces that went out
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+static int write_locked(output_sink_t* sink, const struct iovec* extra, int extra_count) { // buffer then extra, mutex held
+    struct iovec iov[OUTPUT_SINK_MAX_IOV + 1];
+    int count = 0;
+    if (sink->len > 0) {
+        iov[count].iov_base = sink->buffer;
+        iov[count].iov_len = sink->len;
+        count++;
+    }
+    for (int i = 0; i < extra_count; i++) {
+        if (extra[i].iov_len > 0) iov[count++] = extra[i];
+    }
+    sink->len = 0;
+    if (count == 0 || sink->failed) {
+        return sink->failed ? -1 : 0;
+    }
+    fflush(stdout); // stdio output written before this goes first
+    if (writev_all(sink->fd, iov, count) != 0) {
+        sink->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void deadline_of(const output_sink_t* sink, struct timespec* deadline) { // when the oldest buffered byte is due
+    *deadline = sink->oldest;
+    deadline->tv_nsec += (sink->flush_us % 1000000) * 1000;
+    deadline->tv_sec += sink->flush_us / 1000000 + deadline->tv_nsec / 1000000000;
+    deadline->tv_nsec %= 1000000000;
+}
+
+static void* flush_thread(void* arg) { // write out buffers that waited flush_us
+    output_sink_t* sink = (output_sink_t*)arg;
+    pthread_mutex_lock(&sink->mutex);
+    while (!sink->stopping) {
+        if (sink->len == 0) {
+            pthread_cond_wait(&sink->wake, &sink->mutex);
+            continue;
+        }
+        struct timespec deadline;
+        deadline_of(sink, &deadline);
+        if (pthread_cond_timedwait(&sink->wake, &sink->mutex, &deadline) == ETIMEDOUT && sink->len > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            deadline_of(sink, &deadline);
+            if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+                write_locked(sink, NULL, 0); // still the same bytes, not refilled after a flush
+            }
+        }
+    }
+    pthread_mutex_unlock(&sink->mutex);
+    return NULL;
+}
+
+int output_sink_init(output_sink_t* sink, int fd, size_t capacity, long flush_us) { // Initialize a sink
+    if (!sink || fd < 0) {
+        return -1;
+    }
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = fd;
+    sink->capacity = capacity > 0 ? capacity : OUTPUT_SINK_CAPACITY;
+    sink->flush_us = flush_us > 0 ? flush_us : OUTPUT_SINK_FLUSH_US;
+    sink->buffer = malloc(sink->capacity);
+    if (!sink->buffer) {
+        return -1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // deadlines come from clock_gettime(CLOCK_MONOTONIC)
+    int failed = pthread_mutex_init(&sink->mutex, NULL) != 0;
+    if (!failed && pthread_cond_init(&sink->wake, &attr) != 0) {
+        pthread_mutex_destroy(&sink->mutex);
+        failed = 1;
+    }
+    pthread_condattr_destroy(&attr);
+    if (!failed && pthread_cond_init(&sink->drained, NULL) != 0) {
+        pthread_cond_destroy(&sink->wake);
+        pthread_mutex_destroy(&sink->mutex);
+        failed = 1;
+    }
+    if (!failed && pthread_create(&sink->thread, NULL, flush_thread, sink) != 0) {
+        pthread_cond_destroy(&sink->drained);
+        pthread_cond_destroy(&sink->wake);
+        pthread_mutex_destroy(&sink->mutex);
+        failed = 1;
+    }
+    if (failed) {
+        free(sink->buffer);
+        sink->buffer = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int buffer_locked(output_sink_t* sink, const struct iovec* iov, int count) { // one record into the buffer, mutex held
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+
+    int result = 0;
+    if (sink->failed) {
+        result = -1;
+    } else if (total > sink->capacity - sink->len) { // no room, write buffer and record together
+        result = total >= sink->capacity ? write_locked(sink, iov, count) : write_locked(sink, NULL, 0);
+        if (result == 0 && total < sink->capacity) { // small enough to start the next buffer
+            for (int i = 0; i < count; i++) {
+                memcpy(sink->buffer + sink->len, iov[i].iov_base, iov[i].iov_len);
+                sink->len += iov[i].iov_len;
+            }
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            memcpy(sink->buffer + sink->len, iov[i].iov_base, iov[i].iov_len);
+            sink->len += iov[i].iov_len;
+        }
+    }
+    if (sink->len > 0 && sink->len == total) { // was empty, the flush thread starts the clock
+        clock_gettime(CLOCK_MONOTONIC, &sink->oldest);
+        pthread_cond_signal(&sink->wake);
+    }
+    return result;
+}
+
+static int hold_back(output_sink_t* sink, output_bytes_t* bytes, const struct iovec* iov, int count) { // keep pieces until their turn, mutex held
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+    if (total > bytes->capacity - bytes->len) {
+        size_t capacity = bytes->capacity > 0 ? bytes->capacity : 256;
+        while (capacity - bytes->len < total) {
+            capacity *= 2;
+        }
+        char* data = realloc(bytes->data, capacity);
+        if (!data) {
+            return -1;
+        }
+        bytes->data = data;
+        bytes->capacity = capacity;
+    }
+    for (int i = 0; i < count; i++) {
+        memcpy(bytes->data + bytes->len, iov[i].iov_base, iov[i].iov_len);
+        bytes->len += iov[i].iov_len;
+    }
+    sink->deferred += total;
+    return 0;
+}
+
+static int release_bytes(output_sink_t* sink, output_bytes_t* bytes) { // held back pieces go to the buffer, mutex held
+    int result = 0;
+    if (bytes->len > 0) {
+        struct iovec iov = { bytes->data, bytes->len };
+        result = buffer_locked(sink, &iov, 1);
+        sink->deferred -= bytes->len;
+    }
+    free(bytes->data);
+    *bytes = (output_bytes_t){ NULL, 0, 0 };
+    return result;
+}
+
+static int release_reservations(output_sink_t* sink, int all) { // write out committed reservations at the head, mutex held
+    int result = 0;
+    while (sink->reserved_head && (all || sink->reserved_head->committed)) {
+        output_reservation_t* done = sink->reserved_head;
+        sink->reserved_head = done->next;
+        if (!sink->reserved_head) {
+            sink->reserved_tail = NULL;
+        }
+        if (release_bytes(sink, &done->own) != 0 || release_bytes(sink, &done->after) != 0) { // empty unless forced out
+            result = -1;
+        }
+        free(done);
+        if (sink->reserved_head && release_bytes(sink, &sink->reserved_head->own) != 0) { // the next one writes straight through now
+            result = -1;
+        }
+    }
+    pthread_cond_broadcast(&sink->drained);
+    return result;
+}
+
+int output_sink_writev(output_sink_t* sink, const struct iovec* iov, int count) { // Buffer one record
+    if (!sink || !iov || count < 0 || count > OUTPUT_SINK_MAX_IOV) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&sink->mutex);
+    while (sink->reserved_tail && sink->deferred > OUTPUT_SINK_MAX_DEFERRED && !sink->stopping) { // far behind a reservation
+        pthread_cond_wait(&sink->drained, &sink->mutex);
+    }
+    int result = sink->reserved_tail ? hold_back(sink, &sink->reserved_tail->after, iov, count) // after the last reservation
+                                     : buffer_locked(sink, iov, count);
+    pthread_mutex_unlock(&sink->mutex);
+    return result;
+}
+
+output_reservation_t* output_sink_reserve(output_sink_t* sink) { // Reserve a record's place
+    if (!sink) {
+        return NULL;
+    }
+    output_reservation_t* reservation = calloc(1, sizeof(output_reservation_t));
+    if (!reservation) {
+        return NULL;
+    }
+    pthread_mutex_lock(&sink->mutex);
+    if (sink->reserved_tail) {
+        sink->reserved_tail->next = reservation;
+    } else {
+        sink->reserved_head = reservation;
+    }
+    sink->reserved_tail = reservation;
+    pthread_mutex_unlock(&sink->mutex);
+    return reservation;
+}
+
+int output_sink_writev_reserved(output_sink_t* sink, output_reservation_t* reservation, const struct iovec* iov,
+                                int count) { // Append to a reserved record
+    if (!sink || !reservation || !iov || count < 0 || count > OUTPUT_SINK_MAX_IOV) {
+        return -1;
+    }
+    pthread_mutex_lock(&sink->mutex);
+    int result = reservation == sink->reserved_head ? buffer_locked(sink, iov, count) // its turn, as a plain write
+                                                    : hold_back(sink, &reservation->own, iov, count);
+    pthread_mutex_unlock(&sink->mutex);
+    return result;
+}
+
+int output_sink_commit(output_sink_t* sink, output_reservation_t* reservation) { // Complete a reserved record
+    if (!sink || !reservation) {
+        return -1;
+    }
+    pthread_mutex_lock(&sink->mutex);
+    reservation->committed = 1;
+    int result = reservation == sink->reserved_head ? release_reservations(sink, 0) : 0; // later ones wait for their turn
+    pthread_mutex_unlock(&sink->mutex);
+    return result;
+}
+
+int output_sink_write_record(output_sink_t* sink, const char* data, size_t len) { // One record in the sink's framing
+    if (!sink || (!data && len > 0)) {
+        return -1;
+    }
+    if (sink->framing != FRAMING_LENPREFIX) {
+        struct iovec iov[2] = { { (char*)data, len }, { "\n", 1 } };
+        return output_sink_writev(sink, iov, 2);
+    }
+    unsigned char header[FRAME_HEADER_MAX];
+    struct iovec iov[2] = { { header, frame_encode_header(header, (uint64_t)len * 2) }, { (char*)data, len } };
+    return output_sink_writev(sink, iov, 2);
+}
+
+int output_sink_write_end(output_sink_t* sink) { // The end-of-stream frame
+    if (!sink) {
+        return -1;
+    }
+    if (sink->framing != FRAMING_LENPREFIX) {
+        return 0;
+    }
+    unsigned char header[FRAME_HEADER_MAX];
+    struct iovec iov = { header, frame_encode_header(header, FRAME_END_OF_STREAM) };
+    return output_sink_writev(sink, &iov, 1);
+}
+
+int output_sink_flush(output_sink_t* sink) { // Write out what is buffered
+    if (!sink) {
+        return -1;
+    }
+    pthread_mutex_lock(&sink->mutex);
+    int result = write_locked(sink, NULL, 0);
+    pthread_mutex_unlock(&sink->mutex);
+    return result;
+}
+
+void output_sink_destroy(output_sink_t* sink) { // Flush and stop
+    if (!sink || !sink->buffer) {
+        return;
+    }
+    pthread_mutex_lock(&sink->mutex);
+    release_reservations(sink, 1); // records never committed go out as far as they got
+    write_locked(sink, NULL, 0);
+    sink->stopping = 1;
+    pthread_cond_signal(&sink->wake);
+    pthread_mutex_unlock(&sink->mutex);
+    pthread_join(sink->thread, NULL);
+
+    pthread_cond_destroy(&sink->drained);
+    pthread_cond_destroy(&sink->wake);
+    pthread_mutex_destroy(&sink->mutex);
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
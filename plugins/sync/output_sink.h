@@ -0,0 +1,142 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include "framing.h"
+
+/**
+ * Buffered output writer
+ * Lines are copied into one large buffer and written with a single system call when the
+ * buffer fills up, when the oldest byte has waited flush_us, or when a flush is asked for.
+ * A background thread handles the timed flush. Writes larger than the free space go out
+ * in one writev together with what is buffered, without being copied.
+ * Bytes leave in the order they were written, whichever thread writes them, so every
+ * writer sharing a sink (and the plugins sharing the host's sink) stays ordered. Output
+ * already handed to stdio is flushed before the sink writes to the same descriptor.
+ * The sink also carries the pipeline's output framing: records written as frames get a
+ * varint length header (see framing.h) when it is FRAMING_LENPREFIX.
+ * A record can also be reserved first and written piece by piece later: it keeps the place
+ * in the output it had when reserved. Records written after it, and later reservations,
+ * are held back (in memory, up to OUTPUT_SINK_MAX_DEFERRED bytes) until it is committed,
+ * so nothing lands in the middle of it and nobody waits for it but plain writers once
+ * that much is held back.
+ */
+
+#define OUTPUT_SINK_CAPACITY (64 * 1024)             /* default buffer size */
+#define OUTPUT_SINK_FLUSH_US 5000                    /* default longest wait of a buffered byte */
+#define OUTPUT_SINK_MAX_IOV 8                        /* pieces per output_sink_writev call */
+#define OUTPUT_SINK_MAX_DEFERRED (1024 * 1024)       /* bytes held back behind open reservations before writers wait */
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} output_bytes_t;
+
+typedef struct output_reservation { // place of a record in the output, filled later
+    struct output_reservation* next; /* next reservation in output order */
+    output_bytes_t own;              /* the record's bytes while an earlier reservation is open */
+    output_bytes_t after;            /* records written after it and before the next reservation */
+    int committed;                   /* the record is complete */
+} output_reservation_t;
+
+typedef struct output_sink {
+    int fd;                          /* descriptor written to */
+    pthread_mutex_t mutex;           /* protects the buffer, held while writing so output stays ordered */
+    pthread_cond_t wake;             /* data arrived or the sink is stopping */
+    char* buffer;
+    size_t len;                      /* bytes buffered */
+    size_t capacity;
+    long flush_us;                   /* timed flush delay */
+    struct timespec oldest;          /* when the buffer last went from empty to non-empty */
+    int stopping;                    /* set by output_sink_destroy */
+    int failed;                      /* a write failed, later writes are dropped */
+    framing_t framing;               /* format of record output, set by the host after init */
+    pthread_t thread;                /* timed flush thread */
+    output_reservation_t* reserved_head; /* oldest open reservation, its bytes go straight to the buffer */
+    output_reservation_t* reserved_tail;
+    size_t deferred;                 /* bytes held back behind open reservations */
+    pthread_cond_t drained;          /* held back bytes went out */
+} output_sink_t;
+
+/**
+ * Initialize a sink and start its flush thread
+ * @param sink Pointer to sink structure
+ * @param fd Descriptor to write to (e.g. STDOUT_FILENO)
+ * @param capacity Buffer size in bytes, 0 for OUTPUT_SINK_CAPACITY
+ * @param flush_us Longest time a byte stays buffered in microseconds, 0 for OUTPUT_SINK_FLUSH_US
+ * @return 0 on success, -1 on failure
+ */
+int output_sink_init(output_sink_t* sink, int fd, size_t capacity, long flush_us);
+
+/**
+ * Write the pieces as one contiguous record, never split by another writer
+ * Waits while OUTPUT_SINK_MAX_DEFERRED bytes are held back behind open reservations
+ * @param sink Sink to write to
+ * @param iov Pieces to write, in order
+ * @param count Number of pieces, at most OUTPUT_SINK_MAX_IOV
+ * @return 0 on success, -1 on failure
+ */
+int output_sink_writev(output_sink_t* sink, const struct iovec* iov, int count);
+
+/**
+ * Reserve the place of a record in the output, records written from now on come after it
+ * @param sink Sink to write to
+ * @return The reservation, NULL on failure
+ */
+output_reservation_t* output_sink_reserve(output_sink_t* sink);
+
+/**
+ * Append pieces to a reserved record, never waits for earlier reservations
+ * @param sink Sink the record was reserved in
+ * @param reservation The record, not yet committed
+ * @param iov Pieces to write, in order
+ * @param count Number of pieces, at most OUTPUT_SINK_MAX_IOV
+ * @return 0 on success, -1 on failure
+ */
+int output_sink_writev_reserved(output_sink_t* sink, output_reservation_t* reservation, const struct iovec* iov,
+                                int count);
+
+/**
+ * Complete a reserved record and release it, what was held back behind it follows
+ * Every reservation must be committed, or the output stops at it
+ * @param sink Sink the record was reserved in
+ * @param reservation The record, invalid afterwards
+ * @return 0 on success, -1 on failure
+ */
+int output_sink_commit(output_sink_t* sink, output_reservation_t* reservation);
+
+/**
+ * Write one record in the sink's framing: a length-prefixed frame, or the bytes and a
+ * newline with FRAMING_LINES
+ * @param sink Sink to write to
+ * @param data Record payload
+ * @param len Payload length
+ * @return 0 on success, -1 on failure
+ */
+int output_sink_write_record(output_sink_t* sink, const char* data, size_t len);
+
+/**
+ * Write the end-of-stream frame (nothing with FRAMING_LINES)
+ * @param sink Sink to write to
+ * @return 0 on success, -1 on failure
+ */
+int output_sink_write_end(output_sink_t* sink);
+
+/**
+ * Write out everything buffered now
+ * @param sink Sink to flush
+ * @return 0 on success, -1 if a write failed
+ */
+int output_sink_flush(output_sink_t* sink);
+
+/**
+ * Flush, stop the flush thread and release the buffer
+ * Reservations still open are written out as far as they got, in order
+ * @param sink Sink to destroy
+ */
+void output_sink_destroy(output_sink_t* sink);
+
+#endif // OUTPUT_SINK_H
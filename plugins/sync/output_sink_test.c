@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "sync/output_sink.h"
+
+#define WRITER_THREADS 4
+#define WRITER_LINES 5000
+
+static size_t read_available(int fd, char* buf, size_t size) { // whatever is in the pipe right now
+    size_t total = 0;
+    ssize_t got;
+    while (total < size && (got = read(fd, buf + total, size - total)) > 0) {
+        total += (size_t)got;
+    }
+    return total;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+void test_buffer_and_flush() { // nothing leaves before a flush, then everything in order
+    printf("\n=== Test 1: Buffer and Flush ===\n");
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    output_sink_t sink;
+    assert(output_sink_init(&sink, fds[1], 1024, 10 * 1000 * 1000) == 0); // timed flush out of the way
+
+    struct iovec first[3] = { { "[logger] ", 9 }, { "one", 3 }, { "\n", 1 } };
+    struct iovec second[1] = { { "two\n", 4 } };
+    assert(output_sink_writev(&sink, first, 3) == 0);
+    assert(output_sink_writev(&sink, second, 1) == 0);
+
+    char buf[64];
+    assert(read_available(fds[0], buf, sizeof(buf)) == 0);
+    assert(output_sink_flush(&sink) == 0);
+    size_t got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 17 && memcmp(buf, "[logger] one\ntwo\n", 17) == 0);
+
+    output_sink_destroy(&sink);
+    close(fds[0]);
+    close(fds[1]);
+    printf("Buffer and flush test passed\n");
+}
+
+void test_size_and_large_writes() { // a full buffer goes out, oversized records bypass it in order
+    printf("\n=== Test 2: Size Flush and Large Writes ===\n");
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    output_sink_t sink;
+    assert(output_sink_init(&sink, fds[1], 16, 10 * 1000 * 1000) == 0);
+
+    struct iovec small = { "abcdefghij", 10 };
+    assert(output_sink_writev(&sink, &small, 1) == 0);
+    assert(output_sink_writev(&sink, &small, 1) == 0); // does not fit, the first one is written
+    char buf[128];
+    size_t got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 10 && memcmp(buf, "abcdefghij", 10) == 0);
+
+    char large[40];
+    memset(large, 'x', sizeof(large));
+    struct iovec big = { large, sizeof(large) };
+    assert(output_sink_writev(&sink, &big, 1) == 0); // buffered bytes first, then the record
+    got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 50 && memcmp(buf, "abcdefghij", 10) == 0 && memcmp(buf + 10, large, 40) == 0);
+
+    output_sink_destroy(&sink);
+    close(fds[0]);
+    close(fds[1]);
+    printf("Size flush and large writes test passed\n");
+}
+
+void test_timed_flush() { // buffered bytes leave on their own after flush_us
+    printf("\n=== Test 3: Timed Flush ===\n");
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    output_sink_t sink;
+    assert(output_sink_init(&sink, fds[1], 0, 5000) == 0);
+
+    struct iovec line = { "late\n", 5 };
+    assert(output_sink_writev(&sink, &line, 1) == 0);
+    char buf[16];
+    size_t got = 0;
+    for (int i = 0; i < 200 && got == 0; i++) { // well within a second
+        sleep_ms(5);
+        got = read_available(fds[0], buf, sizeof(buf));
+    }
+    assert(got == 5 && memcmp(buf, "late\n", 5) == 0);
+
+    output_sink_destroy(&sink);
+    close(fds[0]);
+    close(fds[1]);
+    printf("Timed flush test passed\n");
+}
+
+void test_framed_records() { // records get a varint header, the stream an end frame
+    printf("\n=== Test 4: Framed Records ===\n");
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    output_sink_t sink;
+    assert(output_sink_init(&sink, fds[1], 0, 10 * 1000 * 1000) == 0);
+    assert(output_sink_write_record(&sink, "a\nb", 3) == 0); // lines: bytes and a newline
+    assert(output_sink_write_end(&sink) == 0);                // nothing without framing
+    sink.framing = FRAMING_LENPREFIX;
+    assert(output_sink_write_record(&sink, "a\nb", 3) == 0);
+    assert(output_sink_write_record(&sink, "", 0) == 0);
+    assert(output_sink_write_end(&sink) == 0);
+    assert(output_sink_flush(&sink) == 0);
+
+    char buf[32];
+    size_t got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 10 && memcmp(buf, "a\nb\n\x06" "a\nb\x00\x01", 10) == 0);
+
+    output_sink_destroy(&sink);
+    close(fds[0]);
+    close(fds[1]);
+    printf("Framed records test passed\n");
+}
+
+void test_reservations() { // a reserved record keeps its place, later output waits behind it
+    printf("\n=== Test 5: Reservations ===\n");
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    output_sink_t sink;
+    assert(output_sink_init(&sink, fds[1], 1024, 10 * 1000 * 1000) == 0);
+
+    output_reservation_t* first = output_sink_reserve(&sink);
+    assert(first != NULL);
+    struct iovec a = { "a\n", 2 };
+    struct iovec b = { "b\n", 2 };
+    assert(output_sink_writev(&sink, &a, 1) == 0); // held back behind first
+    output_reservation_t* second = output_sink_reserve(&sink);
+    assert(second != NULL);
+    struct iovec two = { "two\n", 4 };
+    assert(output_sink_writev_reserved(&sink, second, &two, 1) == 0); // held back, first is still open
+    assert(output_sink_writev(&sink, &b, 1) == 0);
+    assert(output_sink_commit(&sink, second) == 0); // complete, but still behind first
+
+    struct iovec one[2] = { { "o", 1 }, { "ne", 2 } };
+    struct iovec end = { "\n", 1 };
+    assert(output_sink_writev_reserved(&sink, first, one, 2) == 0); // the oldest record writes straight through
+    assert(output_sink_flush(&sink) == 0);
+    char buf[64];
+    size_t got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 3 && memcmp(buf, "one", 3) == 0);
+    assert(sink.deferred == 8);
+
+    assert(output_sink_writev_reserved(&sink, first, &end, 1) == 0);
+    assert(output_sink_commit(&sink, first) == 0); // everything behind it follows, in order
+    assert(output_sink_flush(&sink) == 0);
+    got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 9 && memcmp(buf, "\na\ntwo\nb\n", 9) == 0);
+    assert(sink.deferred == 0 && sink.reserved_head == NULL);
+
+    output_reservation_t* unfinished = output_sink_reserve(&sink); // never committed
+    struct iovec part = { "par", 3 };
+    assert(output_sink_writev(&sink, &b, 1) == 0);
+    assert(output_sink_writev_reserved(&sink, unfinished, &part, 1) == 0);
+    output_sink_destroy(&sink); // goes out as far as it got
+    got = read_available(fds[0], buf, sizeof(buf));
+    assert(got == 5 && memcmp(buf, "parb\n", 5) == 0);
+
+    close(fds[0]);
+    close(fds[1]);
+    printf("Reservations test passed\n");
+}
+
+typedef struct {
+    output_sink_t* sink;
+    int id;
+} writer_arg_t;
+
+void* writer_thread(void* arg) { // numbered lines, each record in three pieces
+    writer_arg_t* writer = (writer_arg_t*)arg;
+    char prefix[16];
+    char number[16];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[w%d] ", writer->id);
+    for (int i = 0; i < WRITER_LINES; i++) {
+        int number_len = snprintf(number, sizeof(number), "%d", i);
+        struct iovec iov[3] = { { prefix, (size_t)prefix_len }, { number, (size_t)number_len }, { "\n", 1 } };
+        assert(output_sink_writev(writer->sink, iov, 3) == 0);
+    }
+    return NULL;
+}
+
+void test_concurrent_writers() { // records never interleave and each writer's lines stay in order
+    printf("\n=== Test 6: Concurrent Writers ===\n");
+
+    char path[] = "/tmp/output_sink_testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+    output_sink_t sink;
+    assert(output_sink_init(&sink, fd, 4096, 0) == 0);
+
+    pthread_t threads[WRITER_THREADS];
+    writer_arg_t args[WRITER_THREADS];
+    for (int i = 0; i < WRITER_THREADS; i++) {
+        args[i] = (writer_arg_t){ &sink, i };
+        pthread_create(&threads[i], NULL, writer_thread, &args[i]);
+    }
+    for (int i = 0; i < WRITER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    output_sink_destroy(&sink);
+
+    FILE* file = fdopen(fd, "r");
+    assert(file != NULL);
+    rewind(file);
+    int next[WRITER_THREADS] = { 0 };
+    int id, number, lines = 0;
+    while (fscanf(file, "[w%d] %d\n", &id, &number) == 2) {
+        assert(id >= 0 && id < WRITER_THREADS);
+        assert(number == next[id]);
+        next[id]++;
+        lines++;
+    }
+    assert(lines == WRITER_THREADS * WRITER_LINES);
+    fclose(file);
+    printf("Concurrent writers test passed\n");
+}
+
+int main() { // main test runner
+    printf("Starting Output Sink Unit Tests...\n");
+
+    test_buffer_and_flush();
+    test_size_and_large_writes();
+    test_timed_flush();
+    test_framed_records();
+    test_reservations();
+    test_concurrent_writers();
+
+    printf("\n All output sink tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,307 @@
+#include "scheduler.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct { // start argument of a worker thread
+    scheduler_t* scheduler;
+    int index;
+} worker_arg_t;
+
+static int deque_init(scheduler_deque_t* deque) {
+    deque->capacity = 16;
+    deque->head = 0;
+    deque->count = 0;
+    deque->tasks = (scheduler_task_t**)malloc(sizeof(scheduler_task_t*) * (size_t)deque->capacity);
+    if (!deque->tasks) {
+        return -1;
+    }
+    if (pthread_mutex_init(&deque->mutex, NULL) != 0) {
+        free(deque->tasks);
+        return -1;
+    }
+    return 0;
+}
+
+static void deque_destroy(scheduler_deque_t* deque) {
+    pthread_mutex_destroy(&deque->mutex);
+    free(deque->tasks);
+    deque->tasks = NULL;
+}
+
+static int deque_grow(scheduler_deque_t* deque) { // double the ring, mutex held
+    int capacity = deque->capacity * 2;
+    scheduler_task_t** tasks = (scheduler_task_t**)malloc(sizeof(scheduler_task_t*) * (size_t)capacity);
+    if (!tasks) {
+        return -1;
+    }
+    for (int i = 0; i < deque->count; i++) { // unwrap, top first
+        tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->capacity = capacity;
+    deque->head = 0;
+    return 0;
+}
+
+static int deque_push(scheduler_deque_t* deque, scheduler_task_t* task, int at_top) { // queue at the bottom or the top
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity && deque_grow(deque) != 0) {
+        pthread_mutex_unlock(&deque->mutex);
+        return -1;
+    }
+    if (at_top) {
+        deque->head = (deque->head + deque->capacity - 1) % deque->capacity;
+        deque->tasks[deque->head] = task;
+    } else {
+        deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+    }
+    __atomic_store_n(&deque->count, deque->count + 1, __ATOMIC_RELAXED); // thieves peek at it unlocked
+    pthread_mutex_unlock(&deque->mutex);
+    return 0;
+}
+
+static scheduler_task_t* deque_pop(scheduler_deque_t* deque, int from_top) { // newest (owner) or oldest (thief) task
+    scheduler_task_t* task = NULL;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        if (from_top) {
+            task = deque->tasks[deque->head];
+            deque->head = (deque->head + 1) % deque->capacity;
+        } else {
+            task = deque->tasks[(deque->head + deque->count - 1) % deque->capacity];
+        }
+        __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+static int deque_remove(scheduler_deque_t* deque, scheduler_task_t* task) { // take a given task out, 1 if it was queued here
+    int found = 0;
+    pthread_mutex_lock(&deque->mutex);
+    for (int i = 0; i < deque->count && !found; i++) {
+        if (deque->tasks[(deque->head + i) % deque->capacity] != task) {
+            continue;
+        }
+        for (int j = i; j + 1 < deque->count; j++) { // close the gap, the order of the others stays
+            deque->tasks[(deque->head + j) % deque->capacity] = deque->tasks[(deque->head + j + 1) % deque->capacity];
+        }
+        __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+
+static int current_worker(scheduler_t* scheduler) { // index of the calling thread's worker, -1 off the workers
+    return (int)(intptr_t)pthread_getspecific(scheduler->worker_key) - 1;
+}
+
+static scheduler_task_t* find_task(scheduler_t* scheduler, int self) { // own deque first, then steal the oldest elsewhere
+    scheduler_task_t* task = deque_pop(&scheduler->deques[self], 0);
+    for (int i = 1; !task && i < scheduler->num_workers; i++) {
+        scheduler_deque_t* victim = &scheduler->deques[(self + i) % scheduler->num_workers];
+        if (__atomic_load_n(&victim->count, __ATOMIC_RELAXED) == 0) { // peek, an empty deque is not locked
+            continue;
+        }
+        task = deque_pop(victim, 1);
+        if (task) {
+            atomic_fetch_add_explicit(&scheduler->steals, 1, memory_order_relaxed);
+        }
+    }
+    if (task) {
+        atomic_fetch_sub(&scheduler->queued, 1);
+    }
+    return task;
+}
+
+static void queue_task(scheduler_t* scheduler, scheduler_task_t* task, int at_top) { // push and wake a parked worker
+    int self = current_worker(scheduler);
+    int target = self >= 0 ? self : (int)(atomic_fetch_add(&scheduler->next_deque, 1) % (unsigned)scheduler->num_workers);
+    while (deque_push(&scheduler->deques[target], task, at_top) != 0) { // out of memory, try again shortly
+        struct timespec pause = { 0, 1000000L };
+        nanosleep(&pause, NULL);
+    }
+
+    // the count goes up before sleeping is read, a worker raises sleeping before it reads
+    // the count: one of the two sees the other, so a queued task never waits for nobody
+    atomic_fetch_add(&scheduler->queued, 1);
+    if (atomic_load(&scheduler->sleeping) > 0) {
+        pthread_mutex_lock(&scheduler->idle_mutex);
+        pthread_cond_signal(&scheduler->idle_cond);
+        pthread_mutex_unlock(&scheduler->idle_mutex);
+    }
+}
+
+static void* worker_thread(void* arg) { // run tasks until the scheduler stops
+    worker_arg_t start = *(worker_arg_t*)arg;
+    free(arg);
+    scheduler_t* scheduler = start.scheduler;
+    pthread_setspecific(scheduler->worker_key, (void*)(intptr_t)(start.index + 1));
+
+    for (;;) {
+        scheduler_task_t* task = find_task(scheduler, start.index);
+        if (task) {
+            atomic_fetch_add_explicit(&scheduler->runs, 1, memory_order_relaxed);
+            task->run(task);
+            continue;
+        }
+
+        // nothing anywhere, park until a task is queued
+        atomic_fetch_add(&scheduler->sleeping, 1);
+        pthread_mutex_lock(&scheduler->idle_mutex);
+        while (atomic_load(&scheduler->queued) == 0 && !scheduler->stopping) {
+            pthread_cond_wait(&scheduler->idle_cond, &scheduler->idle_mutex);
+        }
+        int stopping = scheduler->stopping && atomic_load(&scheduler->queued) == 0;
+        pthread_mutex_unlock(&scheduler->idle_mutex);
+        atomic_fetch_sub(&scheduler->sleeping, 1);
+        if (stopping) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&scheduler->idle_mutex); // registered hooks stay put once stopping
+    int hook_count = scheduler->exit_hook_count;
+    pthread_mutex_unlock(&scheduler->idle_mutex);
+    for (int i = 0; i < hook_count; i++) {
+        scheduler->exit_hooks[i]();
+    }
+    return NULL;
+}
+
+static void stop_workers(scheduler_t* scheduler, int started) { // wake every worker and wait for the first started
+    pthread_mutex_lock(&scheduler->idle_mutex);
+    scheduler->stopping = 1;
+    pthread_cond_broadcast(&scheduler->idle_cond);
+    pthread_mutex_unlock(&scheduler->idle_mutex);
+    for (int i = 0; i < started; i++) {
+        pthread_join(scheduler->threads[i], NULL);
+    }
+}
+
+static void release(scheduler_t* scheduler) { // free everything scheduler_init set up, the workers are gone
+    for (int i = 0; i < scheduler->num_workers; i++) {
+        deque_destroy(&scheduler->deques[i]);
+    }
+    pthread_cond_destroy(&scheduler->idle_cond);
+    pthread_mutex_destroy(&scheduler->idle_mutex);
+    pthread_key_delete(scheduler->worker_key);
+    free(scheduler->deques);
+    free(scheduler->threads);
+    scheduler->deques = NULL;
+    scheduler->threads = NULL;
+}
+
+int scheduler_init(scheduler_t* scheduler, int workers) { // Initialize and start the workers
+    if (!scheduler || workers < 0 || workers > SCHEDULER_MAX_WORKERS) {
+        return -1;
+    }
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus < 1 ? 1 : cpus > SCHEDULER_MAX_WORKERS ? SCHEDULER_MAX_WORKERS : (int)cpus;
+    }
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->deques = (scheduler_deque_t*)calloc((size_t)workers, sizeof(scheduler_deque_t));
+    scheduler->threads = (pthread_t*)calloc((size_t)workers, sizeof(pthread_t));
+    if (!scheduler->deques || !scheduler->threads || pthread_key_create(&scheduler->worker_key, NULL) != 0) {
+        free(scheduler->deques);
+        free(scheduler->threads);
+        return -1;
+    }
+    int ready = 0;
+    while (ready < workers && deque_init(&scheduler->deques[ready]) == 0) {
+        ready++;
+    }
+    if (ready < workers || pthread_mutex_init(&scheduler->idle_mutex, NULL) != 0) {
+        for (int i = 0; i < ready; i++) {
+            deque_destroy(&scheduler->deques[i]);
+        }
+        pthread_key_delete(scheduler->worker_key);
+        free(scheduler->deques);
+        free(scheduler->threads);
+        return -1;
+    }
+    pthread_cond_init(&scheduler->idle_cond, NULL);
+    atomic_init(&scheduler->queued, 0);
+    atomic_init(&scheduler->sleeping, 0);
+    atomic_init(&scheduler->next_deque, 0);
+    atomic_init(&scheduler->runs, 0);
+    atomic_init(&scheduler->steals, 0);
+
+    scheduler->num_workers = workers; // fixed before any worker looks at the deques
+    for (int i = 0; i < workers; i++) {
+        worker_arg_t* arg = (worker_arg_t*)malloc(sizeof(worker_arg_t));
+        if (arg) {
+            *arg = (worker_arg_t){ scheduler, i };
+        }
+        if (!arg || pthread_create(&scheduler->threads[i], NULL, worker_thread, arg) != 0) {
+            free(arg);
+            stop_workers(scheduler, i); // the ones that did start
+            release(scheduler);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void scheduler_submit(scheduler_t* scheduler, scheduler_task_t* task) { // Queue to run next
+    if (scheduler && task) {
+        queue_task(scheduler, task, 0);
+    }
+}
+
+void scheduler_requeue(scheduler_t* scheduler, scheduler_task_t* task) { // Queue behind the others
+    if (scheduler && task) {
+        queue_task(scheduler, task, 1);
+    }
+}
+
+int scheduler_help(scheduler_t* scheduler, scheduler_task_t* task) { // Run a queued task here
+    if (!scheduler || !task || current_worker(scheduler) < 0) {
+        return -1;
+    }
+    int found = 0;
+    for (int i = 0; i < scheduler->num_workers && !found; i++) {
+        scheduler_deque_t* deque = &scheduler->deques[i];
+        found = __atomic_load_n(&deque->count, __ATOMIC_RELAXED) > 0 && deque_remove(deque, task);
+    }
+    if (!found) { // running on another worker, or not submitted
+        return 0;
+    }
+    atomic_fetch_sub(&scheduler->queued, 1);
+    atomic_fetch_add_explicit(&scheduler->runs, 1, memory_order_relaxed);
+    task->run(task);
+    return 1;
+}
+
+int scheduler_at_worker_exit(scheduler_t* scheduler, void (*hook)(void)) { // Register an exit hook
+    if (!scheduler || !hook) {
+        return -1;
+    }
+    int result = 0;
+    pthread_mutex_lock(&scheduler->idle_mutex);
+    int known = 0;
+    for (int i = 0; i < scheduler->exit_hook_count; i++) {
+        known = known || scheduler->exit_hooks[i] == hook;
+    }
+    if (!known && scheduler->exit_hook_count == SCHEDULER_MAX_EXIT_HOOKS) {
+        result = -1;
+    } else if (!known) {
+        scheduler->exit_hooks[scheduler->exit_hook_count++] = hook;
+    }
+    pthread_mutex_unlock(&scheduler->idle_mutex);
+    return result;
+}
+
+void scheduler_destroy(scheduler_t* scheduler) { // Stop, join and release
+    if (!scheduler || !scheduler->deques) {
+        return;
+    }
+    stop_workers(scheduler, scheduler->num_workers);
+    release(scheduler);
+}
@@ -0,0 +1,105 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * Work-stealing task scheduler
+ * A fixed set of worker threads runs tasks. Every worker owns a deque: tasks it submits
+ * go to the bottom and it takes its next task from the bottom as well, so work handed
+ * downstream runs next on the same core while its data is still in cache. A worker with
+ * an empty deque steals the oldest task from the top of another worker's deque, and parks
+ * only when no deque holds anything.
+ * A task is submitted at most once at a time (the submitter keeps track), and may submit
+ * itself again while it runs. Deques are short (one entry per runnable task), so each is
+ * guarded by its own mutex, which thieves only take when the owner's deque is not empty.
+ * The worker a thread belongs to is kept in a pthread key, so copies of this code linked
+ * into different plugins all see the same workers.
+ */
+
+#define SCHEDULER_MAX_WORKERS 256                    /* upper bound of scheduler_init's workers */
+#define SCHEDULER_MAX_EXIT_HOOKS 64                  /* functions run by each worker before it exits */
+
+typedef struct scheduler_task { // embedded in whatever the task works on
+    void (*run)(struct scheduler_task* task);        /* runs on a worker */
+} scheduler_task_t;
+
+typedef struct { // one worker's tasks
+    pthread_mutex_t mutex;           /* protects the ring */
+    scheduler_task_t** tasks;        /* ring of queued tasks, grows as needed */
+    int capacity;
+    int head;                        /* index of the top (oldest) task */
+    int count;                       /* tasks queued */
+} scheduler_deque_t;
+
+typedef struct scheduler {
+    int num_workers;
+    scheduler_deque_t* deques;       /* one per worker */
+    pthread_t* threads;
+    pthread_key_t worker_key;        /* index + 1 of the calling thread's worker, NULL off the workers */
+    atomic_int queued;               /* tasks in all deques */
+    atomic_int sleeping;             /* workers parked on idle_cond */
+    atomic_uint next_deque;          /* round robin for tasks submitted from outside */
+    pthread_mutex_t idle_mutex;      /* protects stopping and the exit hooks, parks idle workers */
+    pthread_cond_t idle_cond;        /* a task was queued or the scheduler is stopping */
+    int stopping;
+    void (*exit_hooks[SCHEDULER_MAX_EXIT_HOOKS])(void);
+    int exit_hook_count;
+    atomic_ullong runs;              /* tasks run (statistics) */
+    atomic_ullong steals;            /* tasks taken from another worker's deque (statistics) */
+} scheduler_t;
+
+/**
+ * Initialize a scheduler and start its workers
+ * @param scheduler Pointer to scheduler structure
+ * @param workers Number of worker threads, 0 for one per online CPU
+ * @return 0 on success, -1 on failure
+ */
+int scheduler_init(scheduler_t* scheduler, int workers);
+
+/**
+ * Queue a task to run as soon as possible
+ * From a worker it goes to the bottom of that worker's deque and usually runs next there,
+ * from any other thread to the deques in turn
+ * @param scheduler The scheduler
+ * @param task Task to run, not queued already
+ */
+void scheduler_submit(scheduler_t* scheduler, scheduler_task_t* task);
+
+/**
+ * Queue a task behind everything already queued on the calling worker
+ * For a task giving the others a turn before it runs again
+ * @param scheduler The scheduler
+ * @param task Task to run, not queued already
+ */
+void scheduler_requeue(scheduler_t* scheduler, scheduler_task_t* task);
+
+/**
+ * Run a task on the calling worker now, if it is waiting in a deque
+ * For a task that cannot go on until another one makes progress (e.g. a full queue
+ * between them): it runs that one nested instead of sleeping. Only the task waited for
+ * is run, so the caller never ends up stacked below something that waits for it
+ * @param scheduler The scheduler
+ * @param task Task to run
+ * @return 1 if it ran, 0 if it was not queued (running elsewhere or not submitted), -1 if
+ *         the caller is no worker of this scheduler
+ */
+int scheduler_help(scheduler_t* scheduler, scheduler_task_t* task);
+
+/**
+ * Register a function every worker runs before it exits, e.g. to release thread caches
+ * @param scheduler The scheduler
+ * @param hook Function to run, registering it again has no effect
+ * @return 0 on success, -1 when SCHEDULER_MAX_EXIT_HOOKS are registered
+ */
+int scheduler_at_worker_exit(scheduler_t* scheduler, void (*hook)(void));
+
+/**
+ * Stop the workers, wait for them and release the scheduler
+ * No task may be queued or submitted any more
+ * @param scheduler The scheduler
+ */
+void scheduler_destroy(scheduler_t* scheduler);
+
+#endif // SCHEDULER_H
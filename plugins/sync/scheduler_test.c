@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <assert.h>
+#include <time.h>
+#include "sync/scheduler.h"
+
+#define TEST_TASKS 1000
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int wait_for(atomic_int* counter, int value) { // 1 once counter reaches value, 0 after a few seconds
+    for (int i = 0; i < 5000 && atomic_load(counter) < value; i++) {
+        sleep_ms(1);
+    }
+    return atomic_load(counter) >= value;
+}
+
+typedef struct { // task counting its runs
+    scheduler_task_t task;
+    scheduler_t* scheduler;
+    atomic_int* counter;
+    int repeats;                     // times the task queues itself again
+    long sleep_ms;
+    pthread_t ran_on;
+} count_task_t;
+
+static void count_run(scheduler_task_t* task) {
+    count_task_t* self = (count_task_t*)((char*)task - offsetof(count_task_t, task));
+    self->ran_on = pthread_self();
+    if (self->sleep_ms > 0) {
+        sleep_ms(self->sleep_ms);
+    }
+    if (self->repeats > 0) { // not counted until the last run
+        self->repeats--;
+        scheduler_requeue(self->scheduler, task);
+        return;
+    }
+    atomic_fetch_add(self->counter, 1);
+}
+
+void test_submit_and_run() { // every task submitted from outside runs once
+    printf("\n=== Test 1: Submit and Run ===\n");
+
+    scheduler_t scheduler;
+    assert(scheduler_init(&scheduler, 4) == 0);
+    assert(scheduler.num_workers == 4);
+
+    static count_task_t tasks[TEST_TASKS];
+    atomic_int counter;
+    atomic_init(&counter, 0);
+    for (int i = 0; i < TEST_TASKS; i++) {
+        tasks[i] = (count_task_t){ { count_run }, &scheduler, &counter, 0, 0, pthread_self() };
+        scheduler_submit(&scheduler, &tasks[i].task);
+    }
+    assert(wait_for(&counter, TEST_TASKS));
+    sleep_ms(10);
+    assert(atomic_load(&counter) == TEST_TASKS);
+    assert(atomic_load(&scheduler.runs) == TEST_TASKS);
+
+    scheduler_destroy(&scheduler);
+    printf("Submit and run test passed\n");
+}
+
+void test_requeue() { // a task queueing itself again runs once per requeue
+    printf("\n=== Test 2: Requeue ===\n");
+
+    scheduler_t scheduler;
+    assert(scheduler_init(&scheduler, 2) == 0);
+
+    count_task_t tasks[4];
+    atomic_int counter;
+    atomic_init(&counter, 0);
+    for (int i = 0; i < 4; i++) {
+        tasks[i] = (count_task_t){ { count_run }, &scheduler, &counter, 100, 0, pthread_self() };
+        scheduler_submit(&scheduler, &tasks[i].task);
+    }
+    assert(wait_for(&counter, 4));
+    assert(atomic_load(&scheduler.runs) == 4 * 101);
+
+    scheduler_destroy(&scheduler);
+    printf("Requeue test passed\n");
+}
+
+typedef struct { // task spawning children on its own worker
+    scheduler_task_t task;
+    scheduler_t* scheduler;
+    count_task_t* children;
+    int child_count;
+} spawn_task_t;
+
+static void spawn_run(scheduler_task_t* task) {
+    spawn_task_t* self = (spawn_task_t*)((char*)task - offsetof(spawn_task_t, task));
+    for (int i = 0; i < self->child_count; i++) { // all of them go to this worker's deque
+        scheduler_submit(self->scheduler, &self->children[i].task);
+    }
+}
+
+void test_stealing() { // idle workers take tasks queued on a busy one
+    printf("\n=== Test 3: Stealing ===\n");
+
+    scheduler_t scheduler;
+    assert(scheduler_init(&scheduler, 4) == 0);
+
+    count_task_t children[64];
+    atomic_int counter;
+    atomic_init(&counter, 0);
+    for (int i = 0; i < 64; i++) {
+        children[i] = (count_task_t){ { count_run }, &scheduler, &counter, 0, 2, pthread_self() };
+    }
+    spawn_task_t spawner = { { spawn_run }, &scheduler, children, 64 };
+    scheduler_submit(&scheduler, &spawner.task);
+    assert(wait_for(&counter, 64));
+    assert(atomic_load(&scheduler.steals) > 0);
+
+    int threads = 0; // the children ran on more than one worker
+    for (int i = 1; i < 64; i++) {
+        threads += !pthread_equal(children[i].ran_on, children[0].ran_on);
+    }
+    assert(threads > 0);
+
+    scheduler_destroy(&scheduler);
+    printf("Stealing test passed\n");
+}
+
+typedef struct { // task running another one through scheduler_help
+    scheduler_task_t task;
+    scheduler_t* scheduler;
+    count_task_t* other;
+    atomic_int* counter;
+    int helped;                      // scheduler_help of the queued task
+    int helped_again;                // scheduler_help once it ran
+} help_task_t;
+
+static void help_run(scheduler_task_t* task) {
+    help_task_t* self = (help_task_t*)((char*)task - offsetof(help_task_t, task));
+    scheduler_submit(self->scheduler, &self->other->task);
+    self->helped = scheduler_help(self->scheduler, &self->other->task);
+    self->helped_again = scheduler_help(self->scheduler, &self->other->task);
+    atomic_fetch_add(self->counter, 1);
+}
+
+void test_help() { // a worker runs a queued task nested, other threads cannot
+    printf("\n=== Test 4: Help ===\n");
+
+    scheduler_t scheduler;
+    assert(scheduler_init(&scheduler, 1) == 0); // nobody else could take the task
+
+    atomic_int counter;
+    atomic_init(&counter, 0);
+    count_task_t other = { { count_run }, &scheduler, &counter, 0, 0, pthread_self() };
+    help_task_t helper = { { help_run }, &scheduler, &other, &counter, -2, -2 };
+    scheduler_submit(&scheduler, &helper.task);
+    assert(wait_for(&counter, 2));
+    assert(helper.helped == 1);                 // ran right there
+    assert(helper.helped_again == 0);           // no longer queued
+    assert(!pthread_equal(other.ran_on, pthread_self()));
+    assert(scheduler_help(&scheduler, &other.task) == -1); // not a worker
+
+    scheduler_destroy(&scheduler);
+    printf("Help test passed\n");
+}
+
+static atomic_int exit_hook_runs;
+
+static void exit_hook(void) {
+    atomic_fetch_add(&exit_hook_runs, 1);
+}
+
+void test_exit_hooks() { // every worker runs each hook once on its way out
+    printf("\n=== Test 5: Exit Hooks ===\n");
+
+    scheduler_t scheduler;
+    assert(scheduler_init(&scheduler, 3) == 0);
+    atomic_init(&exit_hook_runs, 0);
+    assert(scheduler_at_worker_exit(&scheduler, exit_hook) == 0);
+    assert(scheduler_at_worker_exit(&scheduler, exit_hook) == 0); // registered once
+    assert(scheduler_at_worker_exit(&scheduler, NULL) == -1);
+    scheduler_destroy(&scheduler);
+    assert(atomic_load(&exit_hook_runs) == 3);
+
+    assert(scheduler_init(&scheduler, 0) == 0); // one worker per CPU
+    assert(scheduler.num_workers >= 1);
+    scheduler_destroy(&scheduler);
+    assert(scheduler_init(&scheduler, -1) == -1);
+    assert(scheduler_init(&scheduler, SCHEDULER_MAX_WORKERS + 1) == -1);
+    printf("Exit hooks test passed\n");
+}
+
+int main() { // main test runner
+    printf("Starting Scheduler Unit Tests...\n");
+
+    test_submit_and_run();
+    test_requeue();
+    test_stealing();
+    test_help();
+    test_exit_hooks();
+
+    printf("\n All scheduler tests passed!\n");
+    return 0;
+}
@@ -1,27 +1,276 @@
-#define _POSIX_C_SOURCE 200809L
-#include "plugin_common.h"
-#include <unistd.h>
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-
-// Typewriter plugin transform function
-
-static const char* plugin_transform(const char* input) { // transform the input string
-    if (!input) return NULL;
-    size_t len = strlen(input);
-    printf("[typewriter] ");
-    fflush(stdout);
-    for (size_t i = 0; i < len; i++) {
-        putchar(input[i]);
-        fflush(stdout);
-        usleep(100000); // 100ms
-    }
-    putchar('\n');
-    fflush(stdout);
-    return strdup(input);
-}
-
-const char* plugin_get_name(void) { return "typewriter"; } // get plugin name
-
-const char* plugin_init(int queue_size) { return common_plugin_init(plugin_transform, "typewriter", queue_size); } // initialize plugin
\ No newline at end of file
+#define _POSIX_C_SOURCE 200809L
+#include "plugin_common.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Typewriter emitter
+// The stage thread only queues a copy of each line and passes the item on, the characters
+// are written by an emitter thread that waits on a periodic timerfd, one character per tick.
+// Lines queue up behind the one being typed while the stage keeps going, so upstream stages
+// never wait on the typing. A late wakeup catches up with every tick it missed.
+// Each line reserves its place in the output when it is queued, before the item goes on, so
+// what later stages write comes out after the typed line and never inside it.
+// The plugin argument is the per-character delay in milliseconds: =0 writes each line at
+// once with no emitter thread, the default is 100.
+
+#define TYPEWRITER_DEFAULT_DELAY_MS 100
+#define TYPEWRITER_MAX_DELAY_MS 60000
+#define TYPEWRITER_MAX_PENDING (1024 * 1024) // bytes queued before the stage waits for the emitter
+
+typedef struct typed_line {
+    struct typed_line* next;
+    size_t len;
+    size_t pos;                      // characters written so far
+    int started;                     // the "[typewriter] " prefix is out
+    output_reservation_t* slot;      // the line's place in the output, committed when it is typed
+    char text[];
+} typed_line_t;
+
+typedef struct {
+    long delay_ms;
+    int timer_fd;                    // -1 with no delay
+    int timer_armed;
+    int stopping;                    // set by free_state, the emitter drops what is left
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;          // a line arrived, finished, or the emitter is stopping
+    typed_line_t* head;              // line being typed
+    typed_line_t* tail;
+    size_t pending;                  // bytes queued, bounded by TYPEWRITER_MAX_PENDING
+} typewriter_t;
+
+static int arm_timer(typewriter_t* tw, int on) { // periodic tick every delay_ms, or stopped
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (on) {
+        spec.it_interval.tv_sec = tw->delay_ms / 1000;
+        spec.it_interval.tv_nsec = (tw->delay_ms % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+    }
+    if (timerfd_settime(tw->timer_fd, 0, &spec, NULL) != 0) {
+        return -1;
+    }
+    tw->timer_armed = on;
+    return 0;
+}
+
+static void type_bytes(typed_line_t* line, const char* bytes, size_t len) { // into the line's place in the output
+    struct iovec iov = { (char*)bytes, len };
+    plugin_output_write_reserved(line->slot, &iov, 1);
+}
+
+static void pop_line(typewriter_t* tw) { // the head line is done, called with the mutex held
+    typed_line_t* line = tw->head;
+    tw->head = line->next;
+    if (!tw->head) tw->tail = NULL;
+    tw->pending -= line->len;
+    plugin_output_commit(line->slot); // what was written after the line follows it
+    free(line);
+    pthread_cond_broadcast(&tw->changed);
+}
+
+static void start_lines(typewriter_t* tw) { // prefix and first character of the head line, empty lines end at once
+    while (tw->head && !tw->head->started) {
+        typed_line_t* line = tw->head;
+        type_bytes(line, "[typewriter] ", 13);
+        line->started = 1;
+        if (line->len > 0) {
+            type_bytes(line, line->text, 1);
+            line->pos = 1;
+            return;
+        }
+        type_bytes(line, "\n", 1);
+        pop_line(tw);
+    }
+}
+
+static void emit_tick(typewriter_t* tw) { // one tick's output: the next character, or the end of the line
+    typed_line_t* line = tw->head;
+    if (!line) return;
+    if (line->pos < line->len) {
+        type_bytes(line, line->text + line->pos++, 1);
+        return;
+    }
+    type_bytes(line, "\n", 1);
+    pop_line(tw);
+    start_lines(tw); // the next line follows straight away, as it did when typed inline
+}
+
+static void* emitter_thread(void* arg) { // write queued lines, a character per timer tick
+    typewriter_t* tw = (typewriter_t*)arg;
+    pthread_mutex_lock(&tw->mutex);
+    while (!tw->stopping) {
+        if (!tw->head) {
+            if (tw->timer_armed) arm_timer(tw, 0); // idle, no wakeups
+            pthread_cond_wait(&tw->changed, &tw->mutex);
+            continue;
+        }
+        if (!tw->head->started) {
+            start_lines(tw);
+            plugin_output_flush(); // typed characters are seen right away
+            continue;
+        }
+        if (!tw->timer_armed && arm_timer(tw, 1) != 0) {
+            break;
+        }
+        pthread_mutex_unlock(&tw->mutex);
+        uint64_t ticks = 0;
+        ssize_t got = read(tw->timer_fd, &ticks, sizeof(ticks)); // blocks until the next tick
+        pthread_mutex_lock(&tw->mutex);
+        if (got != (ssize_t)sizeof(ticks)) {
+            if (got < 0 && errno == EINTR) continue;
+            break;
+        }
+        for (uint64_t t = 0; t < ticks && tw->head; t++) { // catch up on ticks missed
+            emit_tick(tw);
+        }
+        plugin_output_flush();
+    }
+    tw->stopping = 1; // wakes a stage waiting on a full queue or a flush
+    pthread_cond_broadcast(&tw->changed);
+    pthread_mutex_unlock(&tw->mutex);
+    return NULL;
+}
+
+static void typewriter_free(void* state) { // stop the emitter, unwritten lines are cut short
+    typewriter_t* tw = (typewriter_t*)state;
+    if (!tw) return;
+    if (tw->timer_fd >= 0) {
+        pthread_mutex_lock(&tw->mutex);
+        tw->stopping = 1;
+        pthread_cond_broadcast(&tw->changed);
+        pthread_mutex_unlock(&tw->mutex);
+        struct itimerspec now = { { 0, 0 }, { 0, 1 } };
+        timerfd_settime(tw->timer_fd, 0, &now, NULL); // the emitter may be waiting on a tick
+        pthread_join(tw->thread, NULL);
+        close(tw->timer_fd);
+    }
+    while (tw->head) {
+        pop_line(tw);
+    }
+    pthread_cond_destroy(&tw->changed);
+    pthread_mutex_destroy(&tw->mutex);
+    free(tw);
+}
+
+// Typewriter plugin transform function
+
+static const char* plugin_parse_args(const char* args, void** state) { // per-character delay, starts the emitter
+    long delay_ms = TYPEWRITER_DEFAULT_DELAY_MS;
+    if (args) {
+        char* end = NULL;
+        errno = 0;
+        delay_ms = strtol(args, &end, 10);
+        if (errno != 0 || end == args || *end != '\0' || delay_ms < 0 || delay_ms > TYPEWRITER_MAX_DELAY_MS) {
+            return "Invalid typewriter delay (expected milliseconds from 0 to 60000)";
+        }
+    }
+
+    typewriter_t* tw = calloc(1, sizeof(typewriter_t));
+    if (!tw) {
+        return "Memory allocation failure";
+    }
+    tw->delay_ms = delay_ms;
+    tw->timer_fd = -1;
+    pthread_mutex_init(&tw->mutex, NULL);
+    pthread_cond_init(&tw->changed, NULL);
+    if (delay_ms == 0) { // lines are written by the stage itself
+        *state = tw;
+        return NULL;
+    }
+
+    tw->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tw->timer_fd < 0) {
+        typewriter_free(tw);
+        return "Failed to create typewriter timer";
+    }
+    if (pthread_create(&tw->thread, NULL, emitter_thread, tw) != 0) {
+        close(tw->timer_fd);
+        tw->timer_fd = -1;
+        typewriter_free(tw);
+        return "Failed to create typewriter thread";
+    }
+    *state = tw;
+    return NULL;
+}
+
+static int plugin_transform_inplace(plugin_buffer_t* item, void* state) { // hand the line to the emitter, the item passes unchanged behind it
+    typewriter_t* tw = (typewriter_t*)state;
+    if (!item || !tw) {
+        return -1;
+    }
+
+    if (tw->timer_fd < 0) { // no delay, the whole line goes to the output sink now
+        struct iovec iov[3] = { { "[typewriter] ", 13 }, { item->ptr, item->len }, { "\n", 1 } };
+        return plugin_output_write(iov, 3);
+    }
+
+    typed_line_t* line = malloc(sizeof(typed_line_t) + item->len); // freed by the emitter thread
+    if (!line) {
+        return -1;
+    }
+    memcpy(line->text, item->ptr, item->len);
+    line->next = NULL;
+    line->len = item->len;
+    line->pos = 0;
+    line->started = 0;
+
+    pthread_mutex_lock(&tw->mutex);
+    while (tw->head && tw->pending + line->len > TYPEWRITER_MAX_PENDING && !tw->stopping) { // the emitter is far behind
+        pthread_cond_wait(&tw->changed, &tw->mutex);
+    }
+    if (tw->stopping) {
+        pthread_mutex_unlock(&tw->mutex);
+        free(line);
+        return -1;
+    }
+    line->slot = plugin_output_reserve(); // in queue order, and before anything downstream writes
+    if (tw->tail) {
+        tw->tail->next = line;
+    } else {
+        tw->head = line;
+    }
+    tw->tail = line;
+    tw->pending += line->len;
+    pthread_cond_broadcast(&tw->changed);
+    pthread_mutex_unlock(&tw->mutex);
+    return 0;
+}
+
+static int plugin_transform(const plugin_buffer_t* input, plugin_buffer_t* output, void* state) { // transform input buffer
+    if (!input || !output) {
+        return -1;
+    }
+    if (plugin_buffer_alloc(output, input->len + 1) != 0) {
+        return -1;
+    }
+    memcpy(output->ptr, input->ptr, input->len + 1);
+    output->len = input->len;
+    return plugin_transform_inplace(output, state);
+}
+
+static int plugin_flush(void* state) { // wait until every queued line has been typed
+    typewriter_t* tw = (typewriter_t*)state;
+    if (!tw || tw->timer_fd < 0) {
+        return plugin_output_flush();
+    }
+    pthread_mutex_lock(&tw->mutex);
+    while (tw->head && !tw->stopping) {
+        pthread_cond_wait(&tw->changed, &tw->mutex);
+    }
+    int result = tw->head ? -1 : 0;
+    pthread_mutex_unlock(&tw->mutex);
+    return plugin_output_flush() == 0 ? result : -1;
+}
+
+static const plugin_ops_t g_plugin_ops = { "typewriter", plugin_transform, plugin_transform_inplace, NULL, plugin_parse_args, typewriter_free, plugin_flush }; // transforms run by the framework
+
+const char* plugin_get_name(void) { return "typewriter"; } // get plugin name
+const char* plugin_init(int queue_size) { return common_plugin_init_v2(&g_plugin_ops, queue_size); } // initialize plugin
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance) { return common_plugin_instance_init_v2(&g_plugin_ops, config, instance); } // create an instance
@@ -2,30 +2,180 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
-// Uppercaser plugin transformation function
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UPPERCASER_X86 1
+#else
+#define UPPERCASER_X86 0
+#endif
+
+// Uppercaser kernels
+// Input is treated as UTF-8. ASCII letters are converted 16 (SSE2) or 32 (AVX2) bytes at a
+// time, only the non-ASCII sequences inside a block go through the scalar UTF-8 code below.
+// Only conversions that keep the encoded length are made (Latin-1, Latin Extended-A,
+// Greek and Cyrillic), so every kernel works in place. Malformed sequences are left as is.
+
+static unsigned int upper_code_point(unsigned int cp) { // uppercase of a two byte code point, or cp itself
+    if (cp == 0xB5) return 0x39C;                                             // micro sign -> Greek capital mu
+    if (cp >= 0xE0 && cp <= 0xFE && cp != 0xF7) return cp - 0x20;            // Latin-1 supplement
+    if (cp == 0xFF) return 0x178;                                             // y with diaeresis
+    if (cp >= 0x100 && cp <= 0x137 && cp != 0x131) return cp & 1 ? cp - 1 : cp; // Latin Extended-A pairs
+    if (cp >= 0x139 && cp <= 0x148) return cp & 1 ? cp : cp - 1;
+    if (cp >= 0x14A && cp <= 0x177) return cp & 1 ? cp - 1 : cp;
+    if (cp == 0x17A || cp == 0x17C || cp == 0x17E) return cp - 1;
+    if (cp == 0x3AC) return 0x386;                                            // Greek with tonos
+    if (cp >= 0x3AD && cp <= 0x3AF) return cp - 0x25;
+    if (cp == 0x3C2) return 0x3A3;                                            // final sigma
+    if (cp >= 0x3B1 && cp <= 0x3CB) return cp - 0x20;                         // Greek
+    if (cp == 0x3CC) return 0x38C;
+    if (cp == 0x3CD || cp == 0x3CE) return cp - 0x3F;
+    if (cp >= 0x430 && cp <= 0x44F) return cp - 0x20;                         // Cyrillic
+    if (cp >= 0x450 && cp <= 0x45F) return cp - 0x50;
+    if ((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF) || (cp >= 0x4D0 && cp <= 0x52F)) {
+        return cp & 1 ? cp - 1 : cp;
+    }
+    if (cp >= 0x4C1 && cp <= 0x4CE) return cp & 1 ? cp : cp - 1;
+    if (cp == 0x4CF) return 0x4C0;
+    return cp;
+}
+
+static size_t utf8_upper_one(unsigned char* s, size_t avail) { // convert the sequence at s, return its length
+    unsigned char lead = s[0];
+    if (lead < 0x80) {
+        if (lead >= 'a' && lead <= 'z') s[0] = (unsigned char)(lead - 0x20);
+        return 1;
+    }
+    if (lead >= 0xC2 && lead <= 0xDF) { // two byte sequence, the only ones with a same length uppercase
+        if (avail < 2 || (s[1] & 0xC0) != 0x80) return 1;
+        unsigned int cp = ((unsigned int)(lead & 0x1F) << 6) | (s[1] & 0x3F);
+        unsigned int upper = upper_code_point(cp);
+        if (upper != cp) {
+            s[0] = (unsigned char)(0xC0 | (upper >> 6));
+            s[1] = (unsigned char)(0x80 | (upper & 0x3F));
+        }
+        return 2;
+    }
+    size_t need = lead >= 0xE0 && lead <= 0xEF ? 3 : lead >= 0xF0 && lead <= 0xF4 ? 4 : 1;
+    if (need == 1 || avail < need) return 1;
+    for (size_t i = 1; i < need; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 1;
+    }
+    return need; // valid, no same length mapping, keep it
+}
+
+static size_t utf8_upper_run(unsigned char* s, size_t pos, size_t end, size_t len) { // scalar path up to end
+    while (pos < end) {
+        pos += utf8_upper_one(s + pos, len - pos);
+    }
+    return pos; // a sequence may run past end
+}
+
+static void uppercase_scalar(char* str, size_t len) { // one byte at a time
+    utf8_upper_run((unsigned char*)str, 0, len, len);
+}
+
+#if UPPERCASER_X86
+static size_t utf8_upper_marked(unsigned char* s, size_t block, unsigned int mask, size_t pos, size_t len) { // non-ASCII bytes of a block
+    while (mask) { // only the marked bytes go through the scalar path, the ASCII ones are done
+        size_t j = block + (size_t)__builtin_ctz(mask);
+        if (j >= pos) { // not a continuation byte of a sequence handled already
+            pos = j + utf8_upper_one(s + j, len - j);
+        }
+        mask &= mask - 1;
+    }
+    return pos;
+}
 
-static const char* plugin_transform(const char* input) { // transform the input string
-    if (!input) {
-        return NULL;
-    }
-    
-    // Create a copy of the input string
-    char* result = strdup(input);
-    if (!result) {
-        return NULL;
-    }
-    
-    // Convert all alphabetic characters to uppercase
-    for (int i = 0; result[i] != '\0'; i++) {
-        if (isalpha(result[i])) {
-            result[i] = toupper(result[i]);
+static void uppercase_sse2(char* str, size_t len) { // 16 bytes at a time
+    unsigned char* s = (unsigned char*)str;
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    size_t pos = 0;      // next byte the UTF-8 path has not looked at
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        int non_ascii = _mm_movemask_epi8(v); // bytes >= 0x80 are negative, never inside 'a'..'z'
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, before_a), _mm_cmplt_epi8(v, after_z));
+        _mm_storeu_si128((__m128i*)(s + i), _mm_sub_epi8(v, _mm_and_si128(lower, case_bit)));
+        if (non_ascii) {
+            pos = utf8_upper_marked(s, i, (unsigned int)non_ascii, pos, len);
         }
     }
-    
-    return result;
+    utf8_upper_run(s, pos > i ? pos : i, len, len);
 }
 
+__attribute__((target("avx2")))
+static void uppercase_avx2(char* str, size_t len) { // 32 bytes at a time
+    unsigned char* s = (unsigned char*)str;
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i z = _mm256_set1_epi8('z');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    size_t pos = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        int non_ascii = _mm256_movemask_epi8(v);
+        __m256i lower = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, z), _mm256_cmpgt_epi8(v, before_a));
+        _mm256_storeu_si256((__m256i*)(s + i), _mm256_sub_epi8(v, _mm256_and_si256(lower, case_bit)));
+        if (non_ascii) {
+            pos = utf8_upper_marked(s, i, (unsigned int)non_ascii, pos, len);
+        }
+    }
+    utf8_upper_run(s, pos > i ? pos : i, len, len);
+}
+#endif
+
+static void (*g_uppercase_kernel)(char* str, size_t len) = uppercase_scalar;
+static const char* g_uppercase_kernel_name = "scalar";
+
+__attribute__((constructor))
+static void uppercase_select_kernel(void) { // pick the widest kernel the CPU supports, once at load time
+#if UPPERCASER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_uppercase_kernel = uppercase_avx2;
+        g_uppercase_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        g_uppercase_kernel = uppercase_sse2;
+        g_uppercase_kernel_name = "sse2";
+    }
+#endif
+}
+
+// Uppercaser plugin transformation function
+
+static int plugin_transform(const plugin_buffer_t* input, plugin_buffer_t* output, void* state) { // transform the input buffer
+    (void)state; // no plugin argument
+    if (!input || !output) {
+        return -1;
+    }
+
+    // Create a copy of the input bytes
+    if (plugin_buffer_alloc(output, input->len + 1) != 0) {
+        return -1;
+    }
+    memcpy(output->ptr, input->ptr, input->len + 1);
+    output->len = input->len;
+
+    // Convert all letters to uppercase
+    g_uppercase_kernel(output->ptr, output->len);
+    return 0;
+}
+
+static int plugin_transform_inplace(plugin_buffer_t* item, void* state) { // uppercase the owned buffer directly
+    (void)state; // no plugin argument
+    if (!item) {
+        return -1;
+    }
+    g_uppercase_kernel(item->ptr, item->len);
+    return 0;
+}
+
+static const plugin_ops_t g_plugin_ops = { "uppercaser", plugin_transform, plugin_transform_inplace, NULL, NULL, NULL, NULL }; // transforms run by the framework
+
 const char* plugin_get_name(void) { return "uppercaser"; } // get plugin name
-const char* plugin_init(int queue_size) { return common_plugin_init(plugin_transform, "uppercaser", queue_size); } // initialize plugin
\ No newline at end of file
+const char* plugin_init(int queue_size) { return common_plugin_init_v2(&g_plugin_ops, queue_size); } // initialize plugin
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance) { return common_plugin_instance_init_v2(&g_plugin_ops, config, instance); } // create an instance
+const char* plugin_get_pure(const char* args, plugin_fused_t* fused) { return common_plugin_get_pure(&g_plugin_ops, args, fused); } // pure, may be fused
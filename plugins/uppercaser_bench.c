@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+/* pull in the implementation so we reach the static kernels */
+#include "uppercaser.c"
+
+// Microbenchmark for the uppercaser kernels
+// Usage: ./output/uppercaser_bench [megabytes]
+// Every kernel converts the same ASCII and mixed UTF-8 inputs, the results are checked
+// against each other before any timing is reported.
+
+#define BENCH_LINE 64 // typical line length in the pipeline
+
+typedef struct {
+    const char* name;
+    void (*kernel)(char* str, size_t len);
+} bench_kernel_t;
+
+static void uppercase_legacy(char* str, size_t len) { // the original per byte loop
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (isalpha(c)) {
+            str[i] = (char)toupper(c);
+        }
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void fill_input(char* buf, size_t size, int utf8) { // random words, optionally with UTF-8 letters
+    static const char* const words_utf8[] = { "Ångström", "wörld", "αβγ", "жизнь", "café", "ÿes" };
+    size_t pos = 0;
+    unsigned int seed = 12345;
+    while (pos < size) {
+        seed = seed * 1103515245u + 12345u;
+        if (utf8 && (seed >> 16) % 4 == 0) {
+            const char* word = words_utf8[(seed >> 8) % 6];
+            size_t len = strlen(word);
+            if (pos + len > size) break;
+            memcpy(buf + pos, word, len);
+            pos += len;
+        } else {
+            buf[pos++] = (char)((seed >> 16) % 3 == 0 ? ' ' : 'a' + (seed >> 8) % 26);
+        }
+    }
+    while (pos < size) buf[pos++] = ' ';
+}
+
+static double run_kernel(void (*kernel)(char*, size_t), const char* input, char* work, size_t size) { // MB/s
+    memcpy(work, input, size);
+    double start = now_seconds();
+    for (size_t off = 0; off < size; off += BENCH_LINE) { // line by line, as the pipeline calls it
+        size_t len = size - off < BENCH_LINE ? size - off : BENCH_LINE;
+        kernel(work + off, len);
+    }
+    double elapsed = now_seconds() - start;
+    return elapsed > 0 ? (double)size / (1024.0 * 1024.0) / elapsed : 0.0;
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 64;
+    if (megabytes == 0) megabytes = 1;
+    size_t size = megabytes * 1024 * 1024;
+
+    bench_kernel_t kernels[4];
+    int num_kernels = 0;
+    kernels[num_kernels++] = (bench_kernel_t){ "legacy", uppercase_legacy };
+    kernels[num_kernels++] = (bench_kernel_t){ "scalar", uppercase_scalar };
+#if UPPERCASER_X86
+    kernels[num_kernels++] = (bench_kernel_t){ "sse2", uppercase_sse2 };
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[num_kernels++] = (bench_kernel_t){ "avx2", uppercase_avx2 };
+    }
+#endif
+
+    char* input = malloc(size);
+    char* expected = malloc(size);
+    char* work = malloc(size);
+    if (!input || !expected || !work) {
+        fprintf(stderr, "Memory allocation failure\n");
+        return 1;
+    }
+
+    printf("Uppercaser kernels, %zu MB in %d byte lines, dispatch picks '%s'\n", megabytes, BENCH_LINE, g_uppercase_kernel_name);
+    for (int utf8 = 0; utf8 <= 1; utf8++) {
+        fill_input(input, size, utf8);
+
+        // every vector kernel must match the scalar UTF-8 kernel byte for byte
+        memcpy(expected, input, size);
+        for (size_t off = 0; off < size; off += BENCH_LINE) {
+            uppercase_scalar(expected + off, size - off < BENCH_LINE ? size - off : BENCH_LINE);
+        }
+        for (int k = 2; k < num_kernels; k++) {
+            run_kernel(kernels[k].kernel, input, work, size);
+            if (memcmp(work, expected, size) != 0) {
+                fprintf(stderr, "Kernel %s disagrees with scalar on %s input\n", kernels[k].name, utf8 ? "UTF-8" : "ASCII");
+                return 1;
+            }
+        }
+
+        printf("%s input:\n", utf8 ? "UTF-8" : "ASCII");
+        for (int k = 0; k < num_kernels; k++) {
+            double best = 0.0;
+            for (int round = 0; round < 3; round++) {
+                double mbps = run_kernel(kernels[k].kernel, input, work, size);
+                if (mbps > best) best = mbps;
+            }
+            printf("  %-7s %9.1f MB/s\n", kernels[k].name, best);
+        }
+    }
+    printf("All kernels agree\n");
+
+    free(input);
+    free(expected);
+    free(work);
+    return 0;
+}
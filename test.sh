@@ -101,6 +101,14 @@ else
     failures=$((failures+1))
 fi
 
+print_info "Running monitor unit tests (pthread monitor)"
+if timeout 10 ./output/monitor_pthread_test >/dev/null 2>&1; then
+    print_status "Monitor unit tests (pthread monitor): PASS"
+else
+    print_error "Monitor unit tests (pthread monitor): FAIL"
+    failures=$((failures+1))
+fi
+
 print_info "Running consumer-producer unit tests"
 if timeout 10 ./output/consumer_producer_test >/dev/null 2>&1; then
     print_status "Consumer-producer unit tests: PASS"
@@ -109,21 +117,131 @@ else
     failures=$((failures+1))
 fi
 
+print_info "Running item pool unit tests"
+if timeout 10 ./output/item_pool_test >/dev/null 2>&1; then
+    print_status "Item pool unit tests: PASS"
+else
+    print_error "Item pool unit tests: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running output sink unit tests"
+if timeout 10 ./output/output_sink_test >/dev/null 2>&1; then
+    print_status "Output sink unit tests: PASS"
+else
+    print_error "Output sink unit tests: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running line reader unit tests"
+if timeout 10 ./output/line_reader_test >/dev/null 2>&1; then
+    print_status "Line reader unit tests: PASS"
+else
+    print_error "Line reader unit tests: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running scheduler unit tests"
+if timeout 10 ./output/scheduler_test >/dev/null 2>&1; then
+    print_status "Scheduler unit tests: PASS"
+else
+    print_error "Scheduler unit tests: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running affinity unit tests"
+if timeout 10 ./output/affinity_test >/dev/null 2>&1; then
+    print_status "Affinity unit tests: PASS"
+else
+    print_error "Affinity unit tests: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running coroutine unit tests"
+if timeout 10 ./output/coroutine_test >/dev/null 2>&1; then
+    print_status "Coroutine unit tests: PASS"
+else
+    print_error "Coroutine unit tests: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running uppercaser kernel benchmark (kernels must agree)"
+if timeout 30 ./output/uppercaser_bench 1 >/dev/null 2>&1; then
+    print_status "Uppercaser kernels: PASS"
+else
+    print_error "Uppercaser kernels: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running flipper kernel benchmark (kernels must agree)"
+if timeout 30 ./output/flipper_bench 1 >/dev/null 2>&1; then
+    print_status "Flipper kernels: PASS"
+else
+    print_error "Flipper kernels: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running expander kernel benchmark (kernels must agree)"
+if timeout 30 ./output/expander_bench 1 >/dev/null 2>&1; then
+    print_status "Expander kernels: PASS"
+else
+    print_error "Expander kernels: FAIL"
+    failures=$((failures+1))
+fi
+
+print_info "Running ingest benchmark (readers must agree)"
+if timeout 30 ./output/ingest_bench 4 >/dev/null 2>&1; then
+    print_status "Ingest readers: PASS"
+else
+    print_error "Ingest readers: FAIL"
+    failures=$((failures+1))
+fi
+
 # basic plugin functionality tests
 print_status "=== BASIC PLUGIN TESTS ==="
 
 run_test "uppercaser basic" "[logger] HELLO" \
     "echo -e 'hello\\n<END>' | ./output/analyzer 10 uppercaser logger | grep '\\[logger\\]' | head -n1"
 
+run_test "uppercaser UTF-8" "[logger] ÅNGSTRÖM ΑΒΓ ЖИЗНЬ" \
+    "echo -e 'Ångström αβγ жизнь\\n<END>' | ./output/analyzer 10 uppercaser logger | grep '\\[logger\\]' | head -n1"
+
+run_test "uppercaser long line" "[logger] $(printf 'AB%.0s' {1..100})É" \
+    "echo -e \"$(printf 'ab%.0s' {1..100})é\\n<END>\" | ./output/analyzer 10 uppercaser logger | grep '\\[logger\\]' | head -n1"
+
 run_test "rotator basic" "[logger] ohell" \
     "echo -e 'hello\\n<END>' | ./output/analyzer 10 rotator logger | grep '\\[logger\\]' | head -n1"
 
+run_test "rotator shift" "[logger] llohe,[logger] llohe" \
+    "(echo -e 'hello\\n<END>' | ./output/analyzer 10 rotator=3 logger; echo -e 'hello\\n<END>' | ./output/analyzer 10 rotator=-2 logger) | grep '\\[logger\\]' | paste -sd,"
+
+run_test "consecutive rotators merge" "[logger] lehol" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 rotator=7 rotator rotator:2=-1 flipper logger | grep '\\[logger\\]' | head -n1"
+
+run_test "rotator shift larger than the line" "[logger] ohell,[logger] x" \
+    "echo -e 'hello\\nx\\n<END>' | ./output/analyzer 10 rotator=-9 logger | grep '\\[logger\\]' | paste -sd,"
+
 run_test "flipper basic" "[logger] olleh" \
     "echo -e 'hello\\n<END>' | ./output/analyzer 10 flipper logger | grep '\\[logger\\]' | head -n1"
 
+run_test "flipper long line" "[logger] c$(printf 'ba%.0s' {1..100})" \
+    "echo -e \"$(printf 'ab%.0s' {1..100})c\\n<END>\" | ./output/analyzer 10 flipper logger | grep '\\[logger\\]' | head -n1"
+
+run_test "flipper UTF-8 mode" "[logger] γβα olléh" \
+    "echo -e 'héllo αβγ\\n<END>' | ./output/analyzer 10 flipper=utf8 logger | grep '\\[logger\\]' | head -n1"
+
+run_test "flipper grapheme mode" "[logger] $(printf 'e\xcc\x81fac')" \
+    "printf 'cafe\\xcc\\x81\\n<END>\\n' | ./output/analyzer 10 flipper=grapheme logger | grep '\\[logger\\]' | head -n1"
+
+run_test "flipper UTF-8 mode when fused" "[logger] HOLLÉ" \
+    "echo -e 'héllo\\n<END>' | ./output/analyzer 10 uppercaser flipper:2=utf8 rotator logger | grep '\\[logger\\]' | head -n1"
+
 run_test "expander basic" "[logger] h e l l o" \
     "echo -e 'hello\\n<END>' | ./output/analyzer 10 expander logger | grep '\\[logger\\]' | head -n1"
 
+run_test "expander vector path and tail" "[logger] $(echo abcdefghijklmnopqrstuvwxyz0123456789 | sed 's/./& /g; s/ $//'),[logger] " \
+    "echo -e 'abcdefghijklmnopqrstuvwxyz0123456789\\n\\n<END>' | ./output/analyzer 10 expander logger | grep '\\[logger\\]' | paste -sd,"
+
 # plugin combination tests
 print_status "=== PLUGIN COMBINATION TESTS ==="
 
@@ -217,6 +335,143 @@ run_test "queue size 1" "[logger] HELLO" \
 run_test "queue size 100" "[logger] HELLO" \
     "echo -e 'hello\\n<END>' | ./output/analyzer 100 uppercaser logger | grep '\\[logger\\]' | head -n1"
 
+# multi-worker stage tests
+print_status "=== MULTI-WORKER TESTS ==="
+
+run_test "multi-worker keeps order" "[logger] A,[logger] B,[logger] C,[logger] D,[logger] E" \
+    "echo -e 'a\\nb\\nc\\nd\\ne\\n<END>' | ./output/analyzer 2 uppercaser:3 logger | grep '\\[logger\\]' | paste -sd,"
+
+run_test "multi-worker chain" "[logger] O L L E H" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 uppercaser:2 flipper:4 expander logger | grep '\\[logger\\]' | head -n1"
+
+run_error_test "invalid worker count" "echo '<END>' | ./output/analyzer 10 uppercaser:0 logger"
+
+# shared worker scheduler tests
+print_status "=== SCHEDULER TESTS ==="
+
+run_test "scheduler keeps order" "$(seq 1 20000 | ./output/analyzer 2 rotator=3 logger | md5sum)" \
+    "seq 1 20000 | ./output/analyzer --scheduler=3 2 rotator=3 logger | md5sum"
+
+run_test "scheduler runs a long chain on one worker" "[logger] O L L E H,[logger] D L R O W" \
+    "echo -e 'hello\\nworld\\n<END>' | ./output/analyzer --scheduler=1 1 uppercaser logger flipper logger expander logger | grep '\\[logger\\] . ' | paste -sd,"
+
+run_test "scheduler ignores worker counts" "[logger] OLLEH" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer --scheduler 10 uppercaser:4 flipper logger | grep '\\[logger\\]'"
+
+run_test "scheduler passes flush and checkpoint frames" "0a48454c4c4f0a574f524c4401" \
+    "printf '\\x0ahello\\x03\\x05\\x0aworld\\x01' | ./output/analyzer --scheduler=2 --framing=lenprefix 10 uppercaser logger | od -An -tx1 | tr -d ' \\n'"
+
+run_error_test "invalid scheduler worker count" "echo '<END>' | ./output/analyzer --scheduler=0 10 logger"
+
+# single thread coroutine tests
+print_status "=== COROUTINE TESTS ==="
+
+run_test "coroutines keep order" "$(seq 1 20000 | ./output/analyzer 2 rotator=3 logger | md5sum)" \
+    "seq 1 20000 | ./output/analyzer --coroutines 2 rotator=3 logger | md5sum"
+
+run_test "coroutines run a long chain through one-item queues" "[logger] O L L E H,[logger] D L R O W" \
+    "echo -e 'hello\\nworld\\n<END>' | ./output/analyzer --coroutines 1 uppercaser logger flipper logger expander logger | grep '\\[logger\\] . ' | paste -sd,"
+
+run_test "coroutines ignore worker counts" "[logger] OLLEH" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer --coroutines 10 uppercaser:4 flipper logger | grep '\\[logger\\]'"
+
+run_test "coroutines pass flush and checkpoint frames" "0a48454c4c4f0a574f524c4401" \
+    "printf '\\x0ahello\\x03\\x05\\x0aworld\\x01' | ./output/analyzer --coroutines --framing=lenprefix 10 uppercaser logger | od -An -tx1 | tr -d ' \\n'"
+
+run_error_test "coroutines and scheduler are exclusive" "echo '<END>' | ./output/analyzer --coroutines --scheduler 10 logger"
+
+# CPU placement tests
+print_status "=== PLACEMENT TESTS ==="
+
+run_test "pinned stages keep their output" "[logger] OLLEH" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer --pin=compact 10 uppercaser:2 flipper logger 2>/dev/null | grep '\\[logger\\]'"
+
+run_contains_test "placement is printed at startup" "logger -> CPU" \
+    "echo '<END>' | ./output/analyzer --pin=spread 10 uppercaser logger 2>&1"
+
+run_contains_test "scheduler workers are pinned" "scheduler worker 0 -> CPU" \
+    "echo '<END>' | ./output/analyzer --pin=compact --scheduler 10 uppercaser logger 2>&1"
+
+run_error_test "invalid CPU list" "echo '<END>' | ./output/analyzer --pin=0-x 10 logger"
+
+# repeated plugin tests
+print_status "=== REPEATED PLUGIN TESTS ==="
+
+run_test "same plugin twice" "[logger] lohel" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 rotator rotator logger | grep '\\[logger\\]' | head -n1"
+
+run_test "flipper twice restores input" "[logger] hello" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 flipper:2 flipper logger | grep '\\[logger\\]' | head -n1"
+
+run_test "logger twice" "2" \
+    "echo -e 'hi\\n<END>' | ./output/analyzer 10 logger logger | grep -c '\\[logger\\] hi'"
+
+# stage fusion tests
+print_status "=== STAGE FUSION TESTS ==="
+
+run_test "fused stages keep every transform" "[logger] L E H O L" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 uppercaser rotator rotator flipper expander logger | grep '\\[logger\\]' | head -n1"
+
+run_test "fusion stops at side effects" "[logger] hello,[logger] OHELL" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 logger uppercaser:2 rotator logger | grep '\\[logger\\]' | paste -sd,"
+
+# view tests, reorders compose without touching the bytes
+print_status "=== VIEW TESTS ==="
+
+run_test "views compose before a case change" "[logger] ELLOH,[logger] ÉLLOH" \
+    "echo -e 'hello\\nhéllo\\n<END>' | ./output/analyzer 10 flipper rotator flipper uppercaser logger | grep '\\[logger\\]' | paste -sd,"
+
+run_test "reorders cancel out" "[logger] $(printf 'ab%.0s' {1..1000})" \
+    "echo -e \"$(printf 'ab%.0s' {1..1000})\\n<END>\" | ./output/analyzer 10 rotator:2 flipper rotator flipper logger | grep '\\[logger\\]'"
+
+run_test "views are written out for UTF-8 flips" "[logger] llého" \
+    "echo -e 'héllo\\n<END>' | ./output/analyzer 10 rotator flipper=utf8 logger | grep '\\[logger\\]'"
+
+run_contains_test "views are written out for the typewriter" "\\[typewriter\\] acb" \
+    "echo -e 'abc\\n<END>' | ./output/analyzer 10 flipper rotator typewriter"
+
+run_test "long views are written out with the vector kernels" "[logger] $(seq -s '' 1 100 | rev | sed 's/^\(.*\)\(.\)$/\2\1/')" \
+    "echo -e \"$(seq -s '' 1 100)\\n<END>\" | ./output/analyzer 10 flipper rotator logger | grep '\\[logger\\]'"
+
+# buffer (SDK v2) tests
+print_status "=== BUFFER TESTS ==="
+
+run_test "embedded NUL bytes survive" "[logger] A@B" \
+    "printf 'a\\0b\\n<END>\\n' | ./output/analyzer 10 uppercaser logger | tr '\\0' '@' | grep '\\[logger\\]'"
+
+run_test "lines longer than 1024 bytes" "4008" \
+    "(head -c 2000 /dev/zero | tr '\\0' 'a'; echo; echo '<END>') | ./output/analyzer 10 expander:2 logger | grep '\\[logger\\]' | awk '{print length(\$0)}'"
+
+run_test "lines longer than the read block" "1048576,[logger] x" \
+    "(head -c 1048576 /dev/zero | tr '\\0' 'a'; echo; echo x; echo '<END>') | ./output/analyzer 10 logger | awk '{print length(\$0) == 1048585 ? 1048576 : \$0}' | paste -sd,"
+
+run_test "file input, <END> implied at its end" "[logger] HELLO,[logger] WORLD" \
+    "printf 'hello\\nworld' > /tmp/analyzer_input.txt && ./output/analyzer -f /tmp/analyzer_input.txt 10 uppercaser logger | paste -sd,; rm -f /tmp/analyzer_input.txt"
+
+run_contains_test "typewriter types transformed items" "\\[typewriter\\] OHELL" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 uppercaser rotator typewriter"
+
+run_test "in-place transforms after a logger" "[logger] hello,[logger] EHOLL" \
+    "echo -e 'hello\\n<END>' | ./output/analyzer 10 logger flipper:3 rotator uppercaser rotator logger | grep '\\[logger\\]' | paste -sd,"
+
+# framed (--framing=lenprefix) tests
+print_status "=== FRAMING TESTS ==="
+
+run_test "framed records keep newlines and empty records" "0a48454c4c4f0c574f0a524c440001" \
+    "printf '\\x0ahello\\x0cwo\\nrld\\x00\\x01' | ./output/analyzer --framing=lenprefix 10 uppercaser logger | od -An -tx1 | tr -d ' \\n'"
+
+run_test "framed <END> record is data" "0a3c454e443e044f4b01" \
+    "printf '\\x0a<END>\\x04ok\\x01' | ./output/analyzer --framing=lenprefix 10 uppercaser logger | od -An -tx1 | tr -d ' \\n'"
+
+run_test "flush and checkpoint frames pass between records" "0a48454c4c4f0a574f524c4401" \
+    "printf '\\x0ahello\\x03\\x05\\x0aworld\\x03\\x01' | ./output/analyzer --framing=lenprefix 10 uppercaser:2 logger | od -An -tx1 | tr -d ' \\n'"
+
+run_test "framed file input" "0a6f68656c6c01" \
+    "printf '\\x0ahello\\x01' > /tmp/analyzer_frames.bin && ./output/analyzer --framing=lenprefix -f /tmp/analyzer_frames.bin 10 rotator logger | od -An -tx1 | tr -d ' \\n'; rm -f /tmp/analyzer_frames.bin"
+
+run_test "framed records longer than 127 bytes" "$(printf 'A%.0s' {1..300})" \
+    "(printf '\\xd8\\x04'; printf 'a%.0s' {1..300}; printf '\\x01') | ./output/analyzer --framing=lenprefix 10 uppercaser logger | tail -c +3 | head -c 300"
+
 # assignment compliance tests
 print_status "=== ASSIGNMENT COMPLIANCE ==="
 
@@ -229,12 +484,45 @@ print_status "=== TYPEWRITER TESTS ==="
 run_contains_test "typewriter output format" "\\[typewriter\\] hi" \
     "echo -e 'hi\\n<END>' | ./output/analyzer 10 typewriter"
 
+run_test "typewriter types queued lines in order" "[typewriter] ab,[typewriter] ,[typewriter] cde" \
+    "echo -e 'ab\\n\\ncde\\n<END>' | ./output/analyzer 10 typewriter=5 | grep '\\[typewriter\\]' | paste -sd,"
+
+run_contains_test "typewriter does not hold up the pipeline" "Plugin 'typewriter' did not finish in time, 0 items left in its queue" \
+    "(seq 1 50; echo '<END>') | ./output/analyzer --drain-timeout=300 2 uppercaser typewriter=1000 logger > /dev/null; echo \"exit status \$?\""
+
+run_test "typed line stays whole and ahead of later stages" "[typewriter] abcdefgh,[logger] abcdefgh" \
+    "for i in \$(seq 1 20); do printf 'abcdefgh\\n<END>\\n' | ./output/analyzer 10 typewriter=1 logger | paste -sd,; done | sort -u"
+
+run_test "typed lines interleave with later stages only between lines" "60 0" \
+    "(seq 1 30; echo '<END>') | ./output/analyzer 10 typewriter=1 logger | awk '/^\\[typewriter\\] [0-9]+\$/ { typed[\$2] = 1; n++; next } /^\\[logger\\] [0-9]+\$/ && typed[\$2] { n++; next } { bad++ } END { print n, bad + 0 }'"
+
+run_test "typewriter with no delay" "2000" \
+    "(seq 1 2000; echo '<END>') | timeout 10 ./output/analyzer 10 typewriter=0 | grep -c '^\\[typewriter\\] [0-9]*\$'"
+
 # shutdown tests
 print_status "=== SHUTDOWN TESTS ==="
 
 run_contains_test "pipeline shutdown message" "Pipeline shutdown complete" \
     "echo -e '<END>' | ./output/analyzer 10 logger"
 
+# shutdown tests
+print_status "=== SHUTDOWN TESTS ==="
+
+run_test "end of input without <END> drains the pipeline" "[logger] HELLO,[logger] WORLD" \
+    "printf 'hello\\nworld' | ./output/analyzer 10 uppercaser:2 logger | grep '\\[logger\\]' | paste -sd,"
+
+run_test "SIGTERM ends the input" "[logger] HELLO" \
+    "(echo hello; sleep 2) | { ./output/analyzer 10 uppercaser logger & pid=\$!; sleep 0.5; kill -TERM \$pid; wait \$pid; } | grep '\\[logger\\]'"
+
+run_contains_test "drain timeout reports the stage left behind" "Plugin 'typewriter' did not finish in time" \
+    "echo -e 'abcdef\\n<END>' | ./output/analyzer --drain-timeout=200 10 typewriter=1000 logger > /dev/null; echo \"exit status \$?\""
+
+run_test "drain timeout exits with status 1" "1" \
+    "echo -e 'abcdef\\n<END>' | ./output/analyzer --drain-timeout=200 10 typewriter=1000 > /dev/null; echo \$?"
+
+run_test "drain within the timeout" "[logger] abc" \
+    "echo -e 'abc\\n<END>' | ./output/analyzer --drain-timeout=5000 10 typewriter=1 logger | grep '\\[logger\\]'"
+
 # error condition tests
 print_status "=== ERROR CONDITION TESTS ==="
 
@@ -244,6 +532,15 @@ run_error_test "invalid queue size negative" "./output/analyzer -5 logger"
 run_error_test "invalid queue size zero" "./output/analyzer 0 logger"
 run_error_test "non-numeric queue size" "./output/analyzer abc logger"
 run_error_test "invalid plugin" "./output/analyzer 10 nonexistent_plugin"
+run_error_test "malformed frame" "printf '\\x0ahello\\x07' | ./output/analyzer --framing=lenprefix 10 logger"
+run_error_test "truncated frame" "printf '\\x0ahel' | ./output/analyzer --framing=lenprefix -f /dev/stdin 10 logger"
+run_error_test "invalid drain timeout" "echo '<END>' | ./output/analyzer --drain-timeout=soon 10 logger"
+run_error_test "unknown option" "echo '<END>' | ./output/analyzer --framing=xml 10 logger"
+run_error_test "missing input file" "./output/analyzer -f /nonexistent/input.txt 10 logger"
+run_error_test "invalid plugin argument" "echo '<END>' | ./output/analyzer 10 flipper=sideways logger"
+run_error_test "invalid rotator shift" "echo '<END>' | ./output/analyzer 10 rotator=2x logger"
+run_error_test "invalid typewriter delay" "echo '<END>' | ./output/analyzer 10 typewriter=-1 logger"
+run_error_test "argument to a plugin without arguments" "echo '<END>' | ./output/analyzer 10 uppercaser logger=x"
 
 # summary, including total tests, passed tests, and failed tests
 print_status "=== TEST SUMMARY ==="